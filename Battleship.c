@@ -1,1152 +1,9203 @@
+#ifndef _WIN32
+#define _GNU_SOURCE // POSIX and Linux extensions (clock_gettime, shm_open, futex)
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h> // Link with -lm
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
 #else
 #include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <signal.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
 #endif
 
 #define GRID_SIZE 10
 #define INPUT_SIZE 100
 #define NAME_SIZE 50
 
-#define NUM_SHIPS 4 // Carrier, Battleship, Destroyer, Submarine
+#define MAX_SHIPS 10          // Largest fleet a configuration may define
+#define MAX_SHIP_SIZE GRID_SIZE
+#define SHIP_NAME_SIZE 20
 
 // To store the coordinates of the ships
 typedef struct
 {
     int shipSize;
-    int coords[5][2];
-    char name[20];
+    int coords[MAX_SHIP_SIZE][2];
+    char name[SHIP_NAME_SIZE];
     int sunk;
 } Ship;
 
-// Create arrays to store ship coordinates for both players
-Ship player1Ships[NUM_SHIPS];
-Ship player2Ships[NUM_SHIPS];
-
-int smokeDurationGrid[GRID_SIZE][GRID_SIZE] = {0}; // To track smoke durations
+// Sizes and names of the ships of a fleet, in placement order
+typedef struct
+{
+    int count;
+    int sizes[MAX_SHIPS];
+    char names[MAX_SHIPS][SHIP_NAME_SIZE];
+} Fleet;
 
-// Function to clear the screen (platform dependent)
-void clearScreen()
+// Built-in fleets, selected with --fleet NAME
+typedef struct
 {
-#ifdef _WIN32
-    system("cls"); // For Windows
-#else
-    system("clear"); // For Linux/Unix/Mac
-#endif
-}
+    const char *name;
+    Fleet fleet;
+} FleetPreset;
+
+const FleetPreset fleetPresets[] = {
+    {"standard", {4, {5, 4, 3, 2}, {"Carrier", "Battleship", "Destroyer", "Submarine"}}},
+    {"classic", {5, {5, 4, 3, 3, 2}, {"Carrier", "Battleship", "Cruiser", "Submarine", "Destroyer"}}},
+};
+#define NUM_FLEET_PRESETS (int)(sizeof(fleetPresets) / sizeof(fleetPresets[0]))
+
+// The fleet every player uses in this game, chosen before play starts
+Fleet fleet = {4, {5, 4, 3, 2}, {"Carrier", "Battleship", "Destroyer", "Submarine"}};
+
+// Random number state, kept per thread so simulated games can run in parallel
+static THREAD_LOCAL uint64_t rngState = 0x853C49E6748FEA9BULL;
 
-// Function to clear input buffer
-void clearInputBuffer()
+// Function to seed the game random number generator
+void seedGameRand(uint64_t seed)
 {
-    int ch;
-    while ((ch = getchar()) != '\n' && ch != EOF)
-        ;
+    // Run the seed through splitmix64 so nearby seeds give unrelated streams
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    rngState = (z ^ (z >> 31)) | 1; // xorshift state must never be zero
 }
-// Function to validate column input
-int isValidColumn(char colChar)
+
+// Function to draw a non-negative random number, used in place of rand()
+int gameRand()
 {
-    return (toupper(colChar) >= 'A' && toupper(colChar) <= 'J');
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (int)((rngState * 0x2545F4914F6CDD1DULL) >> 33);
 }
 
-// Function to check if the ship can be placed without overlapping or going out of bounds
-int isValidPlacement(char grid[GRID_SIZE][GRID_SIZE], int row, int col, int shipSize, char orientation)
-{
-    if (orientation == 'H')
-    {
-        if (col + shipSize > GRID_SIZE)
-            return 0; // Out of bounds
+// Weapons a shot can come from, used when reporting shot results
+#define WEAPON_FIRE 0
+#define WEAPON_ARTILLERY 1
+#define WEAPON_TORPEDO 2
+#define NUM_WEAPONS 3
 
-        for (int i = 0; i < shipSize; i++)
-        {
-            if (grid[row][col + i] != '~') // Check if space is already occupied
-                return 0;
-        }
-    }
-    else if (orientation == 'V')
-    {
-        if (row + shipSize > GRID_SIZE)
-            return 0; // Out of bounds
+// Structured game log. Rule functions describe what happened as small binary
+// records instead of printing. A record is shown on this player's screen right
+// away (unless output is quiet) and, when a log file is open, appended to a
+// per-thread buffer that a background writer formats as text or NDJSON.
+#define LOG_LEVEL_OFF 0    // No log file records at all
+#define LOG_LEVEL_GAMES 1  // Game start, players and winner
+#define LOG_LEVEL_EVENTS 2 // Turns, sunk ships, unlocked and expired weapons
+#define LOG_LEVEL_SHOTS 3  // Every shot, radar sweep and smoke screen
+#define LOG_LEVEL_ALL 4    // Bot narration and placement
 
-        for (int i = 0; i < shipSize; i++)
-        {
-            if (grid[row + i][col] != '~') // Check if space is already occupied
-                return 0;
-        }
-    }
-    return 1; // Valid placement
-}
+#define LOG_FORMAT_TEXT 0
+#define LOG_FORMAT_NDJSON 1
+
+// Record types, with the meaning of their data bytes
+#define LOG_GAME_START 1      // difficulty, first player
+#define LOG_PLAYER 2          // 7 bytes of the player's name, chunk = part number
+#define LOG_TURN 3            // turn number (low byte, high byte)
+#define LOG_FIRE 4            // row, col, result (0 miss, 1 hit, 2 already fired)
+#define LOG_ARTILLERY 5       // row, col of the top left corner
+#define LOG_ARTILLERY_CELL 6  // row, col, hit
+#define LOG_TORPEDO 7         // axis ('R' or 'C'), row or column
+#define LOG_TORPEDO_CELL 8    // row, col, hit
+#define LOG_RADAR 9           // row, col, ships found
+#define LOG_SMOKE 10          // row, col
+#define LOG_SUNK 11           // ship index, row, col of its first cell, orientation ('H' or 'V'), size
+#define LOG_UNLOCK 12         // weapon (WEAPON_ARTILLERY or WEAPON_TORPEDO)
+#define LOG_EXPIRE 13         // weapon that ran out unused
+#define LOG_GAME_OVER 14      // winner
+#define LOG_BOT_FIRE 15       // row, col
+#define LOG_BOT_WEAPON 16     // weapon the bot is about to use
+#define LOG_BOT_TORPEDO 17    // axis, row or column of a follow-up torpedo
+#define LOG_BOT_TORPEDO_HIT 18 // axis
+#define LOG_BOT_PLACE_RETRY 19
+#define LOG_BOT_PLACED 20
 
-// Function to place a ship on the grid
-void placeShip(char grid[GRID_SIZE][GRID_SIZE], Ship *ship, int shipSize, const char *shipName)
+#define LOG_FLAG_PRIVATE 1 // Not shown on the players' screen (Hard mode results, bookkeeping)
+
+typedef struct
 {
-    int row, col;
-    char colChar, orientation;
-    char input[INPUT_SIZE];
+    uint32_t game;   // Game number within the run
+    uint8_t type;    // LOG_* record type
+    uint8_t player;  // Player who acted
+    uint8_t flags;   // LOG_FLAG_*
+    uint8_t chunk;   // Part number of a LOG_PLAYER record
+    uint8_t data[8]; // Type specific values
+} LogRecord;
 
-    ship->shipSize = shipSize;    // Store ship size
-    strcpy(ship->name, shipName); // Store ship name
-    ship->sunk = 1;               // Initialize the sunk flag to 1 (not sunk)
+// What a formatter remembers between records of one stream
+typedef struct
+{
+    char names[2][NAME_SIZE];
+} LogFormatState;
 
-    printf("Place your %s (Size: %d): \n", shipName, shipSize);
+// Records below this level reach emitLogRecord. With quiet output and no log
+// file it is LOG_LEVEL_OFF, so LOG_EVENT costs one compare and its arguments
+// are never evaluated.
+static THREAD_LOCAL int logThreshold = LOG_LEVEL_ALL;
 
-    do
-    {
-        // Get input for column and row (e.g., B3)
-        while (1)
-        {
-            printf("Enter column and row (e.g., B3): ");
-            fgets(input, sizeof(input), stdin);
+// When set, nothing is shown on screen (used by the simulator)
+static THREAD_LOCAL int quietOutput = 0;
 
-            // Remove newline character from the input buffer
-            if (input[strlen(input) - 1] == '\n')
-                input[strlen(input) - 1] = '\0';
+// Game and player that new records belong to
+static THREAD_LOCAL uint32_t logGame = 0;
+static THREAD_LOCAL int logPlayer = 0;
+static THREAD_LOCAL int logTurnNumber = 0;
 
-            // Parse the column and row (e.g., B3)
-            if (sscanf(input, " %c%d", &colChar, &row) == 2 && isValidColumn(colChar) && row >= 1 && row <= 10)
-            {
-                col = toupper(colChar) - 'A'; // Convert 'A'-'J' to 0-9
-                row -= 1;                     // Adjust row to zero-index
-                break;                        // Valid input, exit loop
-            }
-            else
-            {
-                printf("Invalid input. Please enter in the format B3.\n");
-            }
-        }
+static THREAD_LOCAL LogFormatState screenFormat; // Names seen by the on-screen formatter
 
-        // Get input for orientation (H or V)
-        while (1)
-        {
-            printf("Enter orientation (H for horizontal, V for vertical): ");
-            fgets(input, sizeof(input), stdin);
+int logLevel = LOG_LEVEL_ALL; // Highest level written to the log file
+int logFormat = LOG_FORMAT_TEXT;
 
-            // Remove newline character from the input buffer
-            if (input[strlen(input) - 1] == '\n')
-                input[strlen(input) - 1] = '\0';
+#define LOG_EVENT(level, type, flags, ...)                                          \
+    do                                                                              \
+    {                                                                               \
+        if ((level) <= logThreshold)                                                \
+            emitLogRecord((level), (type), (flags), (const uint8_t[8]){__VA_ARGS__}); \
+    } while (0)
 
-            // Validate orientation (H or V)
-            if (strlen(input) == 1 && (toupper(input[0]) == 'H' || toupper(input[0]) == 'V'))
-            {
-                orientation = toupper(input[0]); // Convert to uppercase
-                break;                           // Valid orientation, exit loop
-            }
-            else
-            {
-                printf("Invalid orientation. Please enter H or V.\n");
-            }
-        }
+#define LOG_BUFFER_RECORDS 4096 // Records per thread buffer (64 KB)
+#define LOG_MAX_BUFFERS 64      // Producers wait once this many buffers are in flight
+#define LOG_OUTPUT_SIZE (256 * 1024)
 
-        // Check for valid placement
-        if (!isValidPlacement(grid, row, col, shipSize, orientation))
-        {
-            printf("Invalid placement. Either out of bounds or overlapping. Try again.\n");
-        }
+// One producing thread's formatter state; it outlives the thread until the log is closed
+typedef struct LogStream
+{
+    LogFormatState format;
+    struct LogStream *next;
+} LogStream;
 
-    } while (!isValidPlacement(grid, row, col, shipSize, orientation));
+typedef struct LogBuffer
+{
+    struct LogBuffer *next;
+    LogStream *stream;
+    int count;
+    LogRecord records[LOG_BUFFER_RECORDS];
+} LogBuffer;
 
-    // Place the ship on the grid and store the coordinates
-    if (orientation == 'H')
-    {
-        for (int i = 0; i < shipSize; i++)
-        {
-            grid[row][col + i] = 'S';     // Mark ship on grid horizontally
-            ship->coords[i][0] = row;     // Store row coordinate
-            ship->coords[i][1] = col + i; // Store column coordinate
-        }
-    }
-    else if (orientation == 'V')
-    {
-        for (int i = 0; i < shipSize; i++)
-        {
-            grid[row + i][col] = 'S';     // Mark ship on grid vertically
-            ship->coords[i][0] = row + i; // Store row coordinate
-            ship->coords[i][1] = col;     // Store column coordinate
-        }
-    }
+// The log file and the queue of full buffers waiting for the writer thread
+typedef struct
+{
+    FILE *file;
+    LogBuffer *queueHead, *queueTail;
+    LogBuffer *freeBuffers;
+    LogStream *streams;
+    int buffersInFlight;
+    int writing; // Set while the writer thread formats a batch
+    int closing;
+    char *output; // Formatted text waiting to be written
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t queued;  // Signalled when a buffer is queued or the log closes
+    pthread_cond_t drained; // Signalled when a buffer is handed back, broadcast when a batch is written
+    pthread_t thread;
+#endif
+} LogWriter;
 
-    printf("\n"); // Add extra newline for readability
+LogWriter logWriter;
+
+static THREAD_LOCAL LogBuffer *logBuffer = NULL;
+static THREAD_LOCAL LogStream *logStream = NULL;
+
+// Function to keep what a formatter needs from earlier records (player names)
+void trackLogRecord(LogFormatState *state, const LogRecord *record)
+{
+    if (record->type != LOG_PLAYER || record->player > 1 || record->chunk * 7 >= NAME_SIZE)
+        return;
+
+    int offset = record->chunk * 7;
+    for (int i = 0; i < 7 && offset + i < NAME_SIZE; i++)
+        state->names[record->player][offset + i] = (char)record->data[i];
+    state->names[record->player][NAME_SIZE - 1] = '\0';
 }
-// Function to display the grid with consideration of the tracking difficulty
-void displayGrid(char grid[GRID_SIZE][GRID_SIZE], int trackingDifficulty)
+
+// Function to check if a LOG_PLAYER record holds the end of the name
+int isLastNameChunk(const LogRecord *record)
 {
-    printf("  A B C D E F G H I J\n"); // Column headers
-    for (int i = 0; i < GRID_SIZE; i++)
-    {
-        printf("%d ", i + 1); // Row numbers
-        for (int j = 0; j < GRID_SIZE; j++)
-        {
-            if (trackingDifficulty == 2) // Hard mode: only show hits
-            {
-                if (grid[i][j] == '*') // Show hits
-                    printf("* ");
-                else // Hide everything else as water
-                    printf("~ ");
-            }
-            else // Easy mode: show hits and misses
-            {
-                if (grid[i][j] == '*') // Show hits
-                    printf("* ");
-                else if (grid[i][j] == 'o') // Show misses
-                    printf("o ");
-                else // Show water as-is
-                    printf("~ ");
-            }
-        }
-        printf("\n");
-    }
+    return memchr(record->data, '\0', 7) != NULL || (record->chunk + 1) * 7 >= NAME_SIZE - 1;
 }
 
-// Function to randomly select the first player
-int chooseFirstPlayer()
+const char *logWeaponName(int weapon)
 {
-    return rand() % 2; // Randomly returns 0 or 1
+    return weapon == WEAPON_ARTILLERY ? "Artillery" : weapon == WEAPON_TORPEDO ? "Torpedo" : "Fire";
 }
 
-// Function to ask the player for the tracking difficulty
-int askForTrackingDifficulty()
+// Function to write the message of a record, returns its length (0 if it has none).
+// The screen shows the players' messages only; log files also get private records
+// and say where plain shots landed.
+int formatLogText(const LogRecord *record, const LogFormatState *state, int forFile, char *out, int size)
 {
-    char input[INPUT_SIZE];
-  int difficulty;
+    const uint8_t *d = record->data;
+    const char *name = state->names[record->player & 1];
 
-    while (1)
-    {
-        printf("Choose tracking difficulty: 1 for Easy, 2 for Hard: ");
-        fgets(input, sizeof(input), stdin);
+    if ((record->flags & LOG_FLAG_PRIVATE) && !forFile)
+        return 0;
 
-        // Check that only a single valid number (1 or 2) was entered and nothing else
-        if (sscanf(input, "%d", &difficulty) == 1 && (difficulty == 1 || difficulty == 2) && strlen(input) == 2)
-        {
-            return difficulty; // Valid difficulty, return it
-        }
-        else
-        {
-            printf("Invalid input. Please enter 1 for Easy or 2 for Hard.\n");
-        }
-    }
-}
-// Function to initialize the grid with water '~'
-void initializeGrid(char grid[GRID_SIZE][GRID_SIZE])
-{
-    for (int i = 0; i < GRID_SIZE; i++)
+    switch (record->type)
     {
-        for (int j = 0; j < GRID_SIZE; j++)
-        {
-            grid[i][j] = '~'; // Water representation
-        }
+    case LOG_GAME_START:
+        return snprintf(out, size, "Game started with %s tracking, %s goes first.\n", d[0] == 1 ? "Easy" : "Hard", state->names[d[1] & 1]);
+    case LOG_PLAYER:
+        return isLastNameChunk(record) ? snprintf(out, size, "Player %d is %s.\n", record->player + 1, name) : 0;
+    case LOG_TURN:
+        return snprintf(out, size, "Turn %d: %s.\n", d[0] | (d[1] << 8), name);
+    case LOG_FIRE:
+    {
+        const char *result = d[2] == 1 ? "Hit!\n" : d[2] == 0 ? "Miss.\n" : "You've already fired here!\n";
+        if (forFile)
+            return snprintf(out, size, "%s fires at %c%d. %s", name, d[1] + 'A', d[0] + 1, result);
+        return snprintf(out, size, "%s", result);
     }
+    case LOG_ARTILLERY:
+        return snprintf(out, size, "Firing artillery at area %c%d to %c%d\n", d[1] + 'A', d[0] + 1, d[1] + 'A' + 1, d[0] + 2);
+    case LOG_ARTILLERY_CELL:
+    case LOG_TORPEDO_CELL:
+        return snprintf(out, size, d[2] ? "Hit at %c%d!\n" : "Miss at %c%d.\n", d[1] + 'A', d[0] + 1);
+    case LOG_TORPEDO:
+        if (d[0] == 'R')
+            return snprintf(out, size, "Firing torpedo at row %d\n", d[1] + 1);
+        return snprintf(out, size, "Firing torpedo at column %c\n", d[1] + 'A');
+    case LOG_RADAR:
+        return snprintf(out, size, "Performing radar sweep on area %c%d to %c%d\n%s", d[1] + 'A', d[0] + 1, d[1] + 'A' + 1, d[0] + 2,
+                        d[2] ? "Enemy ships found in the area.\n" : "No enemy ships found in the area.\n");
+    case LOG_SMOKE:
+        return snprintf(out, size, "Deploying smoke screen on area %c%d to %c%d\n", d[1] + 'A', d[0] + 1, d[1] + 'A' + 1, d[0] + 2);
+    case LOG_SUNK:
+        return snprintf(out, size, "You sunk the %s!\n", d[0] < fleet.count ? fleet.names[d[0]] : "ship");
+    case LOG_UNLOCK:
+        return snprintf(out, size, "%s has unlocked %s! You have one turn to use it.\n", name, logWeaponName(d[0]));
+    case LOG_EXPIRE:
+        return snprintf(out, size, "%s let %s expire unused.\n", name, logWeaponName(d[0]));
+    case LOG_GAME_OVER:
+        return snprintf(out, size, "%s wins!\n", state->names[d[0] & 1]);
+    case LOG_BOT_FIRE:
+        return snprintf(out, size, "Bot fires at %c%d\n", d[1] + 'A', d[0] + 1);
+    case LOG_BOT_WEAPON:
+        return snprintf(out, size, "Bot is using %s!\n", logWeaponName(d[0]));
+    case LOG_BOT_TORPEDO:
+        if (d[0] == 'R')
+            return snprintf(out, size, "Bot is performing a torpedo attack on row %d.\n", d[1] + 1);
+        return snprintf(out, size, "Bot is performing a torpedo attack on column %c.\n", d[1] + 'A');
+    case LOG_BOT_TORPEDO_HIT:
+        return snprintf(out, size, "Bot's torpedo %s attack hit!\n", d[0] == 'R' ? "row" : "column");
+    case LOG_BOT_PLACE_RETRY:
+        return snprintf(out, size, "Too many attempts to place ships. Restarting bot placement...\n");
+    case LOG_BOT_PLACED:
+        return snprintf(out, size, "Bot has successfully placed all ships.\n");
+    }
+    return 0;
 }
 
-// Function to check if a ship is sunk
-int isShipSunk(char grid[GRID_SIZE][GRID_SIZE], Ship ship)
+// Function to write a string as a JSON string literal, returns its length
+int formatJsonString(const char *text, char *out, int size)
 {
-    for (int i = 0; i < ship.shipSize; i++)
+    int length = 0;
+
+    if (size < 3)
+        return 0;
+    out[length++] = '"';
+    for (; *text && length < size - 8; text++)
     {
-        int row = ship.coords[i][0];
-        int col = ship.coords[i][1];
-        if (grid[row][col] != '*') // If any part of the ship is not hit
+        unsigned char ch = (unsigned char)*text;
+        if (ch == '"' || ch == '\\')
         {
-            return 0; // The ship is not yet sunk
+            out[length++] = '\\';
+            out[length++] = (char)ch;
         }
+        else if (ch < 0x20)
+            length += snprintf(out + length, size - length, "\\u%04x", ch);
+        else
+            out[length++] = (char)ch;
     }
-    // Inside the part where you detect ship sinking
-    return 1; // All parts of the ship are hit, so it's sunk
+    out[length++] = '"';
+    out[length] = '\0';
+    return length;
 }
 
-// Function to ask for firing coordinates, similar to ship placement
-void getFiringCoordinates(int *row, int *col)
+// Function to write a record as one NDJSON line, returns its length (0 if it has none).
+// Rows and columns are zero based.
+int formatLogJson(const LogRecord *record, const LogFormatState *state, char *out, int size)
 {
-    char input[INPUT_SIZE];
-    char colChar;
+    const uint8_t *d = record->data;
+    int length = snprintf(out, size, "{\"game\":%u,\"player\":%d,", record->game, record->player);
+    char *rest = out + length;
+    int space = size - length;
+    int added = 0;
 
-    // Get single line input for firing coordinates (e.g., B1)
-    while (1)
+    switch (record->type)
     {
-        printf("Enter coordinates to fire at (e.g., B1): ");
-        fgets(input, sizeof(input), stdin);
-
-        // Parse the input to get column and row
-        if (sscanf(input, " %c%d", &colChar, row) == 2 && isValidColumn(colChar) && *row >= 1 && *row <= 10)
-        {
-            *col = toupper(colChar) - 'A'; // Convert 'A'-'J' to 0-9
-            *row -= 1;                     // Adjust row to zero-index
-            break;                         // Valid input, exit loop
-        }
-        else
-        {
-            printf("Invalid input. Please enter in the format B1 or A6.\n");
-        }
+    case LOG_GAME_START:
+        added = snprintf(rest, space, "\"event\":\"game_start\",\"difficulty\":\"%s\",\"first\":%d}\n", d[0] == 1 ? "easy" : "hard", d[1]);
+        break;
+    case LOG_PLAYER:
+        if (!isLastNameChunk(record))
+            return 0;
+        added = snprintf(rest, space, "\"event\":\"player\",\"name\":");
+        added += formatJsonString(state->names[record->player & 1], rest + added, space - added);
+        added += snprintf(rest + added, space - added, "}\n");
+        break;
+    case LOG_TURN:
+        added = snprintf(rest, space, "\"event\":\"turn\",\"turn\":%d}\n", d[0] | (d[1] << 8));
+        break;
+    case LOG_FIRE:
+        added = snprintf(rest, space, "\"event\":\"fire\",\"row\":%d,\"col\":%d,\"result\":\"%s\"}\n", d[0], d[1],
+                         d[2] == 1 ? "hit" : d[2] == 0 ? "miss" : "repeat");
+        break;
+    case LOG_ARTILLERY:
+        added = snprintf(rest, space, "\"event\":\"artillery\",\"row\":%d,\"col\":%d}\n", d[0], d[1]);
+        break;
+    case LOG_ARTILLERY_CELL:
+    case LOG_TORPEDO_CELL:
+        added = snprintf(rest, space, "\"event\":\"%s_cell\",\"row\":%d,\"col\":%d,\"hit\":%s}\n",
+                         record->type == LOG_ARTILLERY_CELL ? "artillery" : "torpedo", d[0], d[1], d[2] ? "true" : "false");
+        break;
+    case LOG_TORPEDO:
+        added = snprintf(rest, space, "\"event\":\"torpedo\",\"axis\":\"%s\",\"index\":%d}\n", d[0] == 'R' ? "row" : "col", d[1]);
+        break;
+    case LOG_RADAR:
+        added = snprintf(rest, space, "\"event\":\"radar\",\"row\":%d,\"col\":%d,\"found\":%s}\n", d[0], d[1], d[2] ? "true" : "false");
+        break;
+    case LOG_SMOKE:
+        added = snprintf(rest, space, "\"event\":\"smoke\",\"row\":%d,\"col\":%d}\n", d[0], d[1]);
+        break;
+    case LOG_SUNK:
+        added = snprintf(rest, space, "\"event\":\"sunk\",\"ship\":%d,\"row\":%d,\"col\":%d,\"orientation\":\"%c\",\"size\":%d}\n",
+                         d[0], d[1], d[2], d[3], d[4]);
+        break;
+    case LOG_UNLOCK:
+    case LOG_EXPIRE:
+        added = snprintf(rest, space, "\"event\":\"%s\",\"weapon\":\"%s\"}\n", record->type == LOG_UNLOCK ? "unlock" : "expire",
+                         d[0] == WEAPON_ARTILLERY ? "artillery" : "torpedo");
+        break;
+    case LOG_GAME_OVER:
+        added = snprintf(rest, space, "\"event\":\"game_over\",\"winner\":%d}\n", d[0]);
+        break;
+    case LOG_BOT_FIRE:
+        added = snprintf(rest, space, "\"event\":\"bot_fire\",\"row\":%d,\"col\":%d}\n", d[0], d[1]);
+        break;
+    case LOG_BOT_WEAPON:
+        added = snprintf(rest, space, "\"event\":\"bot_weapon\",\"weapon\":\"%s\"}\n", d[0] == WEAPON_ARTILLERY ? "artillery" : "torpedo");
+        break;
+    case LOG_BOT_TORPEDO:
+    case LOG_BOT_TORPEDO_HIT:
+        added = snprintf(rest, space, "\"event\":\"%s\",\"axis\":\"%s\",\"index\":%d}\n",
+                         record->type == LOG_BOT_TORPEDO ? "bot_torpedo" : "bot_torpedo_hit", d[0] == 'R' ? "row" : "col", d[1]);
+        break;
+    case LOG_BOT_PLACE_RETRY:
+        added = snprintf(rest, space, "\"event\":\"bot_place_retry\"}\n");
+        break;
+    case LOG_BOT_PLACED:
+        added = snprintf(rest, space, "\"event\":\"bot_placed\"}\n");
+        break;
+    default:
+        return 0;
     }
-
-    printf("\n"); // Add extra newline for readability
+    return length + added;
 }
-// Function to count the remaining parts of a ship on the grid
-int countShipParts(char grid[GRID_SIZE][GRID_SIZE], char shipMarker)
+
+// Function to format a batch of buffers into the log file, then hand the buffers back
+void writeLogBuffers(LogBuffer *batch)
 {
-    int count = 0;
-    for (int i = 0; i < GRID_SIZE; i++)
+    int used = 0;
+
+    while (batch != NULL)
     {
-        for (int j = 0; j < GRID_SIZE; j++)
+        LogBuffer *buffer = batch;
+        LogFormatState *state = &buffer->stream->format;
+
+        for (int i = 0; i < buffer->count; i++)
         {
-            if (grid[i][j] == shipMarker)
+            const LogRecord *record = &buffer->records[i];
+            trackLogRecord(state, record);
+
+            if (used > LOG_OUTPUT_SIZE - 512)
             {
-                count++;
+                fwrite(logWriter.output, 1, (size_t)used, logWriter.file);
+                used = 0;
+            }
+            if (logFormat == LOG_FORMAT_NDJSON)
+            {
+                used += formatLogJson(record, state, logWriter.output + used, LOG_OUTPUT_SIZE - used);
+            }
+            else
+            {
+                int length = snprintf(logWriter.output + used, LOG_OUTPUT_SIZE - used, "[game %u] ", record->game);
+                int text = formatLogText(record, state, 1, logWriter.output + used + length, LOG_OUTPUT_SIZE - used - length);
+                if (text > 0)
+                    used += length + text;
             }
         }
+
+        batch = buffer->next;
+#ifndef _WIN32
+        pthread_mutex_lock(&logWriter.lock);
+#endif
+        buffer->next = logWriter.freeBuffers;
+        logWriter.freeBuffers = buffer;
+        logWriter.buffersInFlight--;
+#ifndef _WIN32
+        pthread_cond_signal(&logWriter.drained);
+        pthread_mutex_unlock(&logWriter.lock);
+#endif
     }
-    return count;
+
+    fwrite(logWriter.output, 1, (size_t)used, logWriter.file);
 }
 
-// Function to fire at a coordinate
-int fireAtCoordinate(char grid[GRID_SIZE][GRID_SIZE], int row, int col, Ship ships[NUM_SHIPS], int trackingDifficulty)
+#ifndef _WIN32
+// Writer thread: takes everything queued at once and formats it off the game threads
+void *logWriterThread(void *arg)
 {
-    if (grid[row][col] == 'S') // Ship hit
+    (void)arg;
+    pthread_mutex_lock(&logWriter.lock);
+    while (1)
     {
-        grid[row][col] = '*'; // Mark as hit
+        while (logWriter.queueHead == NULL && !logWriter.closing)
+            pthread_cond_wait(&logWriter.queued, &logWriter.lock);
+        if (logWriter.queueHead == NULL)
+            break; // Closing and nothing left
 
-        // If in Easy mode, show hit message
-        if (trackingDifficulty == 1)
-        {
-            printf("Hit!\n");
-        }
+        LogBuffer *batch = logWriter.queueHead;
+        logWriter.queueHead = logWriter.queueTail = NULL;
+        logWriter.writing = 1;
+        pthread_mutex_unlock(&logWriter.lock);
 
-        return 1; // Hit
+        writeLogBuffers(batch);
+        fflush(logWriter.file);
+
+        pthread_mutex_lock(&logWriter.lock);
+        logWriter.writing = 0;
+        pthread_cond_broadcast(&logWriter.drained);
     }
-    else if (grid[row][col] == '~') // Miss
-    {
-        grid[row][col] = 'o'; // Mark as miss
+    pthread_mutex_unlock(&logWriter.lock);
+    return NULL;
+}
+#endif
 
-        // If in Easy mode, show miss message
-        if (trackingDifficulty == 1)
-        {
-            printf("Miss.\n");
-        }
+// Function to pass this thread's buffer to the writer
+void submitLogBuffer()
+{
+    LogBuffer *buffer = logBuffer;
 
-        return 0; // Miss
-    }
+    if (buffer == NULL)
+        return;
+    logBuffer = NULL;
+    buffer->next = NULL;
+
+#ifdef _WIN32
+    writeLogBuffers(buffer); // No writer thread on Windows
+#else
+    pthread_mutex_lock(&logWriter.lock);
+    if (logWriter.queueTail != NULL)
+        logWriter.queueTail->next = buffer;
     else
+        logWriter.queueHead = buffer;
+    logWriter.queueTail = buffer;
+    pthread_cond_signal(&logWriter.queued);
+    pthread_mutex_unlock(&logWriter.lock);
+#endif
+}
+
+// Function to get an empty buffer for this thread, waiting if the writer is far behind
+LogBuffer *acquireLogBuffer()
+{
+    LogBuffer *buffer;
+
+#ifndef _WIN32
+    pthread_mutex_lock(&logWriter.lock);
+    while (logWriter.freeBuffers == NULL && logWriter.buffersInFlight >= LOG_MAX_BUFFERS)
+        pthread_cond_wait(&logWriter.drained, &logWriter.lock);
+#endif
+    if (logStream == NULL)
     {
-        // Already fired at this location, no additional feedback needed
-        if (trackingDifficulty == 1)
+        logStream = (LogStream *)calloc(1, sizeof(LogStream));
+        if (logStream != NULL)
         {
-            printf("You've already fired here!\n");
+            logStream->next = logWriter.streams;
+            logWriter.streams = logStream;
         }
+    }
+    buffer = logWriter.freeBuffers;
+    if (buffer != NULL)
+        logWriter.freeBuffers = buffer->next;
+    else
+        buffer = (LogBuffer *)malloc(sizeof(LogBuffer));
+    if (buffer != NULL && logStream != NULL)
+        logWriter.buffersInFlight++;
+#ifndef _WIN32
+    pthread_mutex_unlock(&logWriter.lock);
+#endif
 
-        return 0; // No hit
+    if (buffer == NULL || logStream == NULL)
+    {
+        free(buffer);
+        return NULL;
     }
+    buffer->stream = logStream;
+    buffer->count = 0;
+    return buffer;
 }
 
-// Function to check if all ships are sunk
-int allShipsSunk(char grid[GRID_SIZE][GRID_SIZE])
+// Function to show a record on screen and queue it for the log file
+void emitLogRecord(int level, int type, int flags, const uint8_t data[8])
 {
-    for (int i = 0; i < GRID_SIZE; i++)
+    LogRecord record;
+
+    record.game = logGame;
+    record.type = (uint8_t)type;
+    record.player = (uint8_t)logPlayer;
+    record.flags = (uint8_t)flags;
+    record.chunk = 0;
+    memcpy(record.data, data, sizeof(record.data));
+
+    if (type == LOG_PLAYER)
     {
-        for (int j = 0; j < GRID_SIZE; j++)
-        {
-            if (grid[i][j] == 'S')
-                return 0; // Still a ship remaining
-        }
+        record.chunk = data[0];
+        memcpy(record.data, data + 1, 7);
+        record.data[7] = 0;
     }
-    return 1; // All ships are sunk
+
+    if (!quietOutput)
+    {
+        char text[256];
+        trackLogRecord(&screenFormat, &record);
+        if (formatLogText(&record, &screenFormat, 0, text, sizeof(text)) > 0)
+            fputs(text, stdout);
+    }
+
+    if (level > logLevel || logWriter.file == NULL)
+        return;
+    if (logBuffer == NULL && (logBuffer = acquireLogBuffer()) == NULL)
+        return;
+    logBuffer->records[logBuffer->count++] = record;
+    if (logBuffer->count == LOG_BUFFER_RECORDS)
+        submitLogBuffer();
 }
-// Function to switch between players
-int switchPlayer(int currentPlayer)
+
+// Function to choose whether this thread shows records on screen
+void configureLogThread(int showOnScreen)
 {
-    return currentPlayer == 0 ? 1 : 0;
+    quietOutput = !showOnScreen;
+    logThreshold = showOnScreen ? LOG_LEVEL_ALL : (logWriter.file != NULL ? logLevel : LOG_LEVEL_OFF);
 }
 
-// Perform artillery strike (hits a 2x2 area)
-void artilleryStrike(char grid[GRID_SIZE][GRID_SIZE], int row, int col, int trackingDifficulty)
+// Function to start a game's records: names of both players, difficulty and first player
+void logGameStart(uint32_t game, const char *names[2], int trackingDifficulty, int firstPlayer)
 {
-    printf("Firing artillery at area %c%d to %c%d\n", col + 'A', row + 1, col + 'A' + 1, row + 2);
+    logGame = game;
+    logTurnNumber = 0;
+    if (LOG_LEVEL_GAMES > logThreshold)
+        return;
 
-    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+    for (int p = 0; p < 2; p++)
     {
-        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+        logPlayer = p;
+        int length = (int)strlen(names[p]);
+        // Seven name bytes per record, the last record carries the terminator
+        for (int chunk = 0; chunk * 7 <= length && chunk * 7 < NAME_SIZE - 1; chunk++)
         {
-            if (grid[i][j] == 'S')
-            {
-                printf("Hit at %c%d!\n", j + 'A', i + 1);
-                grid[i][j] = '*';
-            }
-            else
-            {
-                if (trackingDifficulty == 1) // Easy Mode
-                {
-                    printf("Miss at %c%d.\n", j + 'A', i + 1);
-                    grid[i][j] = 'o'; // Mark miss
-                }
-                else // Hard Mode
-                {
-                    printf("Miss at %c%d.\n", j + 'A', i + 1);
-                    // Optionally, you can choose not to mark misses in Hard Mode
-                }
-            }
+            uint8_t data[8] = {(uint8_t)chunk};
+            for (int i = 0; i < 7 && chunk * 7 + i < length; i++)
+                data[1 + i] = (uint8_t)names[p][chunk * 7 + i];
+            emitLogRecord(LOG_LEVEL_GAMES, LOG_PLAYER, LOG_FLAG_PRIVATE, data);
         }
     }
+    logPlayer = firstPlayer;
+    LOG_EVENT(LOG_LEVEL_GAMES, LOG_GAME_START, LOG_FLAG_PRIVATE, trackingDifficulty, firstPlayer);
 }
 
-// Function to perform Torpedo attack
-int torpedoAttack(char grid[GRID_SIZE][GRID_SIZE], char choice, int num, int trackingDifficulty)
+// Function to mark the start of a player's turn
+void logTurn(int player)
 {
-    int hit = 0;
+    logPlayer = player;
+    logTurnNumber++;
+    LOG_EVENT(LOG_LEVEL_EVENTS, LOG_TURN, LOG_FLAG_PRIVATE, logTurnNumber & 0xFF, (logTurnNumber >> 8) & 0xFF);
+}
 
-    if (choice == 'R')
-    { // Row attack
-        printf("Firing torpedo at row %d\n", num + 1);
-        for (int j = 0; j < GRID_SIZE; j++)
-        {
+// Function to open the log file and start its writer thread, returns 0 on failure.
+// With append set the file is kept, for a resumed simulation to cut back to its checkpoint.
+int openGameLog(const char *path, int append)
+{
+    logWriter.file = fopen(path, append ? "a" : "w");
+    logWriter.output = (char *)malloc(LOG_OUTPUT_SIZE);
+    if (logWriter.file == NULL || logWriter.output == NULL)
+    {
+        if (logWriter.file != NULL)
+            fclose(logWriter.file);
+        logWriter.file = NULL;
+        return 0;
+    }
+
+#ifndef _WIN32
+    pthread_mutex_init(&logWriter.lock, NULL);
+    pthread_cond_init(&logWriter.queued, NULL);
+    pthread_cond_init(&logWriter.drained, NULL);
+    if (pthread_create(&logWriter.thread, NULL, logWriterThread, NULL) != 0)
+    {
+        fclose(logWriter.file);
+        logWriter.file = NULL;
+        return 0;
+    }
+#endif
+    configureLogThread(!quietOutput);
+    return 1;
+}
+
+// Function to pass on this thread's unfinished buffer, called when a thread stops logging
+void flushLogThread()
+{
+    if (logWriter.file != NULL)
+        submitLogBuffer();
+}
+
+#ifndef _WIN32
+// Function to wait until everything queued is in the log file and return the
+// file's size. Threads that log must have passed on their buffers first.
+uint64_t syncGameLog()
+{
+    struct stat info;
+
+    if (logWriter.file == NULL)
+        return 0;
+    pthread_mutex_lock(&logWriter.lock);
+    while (logWriter.queueHead != NULL || logWriter.writing)
+        pthread_cond_wait(&logWriter.drained, &logWriter.lock);
+    uint64_t size = fstat(fileno(logWriter.file), &info) == 0 ? (uint64_t)info.st_size : 0;
+    pthread_mutex_unlock(&logWriter.lock);
+    return size;
+}
+
+// Function to cut the log file back to size bytes, if it is longer. Returns 0 on failure.
+int truncateGameLog(uint64_t size)
+{
+    if (syncGameLog() <= size)
+        return 1;
+    return ftruncate(fileno(logWriter.file), (off_t)size) == 0;
+}
+#endif
+
+// Function to write out everything queued and close the log file (registered with atexit)
+void closeGameLog()
+{
+    if (logWriter.file == NULL)
+        return;
+
+    flushLogThread();
+#ifndef _WIN32
+    pthread_mutex_lock(&logWriter.lock);
+    logWriter.closing = 1;
+    pthread_cond_signal(&logWriter.queued);
+    pthread_mutex_unlock(&logWriter.lock);
+    pthread_join(logWriter.thread, NULL);
+#endif
+    fclose(logWriter.file);
+    logWriter.file = NULL;
+
+    while (logWriter.freeBuffers != NULL)
+    {
+        LogBuffer *next = logWriter.freeBuffers->next;
+        free(logWriter.freeBuffers);
+        logWriter.freeBuffers = next;
+    }
+    while (logWriter.streams != NULL)
+    {
+        LogStream *next = logWriter.streams->next;
+        free(logWriter.streams);
+        logWriter.streams = next;
+    }
+    free(logWriter.output);
+    logWriter.output = NULL;
+}
+
+// Tracing: timed spans around rule functions and turns, kept in a ring buffer
+// per thread and written as Chrome trace JSON (chrome://tracing or Perfetto).
+// Off unless --trace is given; a disabled span costs one load and one branch.
+#define TRACE_RING_EVENTS 65536 // Newest spans kept per thread
+
+#define TRACE_TURN 0
+#define TRACE_PERFORM_MOVE 1
+#define TRACE_BOT_TURN 2
+#define TRACE_FIRE 3
+#define TRACE_ARTILLERY 4
+#define TRACE_TORPEDO 5
+#define TRACE_RADAR 6
+#define TRACE_AUTO_PLACE 7
+#define TRACE_SINK_CHECK 8
+#define TRACE_ENDGAME 9
+#define TRACE_MCTS 10
+#define TRACE_KINDS 11
+
+const char *traceNames[TRACE_KINDS] = {
+    "turn", "performMove", "botTurn", "fireAtCoordinate", "artilleryStrike",
+    "torpedoAttack", "radarSweep", "autoPlaceShips", "sinkCheck", "solveEndgame", "mctsSearch"};
+
+typedef struct
+{
+    uint64_t start, end; // Nanoseconds on the monotonic clock
+    uint32_t game;
+    uint32_t kind;
+} TraceEvent;
+
+typedef struct TraceRing
+{
+    struct TraceRing *next;
+    int thread;
+    uint64_t count; // Spans ever recorded, the ring holds the newest TRACE_RING_EVENTS
+    TraceEvent events[TRACE_RING_EVENTS];
+} TraceRing;
+
+int traceEnabled = 0;
+const char *tracePath = NULL;
+TraceRing *traceRings = NULL; // Every thread's ring, kept until the trace is written
+int traceThreads = 0;
+#ifndef _WIN32
+pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static THREAD_LOCAL TraceRing *traceRing = NULL;
+static THREAD_LOCAL int traceMuted = 0; // Set while a search plays moves it only imagines
+
+// This thread's output settings, saved while a worker plays games no one watches
+typedef struct
+{
+    int quiet, threshold, muted;
+} WorkerQuiet;
+
+// Function to stop this thread printing, logging and tracing, returns the settings to put back
+WorkerQuiet enterWorkerQuiet()
+{
+    WorkerQuiet saved = {quietOutput, logThreshold, traceMuted};
+    quietOutput = 1;
+    logThreshold = LOG_LEVEL_OFF;
+    traceMuted = 1;
+    return saved;
+}
+
+// Function to put back the output settings enterWorkerQuiet replaced
+void leaveWorkerQuiet(WorkerQuiet saved)
+{
+    quietOutput = saved.quiet;
+    logThreshold = saved.threshold;
+    traceMuted = saved.muted;
+}
+
+// A span being timed; kind is -1 when tracing is off
+typedef struct
+{
+    int kind;
+    uint64_t start;
+} TraceScope;
+
+// Function to read the monotonic clock in nanoseconds
+uint64_t traceClock()
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Function to create this thread's ring on its first span, returns NULL if memory runs out
+TraceRing *traceThreadRing()
+{
+    if (traceRing != NULL)
+        return traceRing;
+
+    traceRing = (TraceRing *)calloc(1, sizeof(TraceRing));
+    if (traceRing == NULL)
+        return NULL;
+#ifndef _WIN32
+    pthread_mutex_lock(&traceLock);
+#endif
+    traceRing->thread = traceThreads++;
+    traceRing->next = traceRings;
+    traceRings = traceRing;
+#ifndef _WIN32
+    pthread_mutex_unlock(&traceLock);
+#endif
+    return traceRing;
+}
+
+TraceScope traceScopeBegin(int kind)
+{
+    TraceScope scope = {-1, 0};
+    if (traceEnabled && !traceMuted)
+    {
+        scope.kind = kind;
+        scope.start = traceClock();
+    }
+    return scope;
+}
+
+void traceScopeEnd(TraceScope *scope)
+{
+    if (scope->kind < 0)
+        return;
+
+    TraceRing *ring = traceThreadRing();
+    if (ring == NULL)
+        return;
+    TraceEvent *event = &ring->events[ring->count % TRACE_RING_EVENTS];
+    event->start = scope->start;
+    event->end = traceClock();
+    event->game = logGame;
+    event->kind = (uint32_t)scope->kind;
+    ring->count++;
+}
+
+// Times the rest of the enclosing block, however it is left
+#define TRACE_SCOPE(kind) TraceScope traceScope __attribute__((cleanup(traceScopeEnd))) = traceScopeBegin(kind)
+
+// Function to write every thread's ring as Chrome trace JSON (registered with atexit)
+void writeTrace()
+{
+    if (!traceEnabled || tracePath == NULL)
+        return;
+    traceEnabled = 0;
+
+    FILE *file = fopen(tracePath, "w");
+    if (file == NULL)
+    {
+        printf("Could not write trace file %s.\n", tracePath);
+        return;
+    }
+
+    // Timestamps are relative to the first span kept
+    uint64_t origin = UINT64_MAX;
+    for (TraceRing *ring = traceRings; ring != NULL; ring = ring->next)
+    {
+        uint64_t kept = ring->count < TRACE_RING_EVENTS ? ring->count : TRACE_RING_EVENTS;
+        for (uint64_t i = ring->count - kept; i < ring->count; i++)
+        {
+            if (ring->events[i % TRACE_RING_EVENTS].start < origin)
+                origin = ring->events[i % TRACE_RING_EVENTS].start;
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    int first = 1;
+    for (TraceRing *ring = traceRings; ring != NULL; ring = ring->next)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                first ? "" : ",\n", ring->thread, ring->thread);
+        first = 0;
+
+        uint64_t kept = ring->count < TRACE_RING_EVENTS ? ring->count : TRACE_RING_EVENTS;
+        for (uint64_t i = ring->count - kept; i < ring->count; i++)
+        {
+            const TraceEvent *event = &ring->events[i % TRACE_RING_EVENTS];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"game\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"game\":%u}}",
+                    traceNames[event->kind], (double)(event->start - origin) / 1000.0,
+                    (double)(event->end - event->start) / 1000.0, ring->thread, event->game);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    while (traceRings != NULL)
+    {
+        TraceRing *next = traceRings->next;
+        free(traceRings);
+        traceRings = next;
+    }
+}
+
+// One bit per grid cell, bit index row * GRID_SIZE + col
+typedef struct
+{
+    uint64_t words[2];
+} BitBoard;
+
+#define CELL_INDEX(row, col) ((row) * GRID_SIZE + (col))
+
+void bitboardSet(BitBoard *board, int cell)
+{
+    board->words[cell >> 6] |= 1ULL << (cell & 63);
+}
+
+int bitboardTest(const BitBoard *board, int cell)
+{
+    return (int)((board->words[cell >> 6] >> (cell & 63)) & 1);
+}
+
+BitBoard bitboardAnd(BitBoard a, BitBoard b)
+{
+    BitBoard result = {{a.words[0] & b.words[0], a.words[1] & b.words[1]}};
+    return result;
+}
+
+BitBoard bitboardOr(BitBoard a, BitBoard b)
+{
+    BitBoard result = {{a.words[0] | b.words[0], a.words[1] | b.words[1]}};
+    return result;
+}
+
+// Cells of a that are not in b
+BitBoard bitboardAndNot(BitBoard a, BitBoard b)
+{
+    BitBoard result = {{a.words[0] & ~b.words[0], a.words[1] & ~b.words[1]}};
+    return result;
+}
+
+// Cells in exactly one of a and b
+BitBoard bitboardXor(BitBoard a, BitBoard b)
+{
+    BitBoard result = {{a.words[0] ^ b.words[0], a.words[1] ^ b.words[1]}};
+    return result;
+}
+
+// Function to move every cell bits places towards cell 0 (0 < bits < 64)
+BitBoard bitboardShiftDown(BitBoard board, int bits)
+{
+    BitBoard result = {{(board.words[0] >> bits) | (board.words[1] << (64 - bits)), board.words[1] >> bits}};
+    return result;
+}
+
+int bitboardIsEmpty(BitBoard board)
+{
+    return (board.words[0] | board.words[1]) == 0;
+}
+
+int bitboardEqual(BitBoard a, BitBoard b)
+{
+    return a.words[0] == b.words[0] && a.words[1] == b.words[1];
+}
+
+int bitboardCount(BitBoard board)
+{
+    return __builtin_popcountll(board.words[0]) + __builtin_popcountll(board.words[1]);
+}
+
+// Function to remove and return the lowest set cell, returns -1 if the board is empty
+int bitboardPopFirst(BitBoard *board)
+{
+    if (board->words[0])
+    {
+        int cell = __builtin_ctzll(board->words[0]);
+        board->words[0] &= board->words[0] - 1;
+        return cell;
+    }
+    if (board->words[1])
+    {
+        int cell = 64 + __builtin_ctzll(board->words[1]);
+        board->words[1] &= board->words[1] - 1;
+        return cell;
+    }
+    return -1;
+}
+
+// Function to build the mask of a ship placement, returns 0 if it leaves the grid
+int placementMask(int shipSize, int row, int col, char orientation, BitBoard *mask)
+{
+    memset(mask, 0, sizeof(*mask));
+    if (row < 0 || col < 0 || (orientation == 'H' ? col + shipSize > GRID_SIZE : row + shipSize > GRID_SIZE))
+        return 0;
+
+    for (int i = 0; i < shipSize; i++)
+    {
+        bitboardSet(mask, orientation == 'H' ? CELL_INDEX(row, col + i) : CELL_INDEX(row + i, col));
+    }
+    return 1;
+}
+
+// Every placement of one ship size on the board, with the placements that
+// cover each cell. Built once per distinct size in the fleet before play
+// starts, then only read, so threads share them freely.
+typedef struct
+{
+    int built;
+    int count;
+    BitBoard masks[2 * GRID_SIZE * GRID_SIZE];
+    short coverStart[GRID_SIZE * GRID_SIZE + 1]; // Placements covering cell c are coverList[coverStart[c]..coverStart[c + 1])
+    short coverList[2 * GRID_SIZE * GRID_SIZE * MAX_SHIP_SIZE];
+} PlacementKernel;
+
+PlacementKernel placementKernels[MAX_SHIP_SIZE + 1]; // Indexed by ship size
+
+// Function to build the placement and coverage tables of one ship size
+void buildPlacementKernel(PlacementKernel *kernel, int shipSize)
+{
+    int coverCount[GRID_SIZE * GRID_SIZE] = {0};
+
+    kernel->count = 0;
+    for (int row = 0; row < GRID_SIZE; row++)
+    {
+        for (int col = 0; col < GRID_SIZE; col++)
+        {
+            for (int o = 0; o < 2; o++)
+            {
+                // A ship of size 1 has only one orientation
+                if (o == 1 && shipSize == 1)
+                    continue;
+                if (placementMask(shipSize, row, col, o ? 'V' : 'H', &kernel->masks[kernel->count]))
+                    kernel->count++;
+            }
+        }
+    }
+
+    for (int p = 0; p < kernel->count; p++)
+    {
+        BitBoard cells = kernel->masks[p];
+        for (int cell = bitboardPopFirst(&cells); cell >= 0; cell = bitboardPopFirst(&cells))
+            coverCount[cell]++;
+    }
+    kernel->coverStart[0] = 0;
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        kernel->coverStart[cell + 1] = (short)(kernel->coverStart[cell] + coverCount[cell]);
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        coverCount[cell] = kernel->coverStart[cell];
+    for (int p = 0; p < kernel->count; p++)
+    {
+        BitBoard cells = kernel->masks[p];
+        for (int cell = bitboardPopFirst(&cells); cell >= 0; cell = bitboardPopFirst(&cells))
+            kernel->coverList[coverCount[cell]++] = (short)p;
+    }
+    kernel->built = 1;
+}
+
+// Function to build the kernels of every ship size in the fleet
+void buildFleetKernels()
+{
+    for (int i = 0; i < fleet.count; i++)
+    {
+        if (!placementKernels[fleet.sizes[i]].built)
+            buildPlacementKernel(&placementKernels[fleet.sizes[i]], fleet.sizes[i]);
+    }
+}
+
+// Function to check a fleet fits the board, prints the problem and returns 0 if not
+int isValidFleet(const Fleet *candidate)
+{
+    int cells = 0;
+
+    if (candidate->count < 1 || candidate->count > MAX_SHIPS)
+    {
+        printf("A fleet needs 1 to %d ships.\n", MAX_SHIPS);
+        return 0;
+    }
+    for (int i = 0; i < candidate->count; i++)
+    {
+        if (candidate->sizes[i] < 1 || candidate->sizes[i] > MAX_SHIP_SIZE)
+        {
+            printf("The %s must have a size from 1 to %d.\n", candidate->names[i], MAX_SHIP_SIZE);
+            return 0;
+        }
+        cells += candidate->sizes[i];
+    }
+    // Ships may not touch, so a fleet much larger than this cannot always be placed
+    if (cells > GRID_SIZE * GRID_SIZE / 3)
+    {
+        printf("The fleet has %d ship cells, at most %d fit on the board.\n", cells, GRID_SIZE * GRID_SIZE / 3);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to select a fleet by preset name or from a file of "Name Size" lines
+// ('#' starts a comment). Returns 0 if it cannot be used.
+int selectFleet(const char *source)
+{
+    Fleet loaded;
+    char line[INPUT_SIZE];
+
+    for (int i = 0; i < NUM_FLEET_PRESETS; i++)
+    {
+        if (strcmp(source, fleetPresets[i].name) == 0)
+        {
+            fleet = fleetPresets[i].fleet;
+            return 1;
+        }
+    }
+
+    FILE *file = fopen(source, "r");
+    if (file == NULL)
+    {
+        printf("No fleet preset or file named %s.\n", source);
+        return 0;
+    }
+
+    memset(&loaded, 0, sizeof(loaded));
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[SHIP_NAME_SIZE];
+        int size;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        if (sscanf(line, "%19s %d", name, &size) != 2)
+            continue;
+        if (loaded.count == MAX_SHIPS)
+        {
+            loaded.count++; // Too many, reported below
+            break;
+        }
+        strcpy(loaded.names[loaded.count], name);
+        loaded.sizes[loaded.count++] = size;
+    }
+    fclose(file);
+
+    if (!isValidFleet(&loaded))
+        return 0;
+    fleet = loaded;
+    return 1;
+}
+
+// Zobrist keys of observation facts. Keys are derived from the fact's number so
+// no table has to be shared between threads.
+#define ZOBRIST_HIT 0
+#define ZOBRIST_MISS (GRID_SIZE * GRID_SIZE)
+#define ZOBRIST_SUNK (2 * GRID_SIZE * GRID_SIZE)
+#define ZOBRIST_RADAR_CONTACT (2 * GRID_SIZE * GRID_SIZE + 32)
+#define ZOBRIST_RADAR_CLEAR (3 * GRID_SIZE * GRID_SIZE + 32)
+#define ZOBRIST_ARTILLERY (4 * GRID_SIZE * GRID_SIZE + 32)
+#define ZOBRIST_TORPEDO (4 * GRID_SIZE * GRID_SIZE + 33)
+
+uint64_t zobristKey(int fact)
+{
+    uint64_t z = (uint64_t)(fact + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// What a player has learned about the opponent's board. Bots read only this,
+// never the opponent's grid. A cell that is neither hit nor miss is unknown.
+typedef struct
+{
+    BitBoard hit;          // Cells fired at that held a ship
+    BitBoard miss;         // Cells fired at that held water
+    BitBoard sunk;         // Cells of ships reported sunk
+    BitBoard radarContact; // Cells of radar windows that reported ships
+    BitBoard radarClear;   // Cells of radar windows that reported nothing (smoke may hide ships)
+    int sunkShips;         // Bit i is set once ship i has been sunk
+    uint64_t hash;         // Zobrist hash of hits, misses, sunk ships and radar replies
+
+    // Index of cells not fired at yet, split by checkerboard parity ((row + col) % 2).
+    // Each side is a dense array with swap-remove, so sampling and removal are O(1).
+    unsigned char freeCells[2][GRID_SIZE * GRID_SIZE];
+    unsigned char freeSlot[GRID_SIZE * GRID_SIZE]; // Position of each cell in its parity array
+    int freeCount[2];
+} Observation;
+
+void initializeObservation(Observation *view)
+{
+    memset(view, 0, sizeof(*view));
+
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
+            int parity = (i + j) & 1;
+            int cell = CELL_INDEX(i, j);
+            view->freeSlot[cell] = (unsigned char)view->freeCount[parity];
+            view->freeCells[parity][view->freeCount[parity]++] = (unsigned char)cell;
+        }
+    }
+}
+
+// Function to check if a cell has not been fired at yet
+int observationIsUnknown(const Observation *view, int row, int col)
+{
+    int cell = CELL_INDEX(row, col);
+    return !bitboardTest(&view->hit, cell) && !bitboardTest(&view->miss, cell);
+}
+
+// Function to record the result of a shot at one cell
+void observeShot(Observation *view, int row, int col, int hit)
+{
+    if (view == NULL || !observationIsUnknown(view, row, col))
+        return;
+
+    // Swap-remove the cell from the free-cell index
+    int parity = (row + col) & 1;
+    int cell = CELL_INDEX(row, col);
+    int slot = view->freeSlot[cell];
+    int last = view->freeCells[parity][--view->freeCount[parity]];
+    view->freeCells[parity][slot] = (unsigned char)last;
+    view->freeSlot[last] = (unsigned char)slot;
+
+    bitboardSet(hit ? &view->hit : &view->miss, cell);
+    view->hash ^= zobristKey((hit ? ZOBRIST_HIT : ZOBRIST_MISS) + cell);
+}
+
+// Function to pick a uniformly random cell that has not been fired at, returns -1 if none is left
+int sampleFreeCell(const Observation *view)
+{
+    int total = view->freeCount[0] + view->freeCount[1];
+    if (total == 0)
+        return -1;
+
+    int pick = gameRand() % total;
+    if (pick < view->freeCount[0])
+        return view->freeCells[0][pick];
+    return view->freeCells[1][pick - view->freeCount[0]];
+}
+
+// Function to pick a random unfired cell of one checkerboard colour, returns -1 if none is left
+int sampleFreeCellParity(const Observation *view, int parity)
+{
+    if (view->freeCount[parity] == 0)
+        return -1;
+
+    return view->freeCells[parity][gameRand() % view->freeCount[parity]];
+}
+
+// Function to pick a random unfired cell to hunt at, returns -1 if none is left.
+// While every ship afloat is at least two long, each one covers cells of both
+// checkerboard colours, so only one colour is searched: the one with fewer
+// unfired cells left, which is the sooner exhausted.
+int sampleHuntCell(const Observation *view)
+{
+    int shortest = MAX_SHIP_SIZE + 1;
+
+    for (int i = 0; i < fleet.count; i++)
+        if (!(view->sunkShips & (1 << i)) && fleet.sizes[i] < shortest)
+            shortest = fleet.sizes[i];
+    if (shortest < 2 || view->freeCount[0] == 0 || view->freeCount[1] == 0)
+        return sampleFreeCell(view);
+    return sampleFreeCellParity(view, view->freeCount[0] <= view->freeCount[1] ? 0 : 1);
+}
+
+// Function to record the reply of a radar sweep over the 2x2 area starting at row, col
+void observeRadar(Observation *view, int row, int col, int foundShip)
+{
+    if (view == NULL)
+        return;
+
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+    {
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+        {
+            BitBoard *plane = foundShip ? &view->radarContact : &view->radarClear;
+            if (!bitboardTest(plane, CELL_INDEX(i, j)))
+            {
+                bitboardSet(plane, CELL_INDEX(i, j));
+                view->hash ^= zobristKey((foundShip ? ZOBRIST_RADAR_CONTACT : ZOBRIST_RADAR_CLEAR) + CELL_INDEX(i, j));
+            }
+        }
+    }
+}
+
+// Function to record that a ship has been sunk
+void observeSunk(Observation *view, const Ship *ship, int shipIndex)
+{
+    if (view == NULL || (view->sunkShips & (1 << shipIndex)))
+        return;
+
+    for (int i = 0; i < ship->shipSize; i++)
+    {
+        bitboardSet(&view->sunk, CELL_INDEX(ship->coords[i][0], ship->coords[i][1]));
+    }
+    view->sunkShips |= 1 << shipIndex;
+    view->hash ^= zobristKey(ZOBRIST_SUNK + shipIndex);
+}
+
+// Function to pick a uniformly random cell of board, returns -1 if it is empty
+int sampleBoardCell(BitBoard board)
+{
+    int count = bitboardCount(board);
+    if (count == 0)
+        return -1;
+
+    for (int skip = gameRand() % count; skip > 0; skip--)
+        bitboardPopFirst(&board);
+    return bitboardPopFirst(&board);
+}
+
+int turnPauseSeconds = 3; // Pause between turns so players can look away
+int clearScreens = 1;     // Clear the screen between turns (0 keeps all output)
+
+// Function to clear the screen (platform dependent)
+void clearScreen()
+{
+    if (!clearScreens)
+        return;
+#ifdef _WIN32
+    system("cls"); // For Windows
+#else
+    system("clear"); // For Linux/Unix/Mac
+#endif
+}
+
+// Function to pause before the next turn
+void pauseBetweenTurns()
+{
+    if (turnPauseSeconds <= 0)
+        return;
+#ifdef _WIN32
+    Sleep(turnPauseSeconds * 1000);
+#else
+    sleep((unsigned)turnPauseSeconds);
+#endif
+}
+
+// Function to validate column input
+int isValidColumn(char colChar)
+{
+    return (toupper(colChar) >= 'A' && toupper(colChar) <= 'J');
+}
+
+#define INPUT_BUFFER_SIZE 4096
+
+// Buffered line reader over a file descriptor (terminal, pipe or socket).
+// Input is read in large blocks, and the rest of the current line is kept so
+// several commands typed on one line are served one after another.
+typedef struct
+{
+    int fd;
+    char buffer[INPUT_BUFFER_SIZE];
+    int start, end; // Unconsumed bytes are buffer[start..end)
+    int eof;
+    char line[INPUT_BUFFER_SIZE]; // Current line
+    int cursor;            // Position of the next unread token in line
+} InputReader;
+
+void initializeInputReader(InputReader *reader, int fd)
+{
+    reader->fd = fd;
+    reader->start = reader->end = 0;
+    reader->eof = 0;
+    reader->line[0] = '\0';
+    reader->cursor = 0;
+}
+
+// Function to refill the reader's buffer with one read call, returns 0 at end of input
+int fillInputBuffer(InputReader *reader)
+{
+    if (reader->eof)
+        return 0;
+
+    fflush(stdout); // Make sure the prompt is visible before waiting for input
+
+#ifdef _WIN32
+    int count = _read(reader->fd, reader->buffer, INPUT_BUFFER_SIZE);
+#else
+    int count = (int)read(reader->fd, reader->buffer, INPUT_BUFFER_SIZE);
+#endif
+    if (count <= 0)
+    {
+        reader->eof = 1;
+        return 0;
+    }
+    reader->start = 0;
+    reader->end = count;
+    return 1;
+}
+
+// Function to load the next input line into reader->line, returns 0 at end of input.
+// Lines longer than INPUT_BUFFER_SIZE are cut short and the rest is dropped.
+int nextInputLine(InputReader *reader)
+{
+    int length = 0;
+    int gotAny = 0;
+
+    while (1)
+    {
+        if (reader->start == reader->end && !fillInputBuffer(reader))
+            break;
+
+        char *newline = memchr(reader->buffer + reader->start, '\n', (size_t)(reader->end - reader->start));
+        int chunk = newline ? (int)(newline - (reader->buffer + reader->start)) : reader->end - reader->start;
+        int room = (int)sizeof(reader->line) - 1 - length;
+        int copy = chunk < room ? chunk : room;
+
+        memcpy(reader->line + length, reader->buffer + reader->start, (size_t)copy);
+        length += copy;
+        gotAny = 1;
+        reader->start += chunk;
+
+        if (newline)
+        {
+            reader->start++; // Skip the newline itself
+            break;
+        }
+    }
+
+    if (!gotAny)
+        return 0;
+
+    if (length > 0 && reader->line[length - 1] == '\r')
+        length--;
+    reader->line[length] = '\0';
+    reader->cursor = 0;
+    return 1;
+}
+
+// Function to check if a character separates tokens
+int isTokenSeparator(char ch)
+{
+    return isspace((unsigned char)ch) || ch == ';' || ch == ',';
+}
+
+// Function to check if the current line still has unread tokens
+int inputPending(const InputReader *reader)
+{
+    for (int i = reader->cursor; reader->line[i]; i++)
+    {
+        if (!isTokenSeparator(reader->line[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Function to copy the next token of the current line into token, returns 0 if the line has none left
+int nextToken(InputReader *reader, char *token, int size)
+{
+    const char *line = reader->line;
+    int i = reader->cursor;
+    int length = 0;
+
+    while (line[i] && isTokenSeparator(line[i]))
+        i++;
+    if (!line[i])
+    {
+        reader->cursor = i;
+        return 0;
+    }
+
+    while (line[i] && !isTokenSeparator(line[i]))
+    {
+        if (length < size - 1)
+            token[length++] = (char)toupper((unsigned char)line[i]);
+        i++;
+    }
+    token[length] = '\0';
+    reader->cursor = i;
+    return 1;
+}
+
+// Function to read a free-text line (such as a name). Text left on the current
+// line is used first, otherwise a new line is read.
+int readInputLine(InputReader *reader, char *text, int size)
+{
+    if (!inputPending(reader) && !nextInputLine(reader))
+        return 0;
+
+    const char *rest = reader->line + reader->cursor;
+    while (*rest && isTokenSeparator(*rest))
+        rest++;
+
+    strncpy(text, rest, (size_t)size - 1);
+    text[size - 1] = '\0';
+    reader->cursor = (int)strlen(reader->line);
+    return 1;
+}
+
+// Commands understood by the input grammar
+#define CMD_FIRE 1      // FIRE B3
+#define CMD_RADAR 2     // RADAR C4
+#define CMD_SMOKE 3     // SMOKE D5
+#define CMD_ARTILLERY 4 // ARTILLERY E6
+#define CMD_TORPEDO 5   // TORPEDO R 5 or TORPEDO C B
+#define CMD_PLACE 6     // PLACE Carrier B3 H, or just B3 H
+#define CMD_NUMBER 7    // A menu choice such as 1 or 2
+#define CMD_SUGGEST 8   // SUGGEST
+#define CMD_HINT 9      // HINT
+
+typedef struct
+{
+    int type;
+    int row, col;     // Target cell, or the row/column of a torpedo
+    char axis;        // 'R' or 'C' for TORPEDO
+    int shipIndex;    // Ship named in PLACE, -1 if none was given
+    char orientation; // 'H' or 'V' for PLACE
+    int number;       // Value of CMD_NUMBER
+} Command;
+
+// Function to parse a coordinate token such as B3, returns 1 if valid
+int parseCoordinate(const char *token, int *row, int *col)
+{
+    char *end;
+
+    if (!isValidColumn(token[0]) || !isdigit((unsigned char)token[1]))
+        return 0;
+
+    long value = strtol(token + 1, &end, 10);
+    if (*end != '\0' || value < 1 || value > GRID_SIZE)
+        return 0;
+
+    *col = toupper(token[0]) - 'A'; // Convert 'A'-'J' to 0-9
+    *row = (int)value - 1;          // Adjust row to zero-index
+    return 1;
+}
+
+// Function to parse a whole number token, returns 1 if valid
+int parseNumber(const char *token, int *value)
+{
+    char *end;
+
+    if (!isdigit((unsigned char)token[0]))
+        return 0;
+
+    long number = strtol(token, &end, 10);
+    if (*end != '\0' || number > 1000000)
+        return 0;
+
+    *value = (int)number;
+    return 1;
+}
+
+// Function to parse H or V, returns 1 if valid
+int parseOrientation(const char *token, char *orientation)
+{
+    if ((token[0] == 'H' || token[0] == 'V') && token[1] == '\0')
+    {
+        *orientation = token[0];
+        return 1;
+    }
+    return 0;
+}
+
+// Function to read and parse the next command. Returns 1 on success, 0 at end
+// of input, or -1 after printing an error; the rest of a bad line is dropped so
+// the following prompt starts from clean input.
+int readCommand(InputReader *reader, Command *command)
+{
+    char keyword[INPUT_SIZE], token[INPUT_SIZE], extra[INPUT_SIZE];
+
+    while (!inputPending(reader))
+    {
+        if (!nextInputLine(reader))
+            return 0;
+    }
+
+    nextToken(reader, keyword, sizeof(keyword));
+    memset(command, 0, sizeof(*command));
+    command->shipIndex = -1;
+
+    if (strcmp(keyword, "FIRE") == 0)
+        command->type = CMD_FIRE;
+    else if (strcmp(keyword, "RADAR") == 0)
+        command->type = CMD_RADAR;
+    else if (strcmp(keyword, "SMOKE") == 0)
+        command->type = CMD_SMOKE;
+    else if (strcmp(keyword, "ARTILLERY") == 0)
+        command->type = CMD_ARTILLERY;
+
+    if (command->type != 0)
+    {
+        if (nextToken(reader, token, sizeof(token)) && parseCoordinate(token, &command->row, &command->col))
+            return 1;
+
+        printf("Invalid input. Please enter %s followed by coordinates, e.g. %s B3.\n", keyword, keyword);
+    }
+    else if (strcmp(keyword, "TORPEDO") == 0)
+    {
+        command->type = CMD_TORPEDO;
+        if (nextToken(reader, token, sizeof(token)) && (strcmp(token, "R") == 0 || strcmp(token, "C") == 0) &&
+            nextToken(reader, extra, sizeof(extra)))
+        {
+            command->axis = token[0];
+            if (command->axis == 'R' && parseNumber(extra, &command->row) && command->row >= 1 && command->row <= GRID_SIZE)
+            {
+                command->row -= 1; // Adjust row to zero-index
+                return 1;
+            }
+            if (command->axis == 'C' && isValidColumn(extra[0]) && extra[1] == '\0')
+            {
+                command->col = extra[0] - 'A';
+                return 1;
+            }
+        }
+
+        printf("Invalid input. Please enter TORPEDO R followed by a row (1-10) or TORPEDO C followed by a column (A-J).\n");
+    }
+    else if (strcmp(keyword, "PLACE") == 0 || parseCoordinate(keyword, &command->row, &command->col))
+    {
+        command->type = CMD_PLACE;
+        int ok = 1;
+
+        if (strcmp(keyword, "PLACE") == 0)
+        {
+            // Optional ship name, then the coordinate
+            ok = nextToken(reader, token, sizeof(token));
+            for (int i = 0; ok && i < fleet.count && command->shipIndex < 0; i++)
+            {
+                char name[INPUT_SIZE];
+                int n = 0;
+                for (; fleet.names[i][n]; n++)
+                    name[n] = (char)toupper((unsigned char)fleet.names[i][n]);
+                name[n] = '\0';
+                if (strcmp(token, name) == 0)
+                    command->shipIndex = i;
+            }
+            if (ok && command->shipIndex >= 0)
+                ok = nextToken(reader, token, sizeof(token));
+            ok = ok && parseCoordinate(token, &command->row, &command->col);
+        }
+
+        if (ok && nextToken(reader, token, sizeof(token)) && parseOrientation(token, &command->orientation))
+            return 1;
+
+        printf("Invalid input. Please enter column, row and orientation, e.g. PLACE Carrier B3 H or B3 H.\n");
+    }
+    else if (parseNumber(keyword, &command->number))
+    {
+        command->type = CMD_NUMBER;
+        return 1;
+    }
+    else if (strcmp(keyword, "SUGGEST") == 0)
+    {
+        command->type = CMD_SUGGEST;
+        return 1;
+    }
+    else if (strcmp(keyword, "HINT") == 0)
+    {
+        command->type = CMD_HINT;
+        return 1;
+    }
+    else
+    {
+        printf("Invalid command '%s'.\n", keyword);
+    }
+
+    reader->cursor = (int)strlen(reader->line); // Drop the rest of the bad line
+    return -1;
+}
+
+// Function to stop the game cleanly when input runs out
+void inputClosed()
+{
+    printf("\nInput closed, exiting.\n");
+    exit(0);
+}
+
+// Function to check if the ship can be placed without overlapping or going out of bounds
+int isValidPlacement(char grid[GRID_SIZE][GRID_SIZE], int row, int col, int shipSize, char orientation)
+{
+    if (orientation == 'H')
+    {
+        if (col + shipSize > GRID_SIZE)
+            return 0; // Out of bounds
+
+        for (int i = 0; i < shipSize; i++)
+        {
+            if (grid[row][col + i] != '~') // Check if space is already occupied
+                return 0;
+        }
+    }
+    else if (orientation == 'V')
+    {
+        if (row + shipSize > GRID_SIZE)
+            return 0; // Out of bounds
+
+        for (int i = 0; i < shipSize; i++)
+        {
+            if (grid[row + i][col] != '~') // Check if space is already occupied
+                return 0;
+        }
+    }
+    return 1; // Valid placement
+}
+
+void suggestPlacement(Ship ships[MAX_SHIPS], int shipIndex);
+
+// Function to place ship shipIndex of the fleet on the grid
+void placeShip(char grid[GRID_SIZE][GRID_SIZE], Ship ships[MAX_SHIPS], int shipIndex, InputReader *input)
+{
+    int row, col;
+    char orientation;
+    Command command;
+    Ship *ship = &ships[shipIndex];
+    int shipSize = fleet.sizes[shipIndex];
+    const char *shipName = fleet.names[shipIndex];
+
+    ship->shipSize = shipSize;    // Store ship size
+    strcpy(ship->name, shipName); // Store ship name
+    ship->sunk = 1;               // Initialize the sunk flag to 1 (not sunk)
+
+    printf("Place your %s (Size: %d): \n", shipName, shipSize);
+
+    while (1)
+    {
+        // Get column, row and orientation (e.g., B3 H or PLACE Carrier B3 H)
+        if (!inputPending(input))
+            printf("Enter column, row and orientation H or V (e.g., B3 H), or SUGGEST: ");
+
+        int status = readCommand(input, &command);
+        if (status == 0)
+            inputClosed();
+        if (status < 0)
+            continue;
+
+        if (command.type == CMD_SUGGEST)
+        {
+            suggestPlacement(ships, shipIndex);
+            continue;
+        }
+        if (command.type != CMD_PLACE)
+        {
+            printf("Invalid input. Please enter in the format B3 H.\n");
+            continue;
+        }
+        if (command.shipIndex >= 0 && strcmp(fleet.names[command.shipIndex], shipName) != 0)
+        {
+            printf("You are placing your %s now, not your %s.\n", shipName, fleet.names[command.shipIndex]);
+            continue;
+        }
+
+        row = command.row;
+        col = command.col;
+        orientation = command.orientation;
+
+        // Check for valid placement
+        if (isValidPlacement(grid, row, col, shipSize, orientation))
+            break;
+
+        printf("Invalid placement. Either out of bounds or overlapping. Try again.\n");
+    }
+
+    // Place the ship on the grid and store the coordinates
+    if (orientation == 'H')
+    {
+        for (int i = 0; i < shipSize; i++)
+        {
+            grid[row][col + i] = 'S';     // Mark ship on grid horizontally
+            ship->coords[i][0] = row;     // Store row coordinate
+            ship->coords[i][1] = col + i; // Store column coordinate
+        }
+    }
+    else if (orientation == 'V')
+    {
+        for (int i = 0; i < shipSize; i++)
+        {
+            grid[row + i][col] = 'S';     // Mark ship on grid vertically
+            ship->coords[i][0] = row + i; // Store row coordinate
+            ship->coords[i][1] = col;     // Store column coordinate
+        }
+    }
+
+    printf("\n"); // Add extra newline for readability
+}
+// Function to display what a player knows about the opponent's grid, with consideration of the tracking difficulty
+void displayGrid(const Observation *view, int trackingDifficulty)
+{
+    printf("  A B C D E F G H I J\n"); // Column headers
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        printf("%d ", i + 1); // Row numbers
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
+            if (bitboardTest(&view->hit, CELL_INDEX(i, j))) // Show hits
+                printf("* ");
+            else if (trackingDifficulty == 1 && bitboardTest(&view->miss, CELL_INDEX(i, j))) // Easy mode: show misses
+                printf("o ");
+            else // Hide everything else as water
+                printf("~ ");
+        }
+        printf("\n");
+    }
+}
+
+// Function to randomly select the first player
+int chooseFirstPlayer()
+{
+    return gameRand() % 2; // Randomly returns 0 or 1
+}
+
+// Function to ask the player for the tracking difficulty
+int askForTrackingDifficulty(InputReader *input)
+{
+    Command command;
+
+    while (1)
+    {
+        if (!inputPending(input))
+            printf("Choose tracking difficulty: 1 for Easy, 2 for Hard: ");
+
+        int status = readCommand(input, &command);
+        if (status == 0)
+            inputClosed();
+
+        // Only a single valid number (1 or 2) is accepted
+        if (status > 0 && command.type == CMD_NUMBER && (command.number == 1 || command.number == 2))
+        {
+            return command.number; // Valid difficulty, return it
+        }
+        else if (status > 0)
+        {
+            printf("Invalid input. Please enter 1 for Easy or 2 for Hard.\n");
+        }
+    }
+}
+// Function to ask for the game mode
+int askForGameMode(InputReader *input)
+{
+    Command command;
+
+    while (1)
+    {
+        if (!inputPending(input))
+            printf("Choose game mode: 1 for Player vs. Player, 2 for Player vs. Bot, 3 for Free-for-all: ");
+
+        int status = readCommand(input, &command);
+        if (status == 0)
+            inputClosed();
+
+        if (status > 0 && command.type == CMD_NUMBER && command.number >= 1 && command.number <= 3)
+        {
+            return command.number;
+        }
+        else if (status > 0)
+        {
+            printf("Invalid input. Please enter 1, 2 or 3.\n");
+        }
+    }
+}
+
+// Function to initialize the grid with water '~'
+void initializeGrid(char grid[GRID_SIZE][GRID_SIZE])
+{
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
+            grid[i][j] = '~'; // Water representation
+        }
+    }
+}
+
+// Function to check if a ship is sunk
+int isShipSunk(char grid[GRID_SIZE][GRID_SIZE], Ship ship)
+{
+    for (int i = 0; i < ship.shipSize; i++)
+    {
+        int row = ship.coords[i][0];
+        int col = ship.coords[i][1];
+        if (grid[row][col] != '*') // If any part of the ship is not hit
+        {
+            return 0; // The ship is not yet sunk
+        }
+    }
+    // Inside the part where you detect ship sinking
+    return 1; // All parts of the ship are hit, so it's sunk
+}
+
+// Function to count the remaining parts of a ship on the grid
+int countShipParts(char grid[GRID_SIZE][GRID_SIZE], char shipMarker)
+{
+    int count = 0;
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
+            if (grid[i][j] == shipMarker)
+            {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Function to fire at a coordinate
+int fireAtCoordinate(char grid[GRID_SIZE][GRID_SIZE], int row, int col, Ship ships[MAX_SHIPS], int trackingDifficulty, Observation *view)
+{
+    TRACE_SCOPE(TRACE_FIRE);
+    if (grid[row][col] == 'S') // Ship hit
+    {
+        grid[row][col] = '*'; // Mark as hit
+        observeShot(view, row, col, 1);
+
+        // Only Easy mode shows the result
+        LOG_EVENT(LOG_LEVEL_SHOTS, LOG_FIRE, trackingDifficulty == 1 ? 0 : LOG_FLAG_PRIVATE, row, col, 1);
+
+        return 1; // Hit
+    }
+    else if (grid[row][col] == '~') // Miss
+    {
+        grid[row][col] = 'o'; // Mark as miss
+        observeShot(view, row, col, 0);
+
+        // Only Easy mode shows the result
+        LOG_EVENT(LOG_LEVEL_SHOTS, LOG_FIRE, trackingDifficulty == 1 ? 0 : LOG_FLAG_PRIVATE, row, col, 0);
+
+        return 0; // Miss
+    }
+    else
+    {
+        // Already fired at this location, no additional feedback needed. The
+        // shooter still learns what is there, another player may have fired.
+        observeShot(view, row, col, grid[row][col] == '*');
+        LOG_EVENT(LOG_LEVEL_SHOTS, LOG_FIRE, trackingDifficulty == 1 ? 0 : LOG_FLAG_PRIVATE, row, col, 2);
+
+        return 0; // No hit
+    }
+}
+
+// Function to check if all ships are sunk
+int allShipsSunk(char grid[GRID_SIZE][GRID_SIZE])
+{
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
+            if (grid[i][j] == 'S')
+                return 0; // Still a ship remaining
+        }
+    }
+    return 1; // All ships are sunk
+}
+// Function to switch between players
+int switchPlayer(int currentPlayer)
+{
+    return currentPlayer == 0 ? 1 : 0;
+}
+
+// Perform artillery strike (hits a 2x2 area), returns the number of hits
+int artilleryStrike(char grid[GRID_SIZE][GRID_SIZE], int row, int col, int trackingDifficulty, Observation *view)
+{
+    TRACE_SCOPE(TRACE_ARTILLERY);
+    int hits = 0;
+
+    LOG_EVENT(LOG_LEVEL_SHOTS, LOG_ARTILLERY, 0, row, col);
+
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+    {
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+        {
+            if (grid[i][j] == 'S')
+            {
+                LOG_EVENT(LOG_LEVEL_SHOTS, LOG_ARTILLERY_CELL, 0, i, j, 1);
+                grid[i][j] = '*';
+                observeShot(view, i, j, 1);
+                hits++;
+            }
+            else
+            {
+                // The shooter learns about the miss even when the grid does not record it,
+                // and about a hit another player of a free-for-all made
+                observeShot(view, i, j, grid[i][j] == '*');
+
+                LOG_EVENT(LOG_LEVEL_SHOTS, LOG_ARTILLERY_CELL, 0, i, j, 0);
+                if (trackingDifficulty == 1) // Easy Mode
+                {
+                    if (grid[i][j] == '~')
+                        grid[i][j] = 'o'; // Mark miss, never over an earlier hit
+                }
+                // Hard Mode does not mark misses
+            }
+        }
+    }
+
+    return hits;
+}
+
+// Function to perform Torpedo attack, returns the number of hits
+int torpedoAttack(char grid[GRID_SIZE][GRID_SIZE], char choice, int num, int trackingDifficulty, Observation *view)
+{
+    TRACE_SCOPE(TRACE_TORPEDO);
+    int hit = 0;
+
+    if (choice == 'R')
+    { // Row attack
+        LOG_EVENT(LOG_LEVEL_SHOTS, LOG_TORPEDO, 0, 'R', num);
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
             if (grid[num][j] == 'S')
             {
-                grid[num][j] = '*'; // Mark hit
-                hit = 1;
-                if (trackingDifficulty == 1) // Only print in easy mode
+                grid[num][j] = '*'; // Mark hit
+                observeShot(view, num, j, 1);
+                hit++;
+                LOG_EVENT(LOG_LEVEL_SHOTS, LOG_TORPEDO_CELL, trackingDifficulty == 1 ? 0 : LOG_FLAG_PRIVATE, num, j, 1); // Only shown in easy mode
+            }
+            else
+            {
+                observeShot(view, num, j, grid[num][j] == '*');
+                LOG_EVENT(LOG_LEVEL_SHOTS, LOG_TORPEDO_CELL, trackingDifficulty == 1 ? 0 : LOG_FLAG_PRIVATE, num, j, 0);
+                if (trackingDifficulty == 1) // Only show and mark miss in easy mode
+                {
+                    if (grid[num][j] == '~')
+                        grid[num][j] = 'o'; // Mark miss, never over an earlier hit
+                }
+            }
+        }
+    }
+    else if (choice == 'C')
+    { // Column attack
+        LOG_EVENT(LOG_LEVEL_SHOTS, LOG_TORPEDO, 0, 'C', num);
+        for (int i = 0; i < GRID_SIZE; i++)
+        {
+            if (grid[i][num] == 'S')
+            {
+                grid[i][num] = '*'; // Mark hit
+                observeShot(view, i, num, 1);
+                hit++;
+                LOG_EVENT(LOG_LEVEL_SHOTS, LOG_TORPEDO_CELL, trackingDifficulty == 1 ? 0 : LOG_FLAG_PRIVATE, i, num, 1); // Only shown in easy mode
+            }
+            else
+            {
+                observeShot(view, i, num, grid[i][num] == '*');
+                LOG_EVENT(LOG_LEVEL_SHOTS, LOG_TORPEDO_CELL, trackingDifficulty == 1 ? 0 : LOG_FLAG_PRIVATE, i, num, 0);
+                if (trackingDifficulty == 1) // Only show and mark miss in easy mode
+                {
+                    if (grid[i][num] == '~')
+                        grid[i][num] = 'o'; // Mark miss, never over an earlier hit
+                }
+            }
+        }
+    }
+
+    return hit;
+}
+// Function to sweep a 2x2 area for ships, returns 1 if any unsmoked ship cell was found
+int radarSweep(char grid[GRID_SIZE][GRID_SIZE], int smokeGrid[GRID_SIZE][GRID_SIZE], int row, int col, Observation *view)
+{
+    TRACE_SCOPE(TRACE_RADAR);
+    int foundShip = 0;
+
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+    {
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+        {
+            if (smokeGrid[i][j] == 0 && grid[i][j] == 'S') // Skip cells that are under smoke
+            {
+                foundShip = 1;
+            }
+        }
+    }
+
+    LOG_EVENT(LOG_LEVEL_SHOTS, LOG_RADAR, 0, row, col, foundShip);
+    observeRadar(view, row, col, foundShip);
+    return foundShip;
+}
+
+void smokeScreen(int smokeDurationGrid[GRID_SIZE][GRID_SIZE], int row, int col)
+{
+    LOG_EVENT(LOG_LEVEL_SHOTS, LOG_SMOKE, 0, row, col);
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+ {
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+        {
+            smokeDurationGrid[i][j] = 1; // Set smoke duration for 1 round
+        }
+    }
+}
+
+void reduceSmokeDuration(int smokeDurationGrid[GRID_SIZE][GRID_SIZE])
+{
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
+            if (smokeDurationGrid[i][j] > 0) // If smoke is active
+            {
+                smokeDurationGrid[i][j]--; // Decrease duration
+            }
+        }
+    }
+}
+// Result of a single bot turn
+typedef struct
+{
+    int weapon; // WEAPON_FIRE, WEAPON_ARTILLERY or WEAPON_TORPEDO
+    int cells;  // Number of cells targeted
+    int hits;   // Number of ship cells hit
+} ShotReport;
+
+// Targeting state the bot carries between its turns
+typedef struct
+{
+    int lastHitRow, lastHitCol; // Track last hit for adjacent targeting
+    int torpedoRow, torpedoCol; // Row and Column to perform torpedo attacks
+    int torpedoState;           // 0 = column torpedo next, 1 = row torpedo next
+    int torpedoTurns;           // Number of remaining torpedo turns
+} BotState;
+
+// Function to reset the bot's targeting state at the start of a game
+void initializeBotState(BotState *state)
+{
+    state->lastHitRow = -1;
+    state->lastHitCol = -1;
+    state->torpedoRow = -1;
+    state->torpedoCol = -1;
+    state->torpedoState = 0;
+    state->torpedoTurns = 0;
+}
+
+// Function to record a bot hit and set up torpedo attacks for the next two turns
+void botRecordHit(BotState *state, int row, int col)
+{
+    state->torpedoRow = row;
+    state->torpedoCol = col;
+    state->torpedoState = 0; // Start with column torpedo
+    state->torpedoTurns = 2;
+    state->lastHitRow = row;
+    state->lastHitCol = col;
+}
+
+#define PLAYED_MOVE_TYPES 5 // Fire, radar, smoke, artillery and torpedo (either axis), counted by move type
+
+// Everything one side of the game owns
+typedef struct
+{
+    char name[NAME_SIZE];
+    char grid[GRID_SIZE][GRID_SIZE];             // This player's own fleet
+    Ship ships[MAX_SHIPS];                       // Coordinates of this player's ships
+    int smokeDurationGrid[GRID_SIZE][GRID_SIZE]; // Smoke covering this player's own fleet
+    int radarUses;
+    int smokeScreenUses;
+    int sunkTotal; // Enemy ships this player has sunk
+    int artilleryLifetime;
+    int torpedoLifetime;
+    int artilleryUnlocked; // Set once Artillery has been granted, it is only granted once
+    int torpedoUnlocked;   // Set once Torpedo has been granted, it is only granted once
+    Observation view;      // What this player knows about the opponent's board
+    BotState bot;          // Targeting state when this player is a bot
+    int movesPlayed[PLAYED_MOVE_TYPES]; // Actions taken this game, one per turn
+} PlayerState;
+
+// Complete state of a two player game
+typedef struct
+{
+    PlayerState players[2];
+    int currentPlayer;
+    int trackingDifficulty;
+} GameState;
+
+// Function to reset a player to the start of a game
+void initializePlayer(PlayerState *player, const char *name)
+{
+    memset(player, 0, sizeof(*player));
+    strncpy(player->name, name, NAME_SIZE - 1);
+    initializeGrid(player->grid);
+    player->radarUses = 3;
+    initializeObservation(&player->view);
+    initializeBotState(&player->bot);
+}
+
+// Function to start a player's turn: special weapons and smoke age by one turn
+void beginTurn(PlayerState *player)
+{
+    // Decrement lifetime variables at the start of the turn
+    if (player->artilleryLifetime == 1)
+        LOG_EVENT(LOG_LEVEL_EVENTS, LOG_EXPIRE, LOG_FLAG_PRIVATE, WEAPON_ARTILLERY);
+    if (player->torpedoLifetime == 1)
+        LOG_EVENT(LOG_LEVEL_EVENTS, LOG_EXPIRE, LOG_FLAG_PRIVATE, WEAPON_TORPEDO);
+    if (player->artilleryLifetime > 0)
+        player->artilleryLifetime--;
+    if (player->torpedoLifetime > 0)
+        player->torpedoLifetime--;
+
+    // Reduce smoke duration at the start of the player's turn
+    reduceSmokeDuration(player->smokeDurationGrid);
+}
+
+// Function to finish a turn: report sunk ships and unlock special moves.
+// Indices of ships sunk this turn are written to sunkShips (may be NULL), the count is returned.
+int resolveTurn(PlayerState *attacker, PlayerState *defender, int sunkShips[MAX_SHIPS])
+{
+    TRACE_SCOPE(TRACE_SINK_CHECK);
+    int sunkThisTurn = 0;
+
+    // Check if any ships have been sunk
+    for (int i = 0; i < fleet.count; i++)
+    {
+        if (defender->ships[i].sunk == 1 && isShipSunk(defender->grid, defender->ships[i]))
+        {
+            const Ship *ship = &defender->ships[i];
+            LOG_EVENT(LOG_LEVEL_EVENTS, LOG_SUNK, 0, i, ship->coords[0][0], ship->coords[0][1],
+                      ship->shipSize > 1 && ship->coords[1][0] == ship->coords[0][0] ? 'H' : 'V', ship->shipSize);
+            defender->ships[i].sunk = 0; // Mark the ship as sunk to prevent repeated messages
+            observeSunk(&attacker->view, &defender->ships[i], i);
+            attacker->smokeScreenUses++; // Award extra smoke use
+            attacker->sunkTotal++;
+            if (sunkShips != NULL)
+                sunkShips[sunkThisTurn] = i;
+            sunkThisTurn++;
+        }
+    }
+
+    // Unlock special moves based on sunkTotal
+    if (attacker->sunkTotal >= 1 && !attacker->artilleryUnlocked)
+    {
+        attacker->artilleryLifetime = 2;
+        attacker->artilleryUnlocked = 1;
+        LOG_EVENT(LOG_LEVEL_EVENTS, LOG_UNLOCK, 0, WEAPON_ARTILLERY);
+    }
+    if (attacker->sunkTotal >= 3 && !attacker->torpedoUnlocked)
+    {
+        attacker->torpedoLifetime = 2;
+        attacker->torpedoUnlocked = 1;
+        LOG_EVENT(LOG_LEVEL_EVENTS, LOG_UNLOCK, 0, WEAPON_TORPEDO);
+    }
+
+    return sunkThisTurn;
+}
+
+// Actions encoded in 16 bits: the action type in bits 7-9 and its target in
+// bits 0-6 (a cell index, or a row or column for a torpedo).
+typedef uint16_t Move;
+
+#define MOVE_FIRE 0
+#define MOVE_RADAR 1
+#define MOVE_SMOKE 2
+#define MOVE_ARTILLERY 3
+#define MOVE_TORPEDO_ROW 4
+#define MOVE_TORPEDO_COLUMN 5
+
+#define MAKE_MOVE(type, target) ((Move)(((type) << 7) | (target)))
+#define MOVE_TYPE(move) ((move) >> 7)
+#define MOVE_TARGET(move) ((move) & 0x7F)
+
+// Largest number of legal moves in any state: fire, radar, smoke and artillery at every cell plus every torpedo line
+#define MAX_LEGAL_MOVES (4 * GRID_SIZE * GRID_SIZE + 2 * GRID_SIZE)
+
+// Function to check if an action may be played by this player now
+int isLegalMove(const PlayerState *self, Move move)
+{
+    int target = MOVE_TARGET(move);
+
+    switch (MOVE_TYPE(move))
+    {
+    case MOVE_FIRE:
+        return target < GRID_SIZE * GRID_SIZE;
+    case MOVE_RADAR:
+        return target < GRID_SIZE * GRID_SIZE && self->radarUses > 0;
+    case MOVE_SMOKE:
+        return target < GRID_SIZE * GRID_SIZE && self->smokeScreenUses > 0;
+    case MOVE_ARTILLERY:
+        return target < GRID_SIZE * GRID_SIZE && self->artilleryLifetime > 0;
+    case MOVE_TORPEDO_ROW:
+    case MOVE_TORPEDO_COLUMN:
+        return target < GRID_SIZE && self->torpedoLifetime > 0 && self->sunkTotal >= 3;
+    }
+    return 0;
+}
+
+// Function to write every legal action of this player into moves (room for
+// MAX_LEGAL_MOVES), returns how many were written. Cells already fired at are
+// left out of FIRE when skipFired is set; firing there again is legal but wasted.
+int generateLegalMoves(const PlayerState *self, int skipFired, Move *moves)
+{
+    int count = 0;
+
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        if (!skipFired || observationIsUnknown(&self->view, cell / GRID_SIZE, cell % GRID_SIZE))
+            moves[count++] = MAKE_MOVE(MOVE_FIRE, cell);
+    }
+    if (self->radarUses > 0)
+        for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+            moves[count++] = MAKE_MOVE(MOVE_RADAR, cell);
+    if (self->smokeScreenUses > 0)
+        for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+            moves[count++] = MAKE_MOVE(MOVE_SMOKE, cell);
+    if (self->artilleryLifetime > 0)
+        for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+            moves[count++] = MAKE_MOVE(MOVE_ARTILLERY, cell);
+    if (self->torpedoLifetime > 0 && self->sunkTotal >= 3)
+    {
+        for (int line = 0; line < GRID_SIZE; line++)
+            moves[count++] = MAKE_MOVE(MOVE_TORPEDO_ROW, line);
+        for (int line = 0; line < GRID_SIZE; line++)
+            moves[count++] = MAKE_MOVE(MOVE_TORPEDO_COLUMN, line);
+    }
+    return count;
+}
+
+// Function to carry out a legal action with the usual messages, the shot's results go to report (may be NULL)
+void playMove(PlayerState *self, PlayerState *opponent, Move move, int trackingDifficulty, ShotReport *report)
+{
+    int target = MOVE_TARGET(move);
+    int row = target / GRID_SIZE, col = target % GRID_SIZE;
+    ShotReport unused;
+
+    if (report == NULL)
+        report = &unused;
+    report->weapon = WEAPON_FIRE;
+    report->cells = 0; // Radar and smoke fire no shots
+    report->hits = 0;
+    self->movesPlayed[MOVE_TYPE(move) == MOVE_TORPEDO_COLUMN ? MOVE_TORPEDO_ROW : MOVE_TYPE(move)]++;
+
+    switch (MOVE_TYPE(move))
+    {
+    case MOVE_FIRE:
+        report->cells = 1;
+        report->hits = fireAtCoordinate(opponent->grid, row, col, opponent->ships, trackingDifficulty, &self->view);
+        break;
+    case MOVE_RADAR:
+        radarSweep(opponent->grid, opponent->smokeDurationGrid, row, col, &self->view);
+        self->radarUses--;
+        break;
+    case MOVE_SMOKE:
+        smokeScreen(self->smokeDurationGrid, row, col);
+        self->smokeScreenUses--;
+        break;
+    case MOVE_ARTILLERY:
+        report->weapon = WEAPON_ARTILLERY;
+        report->cells = 4;
+        report->hits = artilleryStrike(opponent->grid, row, col, trackingDifficulty, &self->view);
+        self->artilleryLifetime = 0; // Deactivate after use
+        break;
+    case MOVE_TORPEDO_ROW:
+    case MOVE_TORPEDO_COLUMN:
+        report->weapon = WEAPON_TORPEDO;
+        report->cells = GRID_SIZE;
+        report->hits = torpedoAttack(opponent->grid, MOVE_TYPE(move) == MOVE_TORPEDO_ROW ? 'R' : 'C', target, trackingDifficulty, &self->view);
+        self->torpedoLifetime = 0; // Deactivate after use
+        break;
+    }
+}
+
+// Everything applyMove changed, so undoMove can put it back
+typedef struct
+{
+    int cellCount;
+    unsigned char cells[GRID_SIZE];  // Opponent grid cells the move could change
+    char cellValues[GRID_SIZE];
+    int smokeValues[4];              // Own smoke over the 2x2 area of a smoke screen
+    int shipSunk[MAX_SHIPS];         // Opponent ships' sunk flags
+    int radarUses, smokeScreenUses, sunkTotal;
+    int artilleryLifetime, torpedoLifetime, artilleryUnlocked, torpedoUnlocked;
+    Observation view;
+} MoveUndo;
+
+// Function to play a legal action and resolve the turn without any output, for searches.
+// The previous state is saved in undo.
+void applyMove(PlayerState *self, PlayerState *opponent, Move move, int trackingDifficulty, MoveUndo *undo)
+{
+    int target = MOVE_TARGET(move);
+    int row = target / GRID_SIZE, col = target % GRID_SIZE;
+    int type = MOVE_TYPE(move);
+
+    undo->cellCount = 0;
+    if (type == MOVE_FIRE)
+        undo->cells[undo->cellCount++] = (unsigned char)target;
+    else if (type == MOVE_ARTILLERY)
+    {
+        for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+            for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+                undo->cells[undo->cellCount++] = (unsigned char)CELL_INDEX(i, j);
+    }
+    else if (type == MOVE_TORPEDO_ROW || type == MOVE_TORPEDO_COLUMN)
+    {
+        for (int k = 0; k < GRID_SIZE; k++)
+            undo->cells[undo->cellCount++] = (unsigned char)(type == MOVE_TORPEDO_ROW ? CELL_INDEX(target, k) : CELL_INDEX(k, target));
+    }
+    for (int k = 0; k < undo->cellCount; k++)
+        undo->cellValues[k] = opponent->grid[undo->cells[k] / GRID_SIZE][undo->cells[k] % GRID_SIZE];
+    if (type == MOVE_SMOKE)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            int i = row + k / 2, j = col + k % 2;
+            undo->smokeValues[k] = i < GRID_SIZE && j < GRID_SIZE ? self->smokeDurationGrid[i][j] : 0;
+        }
+    }
+    for (int i = 0; i < fleet.count; i++)
+        undo->shipSunk[i] = opponent->ships[i].sunk;
+    undo->radarUses = self->radarUses;
+    undo->smokeScreenUses = self->smokeScreenUses;
+    undo->sunkTotal = self->sunkTotal;
+    undo->artilleryLifetime = self->artilleryLifetime;
+    undo->torpedoLifetime = self->torpedoLifetime;
+    undo->artilleryUnlocked = self->artilleryUnlocked;
+    undo->torpedoUnlocked = self->torpedoUnlocked;
+    undo->view = self->view;
+
+    // Searches never print, log or trace the moves they try
+    WorkerQuiet saved = enterWorkerQuiet();
+    playMove(self, opponent, move, trackingDifficulty, NULL);
+    resolveTurn(self, opponent, NULL);
+    leaveWorkerQuiet(saved);
+}
+
+// Function to take back the last applyMove of this player
+void undoMove(PlayerState *self, PlayerState *opponent, Move move, const MoveUndo *undo)
+{
+    int target = MOVE_TARGET(move);
+
+    for (int k = 0; k < undo->cellCount; k++)
+        opponent->grid[undo->cells[k] / GRID_SIZE][undo->cells[k] % GRID_SIZE] = undo->cellValues[k];
+    if (MOVE_TYPE(move) == MOVE_SMOKE)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            int i = target / GRID_SIZE + k / 2, j = target % GRID_SIZE + k % 2;
+            if (i < GRID_SIZE && j < GRID_SIZE)
+                self->smokeDurationGrid[i][j] = undo->smokeValues[k];
+        }
+    }
+    for (int i = 0; i < fleet.count; i++)
+        opponent->ships[i].sunk = undo->shipSunk[i];
+    self->radarUses = undo->radarUses;
+    self->smokeScreenUses = undo->smokeScreenUses;
+    self->sunkTotal = undo->sunkTotal;
+    self->artilleryLifetime = undo->artilleryLifetime;
+    self->torpedoLifetime = undo->torpedoLifetime;
+    self->artilleryUnlocked = undo->artilleryUnlocked;
+    self->torpedoUnlocked = undo->torpedoUnlocked;
+    self->view = undo->view;
+    self->movesPlayed[MOVE_TYPE(move) == MOVE_TORPEDO_COLUMN ? MOVE_TORPEDO_ROW : MOVE_TYPE(move)]--;
+}
+
+// Radar and smoke planner, defined after the layout sampler it draws from
+#define PLAN_SAMPLES 128
+#define PLAN_COUNTER_BITS 8   // Counts up to PLAN_SAMPLES
+#define RADAR_MIN_GAIN 0.9    // Bits a sweep must be worth before the bot gives a turn to it
+#define SMOKE_MIN_SHARE 0.3   // Share of the opponent's likely sweeps a smoke screen must foil
+#define SMOKE_SHARPNESS 16.0  // How strongly the opponent is expected to favour its best sweeps
+
+int planRadar(const Observation *view, double *gain);
+int planSmoke(const PlayerState *self, const PlayerState *opponent, double *share);
+int fleetOpenToSweep(const PlayerState *self, const PlayerState *opponent);
+void printMoveHint(const PlayerState *self, const PlayerState *opponent);
+
+// Move handler
+void performMove(PlayerState *self, PlayerState *opponent, int trackingDifficulty, InputReader *input)
+{
+    TRACE_SCOPE(TRACE_PERFORM_MOVE);
+    Command command;
+    int validMove = 0; // Flag to check if a valid move was chosen
+
+    while (!validMove) // Loop until a valid move is chosen
+    {
+        if (!inputPending(input))
+            printf("Choose your move (FIRE B3, RADAR B3, SMOKE B3, ARTILLERY B3, TORPEDO R 3 or TORPEDO C B), or HINT: ");
+
+        int status = readCommand(input, &command);
+        if (status == 0)
+            inputClosed();
+        if (status < 0)
+            continue;
+        if (command.type == CMD_HINT)
+        {
+            printMoveHint(self, opponent);
+            continue;
+        }
+
+        Move move;
+        int cell = CELL_INDEX(command.row, command.col);
+        if (command.type == CMD_FIRE)
+            move = MAKE_MOVE(MOVE_FIRE, cell);
+        else if (command.type == CMD_RADAR)
+            move = MAKE_MOVE(MOVE_RADAR, cell);
+        else if (command.type == CMD_SMOKE)
+            move = MAKE_MOVE(MOVE_SMOKE, cell);
+        else if (command.type == CMD_ARTILLERY)
+            move = MAKE_MOVE(MOVE_ARTILLERY, cell);
+        else if (command.type == CMD_TORPEDO)
+            move = command.axis == 'R' ? MAKE_MOVE(MOVE_TORPEDO_ROW, command.row) : MAKE_MOVE(MOVE_TORPEDO_COLUMN, command.col);
+        else
+        {
+            printf("Invalid move! Please enter a valid move.\n");
+            continue;
+        }
+
+        if (!isLegalMove(self, move))
+        {
+            if (MOVE_TYPE(move) == MOVE_RADAR)
+                printf("No radar sweeps left!\n");
+            else if (MOVE_TYPE(move) == MOVE_SMOKE)
+                printf("No smoke screens left!\n");
+            else if (MOVE_TYPE(move) == MOVE_ARTILLERY)
+                printf("Artillery is not available!\n");
+            else
+                printf("Torpedo is not available!\n");
+            continue;
+        }
+
+        playMove(self, opponent, move, trackingDifficulty, NULL);
+        if (MOVE_TYPE(move) == MOVE_ARTILLERY)
+            printf("Artillery used successfully!\n");
+        else if (MOVE_TYPE(move) == MOVE_TORPEDO_ROW)
+            printf("Torpedo used successfully on row %d!\n", command.row + 1);
+        else if (MOVE_TYPE(move) == MOVE_TORPEDO_COLUMN)
+            printf("Torpedo used successfully on column %c!\n", command.col + 'A');
+        validMove = 1; // Mark the move as valid
+    }
+}
+int isAdjacent(char grid[GRID_SIZE][GRID_SIZE], int row, int col, int shipSize, char orientation)
+{
+    int directions[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+    if (orientation == 'H')
+    {
+        for (int i = 0; i < shipSize; i++)
+        {
+            int r = row;
+            int c = col + i;
+            for (int d = 0; d < 8; d++)
+            {
+                int adjR = r + directions[d][0];
+                int adjC = c + directions[d][1];
+                if (adjR >= 0 && adjR < GRID_SIZE && adjC >= 0 && adjC < GRID_SIZE && grid[adjR][adjC] == 'S')
+                {
+                    return 1; // Adjacent to another ship
+                }
+            }
+        }
+    }
+    else if (orientation == 'V')
+    {
+        for (int i = 0; i < shipSize; i++)
+        {
+            int r = row + i;
+            int c = col;
+            for (int d = 0; d < 8; d++)
+            {
+                int adjR = r + directions[d][0];
+                int adjC = c + directions[d][1];
+                if (adjR >= 0 && adjR < GRID_SIZE && adjC >= 0 && adjC < GRID_SIZE && grid[adjR][adjC] == 'S')
+                {
+                    return 1; // Adjacent to another ship
+                }
+            }
+        }
+    }
+
+    return 0; // No adjacent ships
+}
+
+// Helper function to place a single ship automatically
+void autoPlaceSingleShip(char grid[GRID_SIZE][GRID_SIZE], Ship *ship, int shipSize, const char *shipName)
+{
+    int valid = 0, attempts = 0;
+    while (!valid)
+    {
+        if (attempts > 100)
+        { // Safeguard: if too many attempts, reset grid
+            LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_PLACE_RETRY, 0, 0);
+            initializeGrid(grid); // Reset grid
+            attempts = 0;         // Reset attempts
+        }
+
+        int row = gameRand() % GRID_SIZE;
+        int col = gameRand() % GRID_SIZE;
+        char orientation = (gameRand() % 2 == 0) ? 'H' : 'V'; // Randomize orientation
+
+        if (isValidPlacement(grid, row, col, shipSize, orientation) &&
+            !isAdjacent(grid, row, col, shipSize, orientation))
+        {
+            // Place the ship on the grid
+            if (orientation == 'H')
+            {
+                for (int i = 0; i < shipSize; i++)
+                {
+                    grid[row][col + i] = 'S';     // Mark ship on grid horizontally
+                    ship->coords[i][0] = row;     // Store row coordinate
+                    ship->coords[i][1] = col + i; // Store column coordinate
+                }
+            }
+            else // 'V'
+            {
+                for (int i = 0; i < shipSize; i++)
+                {
+                    grid[row + i][col] = 'S';     // Mark ship on grid vertically
+                    ship->coords[i][0] = row + i; // Store row coordinate
+                    ship->coords[i][1] = col;     // Store column coordinate
+                }
+            }
+
+            // Initialize ship properties
+            ship->shipSize = shipSize;
+            strcpy(ship->name, shipName);
+            ship->sunk = 1; // Initialize the sunk flag to 1 (not sunk)
+
+            valid = 1; // Ship placed successfully
+        }
+        attempts++;
+    }
+}
+// Refactored autoPlaceShips function
+void autoPlaceShips(char grid[GRID_SIZE][GRID_SIZE], Ship ships[MAX_SHIPS])
+{
+    TRACE_SCOPE(TRACE_AUTO_PLACE);
+    for (int i = 0; i < fleet.count; i++)
+    {
+        autoPlaceSingleShip(grid, &ships[i], fleet.sizes[i], fleet.names[i]);
+    }
+
+    LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_PLACED, 0, 0);
+}
+
+// Function to read a monotonic clock in seconds
+double monotonicSeconds()
+{
+#ifdef _WIN32
+    return (double)GetTickCount64() / 1000.0;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+// Exact endgame solver. Once few ship layouts are consistent with the
+// observation, it searches for the move that minimises the expected number of
+// remaining shots. Sub-results are kept in a transposition table keyed by the
+// observation's Zobrist hash. The table is emptied (by a new generation) for
+// every solve and the search stops after a fixed number of nodes, so the move
+// depends on the position alone, never on the clock or on earlier games.
+#define MAX_ENDGAME_SHIPS 2
+#define MAX_ENDGAME_LAYOUTS 128
+#define ENDGAME_TABLE_SIZE (1 << 16)
+
+int endgameLayoutThreshold = 12; // Solve only when at most this many layouts remain
+long endgameNodeBudget = 20000;  // Positions the solver may expand for one move
+
+// One way the remaining ships could be placed
+typedef struct
+{
+    BitBoard ship[MAX_ENDGAME_SHIPS]; // Cells of each remaining ship
+    BitBoard cells;                   // Cells of all remaining ships
+} EndgameLayout;
+
+typedef struct
+{
+    uint64_t key;
+    double expectedShots;
+    uint32_t generation; // Solve the entry belongs to
+    short bestCell;      // Best cell to fire at, -1 if unknown
+} EndgameEntry;
+
+typedef struct
+{
+    EndgameLayout layouts[MAX_ENDGAME_LAYOUTS];
+    int layoutCount;
+    int overflow; // Set when more layouts exist than the threshold
+    int shipCount;
+    int shipIndex[MAX_ENDGAME_SHIPS]; // Fleet index of each remaining ship
+    int shipSize[MAX_ENDGAME_SHIPS];
+    long nodes;
+    int timedOut; // Set once the node budget ran out
+} EndgameSearch;
+
+// Transposition table, one per thread so simulations do not contend for it
+static THREAD_LOCAL EndgameEntry *endgameTable = NULL;
+static THREAD_LOCAL uint32_t endgameGeneration = 0;
+
+// The move chosen by the solver
+typedef struct
+{
+    int weapon;    // WEAPON_FIRE, WEAPON_ARTILLERY or WEAPON_TORPEDO
+    int row, col;  // Target cell, artillery corner, or torpedo row/column
+    char axis;     // 'R' or 'C' for a torpedo
+    double expectedShots;
+} EndgameChoice;
+
+// Function to list every placement of the remaining ships that fits the observation
+void enumerateEndgameLayouts(EndgameSearch *search, int ship, BitBoard used, BitBoard blocked, BitBoard mustCover, EndgameLayout *partial)
+{
+    if (search->overflow)
+        return;
+
+    if (ship == search->shipCount)
+    {
+        // Every hit that is not part of a sunk ship must belong to a remaining ship
+        if (!bitboardIsEmpty(bitboardAndNot(mustCover, used)))
+            return;
+        if (search->layoutCount >= endgameLayoutThreshold || search->layoutCount >= MAX_ENDGAME_LAYOUTS)
+        {
+            search->overflow = 1;
+            return;
+        }
+        partial->cells = used;
+        search->layouts[search->layoutCount++] = *partial;
+        return;
+    }
+
+    const PlacementKernel *kernel = &placementKernels[search->shipSize[ship]];
+    BitBoard taken = bitboardOr(used, blocked);
+    for (int p = 0; p < kernel->count; p++)
+    {
+        BitBoard mask = kernel->masks[p];
+        if (!bitboardIsEmpty(bitboardAnd(mask, taken)))
+            continue;
+
+        partial->ship[ship] = mask;
+        enumerateEndgameLayouts(search, ship + 1, bitboardOr(used, mask), blocked, mustCover, partial);
+        if (search->overflow)
+            return;
+    }
+}
+
+// Function to check every unexplained hit can still be covered by some
+// remaining ship, using the per-cell coverage tables
+int endgameHitsCoverable(const EndgameSearch *search, BitBoard blocked, BitBoard mustCover)
+{
+    for (int cell = bitboardPopFirst(&mustCover); cell >= 0; cell = bitboardPopFirst(&mustCover))
+    {
+        int covered = 0;
+        for (int k = 0; k < search->shipCount && !covered; k++)
+        {
+            const PlacementKernel *kernel = &placementKernels[search->shipSize[k]];
+            for (int c = kernel->coverStart[cell]; c < kernel->coverStart[cell + 1] && !covered; c++)
+                covered = bitboardIsEmpty(bitboardAnd(kernel->masks[kernel->coverList[c]], blocked));
+        }
+        if (!covered)
+            return 0;
+    }
+    return 1;
+}
+
+double endgameSolve(EndgameSearch *search, const unsigned char *set, int count, BitBoard hits, BitBoard fired, uint64_t hash, int *bestCell);
+
+// Function to evaluate firing at every cell of target at once (one cell for a
+// plain shot, four for artillery, a line for a torpedo). Returns the expected
+// number of shots including this one, or a value of at least cutoff when the
+// target is already known to be no better than cutoff.
+double endgameEvaluate(EndgameSearch *search, const unsigned char *set, int count, BitBoard hits, BitBoard fired, uint64_t hash, BitBoard target, double cutoff)
+{
+    BitBoard outcomeHits[MAX_ENDGAME_LAYOUTS];
+    int outcomeSunk[MAX_ENDGAME_LAYOUTS];
+    int group[MAX_ENDGAME_LAYOUTS];
+    int groupCount = 0;
+    int groupSize[MAX_ENDGAME_LAYOUTS];
+    int groupFirst[MAX_ENDGAME_LAYOUTS];
+    BitBoard newCells = bitboardAndNot(target, fired);
+
+    // Group the layouts by what the shooter would observe
+    for (int i = 0; i < count; i++)
+    {
+        const EndgameLayout *layout = &search->layouts[set[i]];
+        BitBoard newHits = bitboardAnd(layout->cells, newCells);
+        BitBoard allHits = bitboardOr(hits, newHits);
+        int sunk = 0;
+
+        for (int k = 0; k < search->shipCount; k++)
+        {
+            if (!bitboardIsEmpty(bitboardAnd(layout->ship[k], newHits)) &&
+                bitboardIsEmpty(bitboardAndNot(layout->ship[k], allHits)))
+                sunk |= 1 << k;
+        }
+        outcomeHits[i] = newHits;
+        outcomeSunk[i] = sunk;
+
+        if (bitboardIsEmpty(bitboardAndNot(layout->cells, allHits)))
+        {
+            group[i] = -1; // Every ship is sunk, the game is over
+            continue;
+        }
+
+        group[i] = groupCount;
+        for (int g = 0; g < groupCount; g++)
+        {
+            int first = groupFirst[g];
+            if (outcomeSunk[first] == sunk && bitboardEqual(outcomeHits[first], newHits))
+            {
+                group[i] = g;
+                break;
+            }
+        }
+        if (group[i] == groupCount)
+        {
+            groupFirst[groupCount] = i;
+            groupSize[groupCount++] = 0;
+        }
+        groupSize[group[i]]++;
+    }
+
+    // Each group that is not over needs at least as many shots as its
+    // layout with the fewest ship cells left
+    int groupLeft[MAX_ENDGAME_LAYOUTS];
+    for (int g = 0; g < groupCount; g++)
+        groupLeft[g] = GRID_SIZE * GRID_SIZE;
+    for (int i = 0; i < count; i++)
+    {
+        if (group[i] < 0)
+            continue;
+        int left = bitboardCount(bitboardAndNot(search->layouts[set[i]].cells, bitboardOr(hits, outcomeHits[i])));
+        if (left < groupLeft[group[i]])
+            groupLeft[group[i]] = left;
+    }
+
+    double lowerBound = 1.0;
+    for (int g = 0; g < groupCount; g++)
+        lowerBound += (double)groupSize[g] / count * groupLeft[g];
+    if (lowerBound >= cutoff)
+        return lowerBound;
+
+    double expected = lowerBound;
+    for (int g = 0; g < groupCount; g++)
+    {
+        unsigned char child[MAX_ENDGAME_LAYOUTS];
+        int childCount = 0;
+        int first = groupFirst[g];
+        BitBoard newHits = outcomeHits[first];
+        BitBoard childHits = bitboardOr(hits, newHits);
+        uint64_t childHash = hash;
+        BitBoard walk = newCells;
+        int cell, unusedCell;
+
+        for (int i = 0; i < count; i++)
+        {
+            if (group[i] == g)
+                child[childCount++] = set[i];
+        }
+
+        while ((cell = bitboardPopFirst(&walk)) >= 0)
+            childHash ^= zobristKey((bitboardTest(&newHits, cell) ? ZOBRIST_HIT : ZOBRIST_MISS) + cell);
+        for (int k = 0; k < search->shipCount; k++)
+        {
+            if (outcomeSunk[first] & (1 << k))
+                childHash ^= zobristKey(ZOBRIST_SUNK + search->shipIndex[k]);
+        }
+
+        double value = endgameSolve(search, child, childCount, childHits, bitboardOr(fired, target), childHash, &unusedCell);
+        if (search->timedOut)
+            return cutoff;
+
+        expected += (double)childCount / count * (value - groupLeft[g]);
+        if (expected >= cutoff)
+            return expected;
+    }
+    return expected;
+}
+
+// Function to find the expected number of shots left from a state where only
+// plain shots are available, and the best cell to fire at
+double endgameSolve(EndgameSearch *search, const unsigned char *set, int count, BitBoard hits, BitBoard fired, uint64_t hash, int *bestCell)
+{
+    // With a single layout left, each remaining ship cell takes one shot
+    if (count == 1)
+    {
+        BitBoard left = bitboardAndNot(search->layouts[set[0]].cells, hits);
+        *bestCell = bitboardPopFirst(&left);
+        return (double)bitboardCount(bitboardAndNot(search->layouts[set[0]].cells, hits));
+    }
+
+    EndgameEntry *entry = &endgameTable[hash & (ENDGAME_TABLE_SIZE - 1)];
+    if (entry->key == hash && entry->generation == endgameGeneration)
+    {
+        *bestCell = entry->bestCell;
+        return entry->expectedShots;
+    }
+
+    if (++search->nodes > endgameNodeBudget)
+    {
+        search->timedOut = 1;
+        return 0.0;
+    }
+
+    // Candidate cells: unfired cells that hold a ship in at least one layout,
+    // tried in order of how many layouts they hit. Cells that hold a ship in
+    // exactly the same layouts are interchangeable, so only one of them is kept.
+    int candidates[GRID_SIZE * GRID_SIZE];
+    int hitCount[GRID_SIZE * GRID_SIZE] = {0};
+    BitBoard members[GRID_SIZE * GRID_SIZE]; // Bit i set when layout set[i] holds the cell
+    int candidateCount = 0;
+    BitBoard possible = {{0, 0}};
+    for (int i = 0; i < count; i++)
+        possible = bitboardOr(possible, search->layouts[set[i]].cells);
+    possible = bitboardAndNot(possible, fired);
+    BitBoard walk = possible;
+    int cell;
+    while ((cell = bitboardPopFirst(&walk)) >= 0)
+        memset(&members[cell], 0, sizeof(BitBoard));
+    for (int i = 0; i < count; i++)
+    {
+        walk = bitboardAndNot(search->layouts[set[i]].cells, fired);
+        while ((cell = bitboardPopFirst(&walk)) >= 0)
+        {
+            hitCount[cell]++;
+            bitboardSet(&members[cell], i);
+        }
+    }
+    walk = possible;
+    while ((cell = bitboardPopFirst(&walk)) >= 0)
+    {
+        int duplicate = 0;
+        for (int i = 0; i < candidateCount && !duplicate; i++)
+            duplicate = bitboardEqual(members[candidates[i]], members[cell]);
+        if (!duplicate)
+            candidates[candidateCount++] = cell;
+    }
+    for (int i = 1; i < candidateCount; i++)
+    {
+        int cell = candidates[i], j = i;
+        while (j > 0 && hitCount[candidates[j - 1]] < hitCount[cell])
+        {
+            candidates[j] = candidates[j - 1];
+            j--;
+        }
+        candidates[j] = cell;
+    }
+
+    // A cell every layout has a ship on must be fired at sooner or later, and
+    // firing it first only brings its information earlier, so nothing else is tried
+    if (hitCount[candidates[0]] == count)
+        candidateCount = 1;
+
+    double best = 1e9;
+    *bestCell = candidates[0];
+    for (int i = 0; i < candidateCount; i++)
+    {
+        BitBoard target = {{0, 0}};
+        bitboardSet(&target, candidates[i]);
+        double value = endgameEvaluate(search, set, count, hits, fired, hash, target, best);
+        if (search->timedOut)
+            return 0.0;
+        if (value < best)
+        {
+            best = value;
+            *bestCell = candidates[i];
+        }
+    }
+
+    entry->key = hash;
+    entry->expectedShots = best;
+    entry->generation = endgameGeneration;
+    entry->bestCell = (short)*bestCell;
+    return best;
+}
+
+// Function to list the layouts the remaining ships can take. Returns 0 when the
+// position is not an endgame (too many ships or layouts left).
+int findEndgameLayouts(const Observation *view, EndgameSearch *search)
+{
+    EndgameLayout partial;
+    BitBoard blocked = bitboardOr(view->miss, view->sunk);
+    BitBoard mustCover = bitboardAndNot(view->hit, view->sunk);
+
+    search->shipCount = 0;
+    for (int i = 0; i < fleet.count; i++)
+    {
+        if (view->sunkShips & (1 << i))
+            continue;
+        if (search->shipCount == MAX_ENDGAME_SHIPS)
+            return 0;
+        search->shipIndex[search->shipCount] = i;
+        search->shipSize[search->shipCount++] = fleet.sizes[i];
+    }
+    if (search->shipCount == 0)
+        return 0;
+
+    if (!endgameHitsCoverable(search, blocked, mustCover))
+        return 0;
+
+    search->layoutCount = 0;
+    search->overflow = 0;
+    enumerateEndgameLayouts(search, 0, (BitBoard){{0, 0}}, blocked, mustCover, &partial);
+    return !search->overflow && search->layoutCount > 0;
+}
+
+// Function to fold a value into an endgame key (a splitmix64 step)
+uint64_t mixEndgameKey(uint64_t key, uint64_t value)
+{
+    uint64_t z = (key ^ value) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Function to key everything a solve depends on: the sizes of the remaining
+// ships, the layouts they can take, the hits those layouts must cover and the
+// weapons at hand. Unlike the observation hash it leaves out shots that no
+// longer matter, so different games that come down to the same ending share a key.
+uint64_t endgameKey(const EndgameSearch *search, const Observation *view, int artilleryReady, int torpedoReady)
+{
+    BitBoard unresolved = bitboardAndNot(view->hit, view->sunk);
+    uint64_t key = (uint64_t)artilleryReady | (uint64_t)torpedoReady << 1 | (uint64_t)search->layoutCount << 2;
+
+    for (int k = 0; k < search->shipCount; k++)
+        key = mixEndgameKey(key, (uint64_t)search->shipSize[k]);
+    key = mixEndgameKey(mixEndgameKey(key, unresolved.words[0]), unresolved.words[1]);
+    // Layouts come out of the enumeration in a fixed order, so the same set always folds the same way
+    for (int i = 0; i < search->layoutCount; i++)
+        for (int k = 0; k < search->shipCount; k++)
+            key = mixEndgameKey(mixEndgameKey(key, search->layouts[i].ship[k].words[0]), search->layouts[i].ship[k].words[1]);
+    return key;
+}
+
+// Function to choose an exact endgame move among the layouts findEndgameLayouts
+// listed. Returns 1 with the exact move, or 2 with the likeliest cell when the
+// node budget ran out before the search finished (0 if out of memory).
+int solveEndgame(const Observation *view, EndgameSearch *search, int artilleryReady, int torpedoReady, EndgameChoice *choice)
+{
+    TRACE_SCOPE(TRACE_ENDGAME);
+
+    if (endgameTable == NULL)
+    {
+        endgameTable = (EndgameEntry *)calloc(ENDGAME_TABLE_SIZE, sizeof(EndgameEntry));
+        if (endgameTable == NULL)
+            return 0;
+    }
+
+    unsigned char set[MAX_ENDGAME_LAYOUTS];
+    for (int i = 0; i < search->layoutCount; i++)
+        set[i] = (unsigned char)i;
+
+    BitBoard fired = bitboardOr(view->hit, view->miss);
+    if (++endgameGeneration == 0) // Wrapped: entries of an old solve could match again
+    {
+        memset(endgameTable, 0, ENDGAME_TABLE_SIZE * sizeof(EndgameEntry));
+        endgameGeneration = 1;
+    }
+    search->nodes = 0;
+    search->timedOut = 0;
+
+    // Plain shots first; the table answers at once if this state was solved before
+    int bestCell;
+    double best = endgameSolve(search, set, search->layoutCount, view->hit, fired, view->hash, &bestCell);
+    if (search->timedOut)
+    {
+        // Out of time: fall back to the cell that hits the most layouts
+        int hitCount[GRID_SIZE * GRID_SIZE] = {0};
+        best = 1e9;
+        bestCell = -1;
+        for (int i = 0; i < search->layoutCount; i++)
+        {
+            BitBoard walk = bitboardAndNot(search->layouts[i].cells, fired);
+            int cell;
+            while ((cell = bitboardPopFirst(&walk)) >= 0)
+            {
+                if (++hitCount[cell] > (bestCell < 0 ? 0 : hitCount[bestCell]))
+                    bestCell = cell;
+            }
+        }
+    }
+    choice->weapon = WEAPON_FIRE;
+    choice->row = bestCell / GRID_SIZE;
+    choice->col = bestCell % GRID_SIZE;
+    choice->expectedShots = best;
+
+    // Special weapons expire after this turn, so they are only weighed here at the root
+    BitBoard possible = {{0, 0}};
+    for (int i = 0; i < search->layoutCount; i++)
+        possible = bitboardOr(possible, search->layouts[i].cells);
+    possible = bitboardAndNot(possible, fired);
+
+    for (int t = 0; t < (torpedoReady ? 2 * GRID_SIZE : 0) && !search->timedOut; t++)
+    {
+        BitBoard target = {{0, 0}};
+        for (int i = 0; i < GRID_SIZE; i++)
+            bitboardSet(&target, t < GRID_SIZE ? CELL_INDEX(t, i) : CELL_INDEX(i, t - GRID_SIZE));
+        if (bitboardIsEmpty(bitboardAnd(target, possible)))
+            continue;
+
+        double value = endgameEvaluate(search, set, search->layoutCount, view->hit, fired, view->hash, target, choice->expectedShots);
+        if (!search->timedOut && value < choice->expectedShots)
+        {
+            choice->weapon = WEAPON_TORPEDO;
+            choice->axis = t < GRID_SIZE ? 'R' : 'C';
+            choice->row = t < GRID_SIZE ? t : 0;
+            choice->col = t < GRID_SIZE ? 0 : t - GRID_SIZE;
+            choice->expectedShots = value;
+        }
+    }
+
+    for (int t = 0; t < (artilleryReady ? (GRID_SIZE - 1) * (GRID_SIZE - 1) : 0) && !search->timedOut; t++)
+    {
+        int row = t / (GRID_SIZE - 1), col = t % (GRID_SIZE - 1);
+        BitBoard target = {{0, 0}};
+        bitboardSet(&target, CELL_INDEX(row, col));
+        bitboardSet(&target, CELL_INDEX(row, col + 1));
+        bitboardSet(&target, CELL_INDEX(row + 1, col));
+        bitboardSet(&target, CELL_INDEX(row + 1, col + 1));
+        if (bitboardIsEmpty(bitboardAnd(target, possible)))
+            continue;
+
+        double value = endgameEvaluate(search, set, search->layoutCount, view->hit, fired, view->hash, target, choice->expectedShots);
+        if (!search->timedOut && value < choice->expectedShots)
+        {
+            choice->weapon = WEAPON_ARTILLERY;
+            choice->row = row;
+            choice->col = col;
+            choice->expectedShots = value;
+        }
+    }
+
+    return search->timedOut ? 2 : 1;
+}
+
+// Decision cache: the endgame decisions of bots, shared by every game and
+// thread of the process. The key is endgameKey, so one entry answers for every
+// game that comes down to the same ending, whatever shots led there. Only
+// endgames are looked up, after their layouts are listed. Entries live in sets of
+// DECISION_CACHE_WAYS. Readers take no lock: an entry stores key ^ data next to
+// data, so a half written entry fails the key check and reads as a miss. Writers
+// lock the stripe of their set and evict with a CLOCK hand that passes over
+// (and clears) entries read since it last came round.
+#define DECISION_CACHE_WAYS 8
+#define DECISION_CACHE_STRIPES 64
+#define DECISION_VALID (1ULL << 63) // Set in the data of every filled entry
+
+int decisionCacheMegabytes = 8; // 0 turns the cache off
+
+typedef struct
+{
+    uint64_t check; // key ^ data
+    uint64_t data;  // DECISION_VALID, expected shots (float bits 32-62 of a positive float), axis, col, row, weapon
+} DecisionEntry;
+
+typedef struct
+{
+    DecisionEntry entries[DECISION_CACHE_WAYS];
+    uint8_t referenced[DECISION_CACHE_WAYS]; // Set on every hit, cleared as the hand passes
+    uint8_t hand;
+} DecisionSet;
+
+typedef struct
+{
+    DecisionSet *sets;
+    uint64_t setCount; // Power of two, 0 while the cache is off
+    uint64_t lookups, hits;     // Totals of the threads' own counts, added as each thread finishes
+    uint64_t inserts, evictions; // Updated with relaxed atomic adds under a stripe lock
+#ifndef _WIN32
+    pthread_mutex_t stripes[DECISION_CACHE_STRIPES];
+#endif
+} DecisionCache;
+
+DecisionCache decisionCache;
+static THREAD_LOCAL uint64_t decisionLookups = 0, decisionHits = 0; // This thread's lookups, kept off the shared cache line
+
+// Function to allocate the decision cache, megabytes rounded down to a power of two of sets
+void initializeDecisionCache(int megabytes)
+{
+    uint64_t bytes = (uint64_t)megabytes * 1024 * 1024;
+
+    if (megabytes <= 0)
+        return;
+    decisionCache.setCount = 1;
+    while (decisionCache.setCount * 2 * sizeof(DecisionSet) <= bytes)
+        decisionCache.setCount *= 2;
+    decisionCache.sets = (DecisionSet *)calloc(decisionCache.setCount, sizeof(DecisionSet));
+    if (decisionCache.sets == NULL)
+    {
+        decisionCache.setCount = 0; // Run without it
+        return;
+    }
+#ifndef _WIN32
+    for (int i = 0; i < DECISION_CACHE_STRIPES; i++)
+        pthread_mutex_init(&decisionCache.stripes[i], NULL);
+#endif
+}
+
+// Function to find a cached decision, returns 0 on a miss
+int findDecision(uint64_t key, uint64_t *data)
+{
+    DecisionSet *set = &decisionCache.sets[key & (decisionCache.setCount - 1)];
+
+    decisionLookups++;
+    for (int way = 0; way < DECISION_CACHE_WAYS; way++)
+    {
+        uint64_t check = __atomic_load_n(&set->entries[way].check, __ATOMIC_RELAXED);
+        uint64_t value = __atomic_load_n(&set->entries[way].data, __ATOMIC_RELAXED);
+        if ((value & DECISION_VALID) && (check ^ value) == key)
+        {
+            if (!__atomic_load_n(&set->referenced[way], __ATOMIC_RELAXED))
+                __atomic_store_n(&set->referenced[way], 1, __ATOMIC_RELAXED);
+            decisionHits++;
+            *data = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to add a decision to the cache, evicting the first entry the CLOCK hand finds unread
+void storeDecision(uint64_t key, uint64_t data)
+{
+    uint64_t index = key & (decisionCache.setCount - 1);
+    DecisionSet *set = &decisionCache.sets[index];
+
+    data |= DECISION_VALID;
+#ifndef _WIN32
+    pthread_mutex_lock(&decisionCache.stripes[index % DECISION_CACHE_STRIPES]);
+#endif
+    int way = -1, present = 0;
+    for (int w = 0; w < DECISION_CACHE_WAYS && !present; w++)
+    {
+        DecisionEntry *entry = &set->entries[w];
+        present = (entry->data & DECISION_VALID) && (entry->check ^ entry->data) == key; // Another thread stored it meanwhile
+        if (way < 0 && !(entry->data & DECISION_VALID))
+            way = w;
+    }
+    if (present)
+        way = DECISION_CACHE_WAYS;
+    else if (way < 0)
+    {
+        while (__atomic_load_n(&set->referenced[set->hand], __ATOMIC_RELAXED))
+        {
+            __atomic_store_n(&set->referenced[set->hand], 0, __ATOMIC_RELAXED);
+            set->hand = (uint8_t)((set->hand + 1) % DECISION_CACHE_WAYS);
+        }
+        way = set->hand;
+        set->hand = (uint8_t)((set->hand + 1) % DECISION_CACHE_WAYS);
+        __atomic_add_fetch(&decisionCache.evictions, 1, __ATOMIC_RELAXED);
+    }
+    if (way < DECISION_CACHE_WAYS)
+    {
+        __atomic_store_n(&set->entries[way].data, data, __ATOMIC_RELAXED);
+        __atomic_store_n(&set->entries[way].check, key ^ data, __ATOMIC_RELAXED);
+        __atomic_store_n(&set->referenced[way], 0, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&decisionCache.inserts, 1, __ATOMIC_RELAXED);
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&decisionCache.stripes[index % DECISION_CACHE_STRIPES]);
+#endif
+}
+
+// Function to add this thread's lookup counts to the cache totals, called when a thread stops playing bots
+void flushDecisionCounters()
+{
+    __atomic_add_fetch(&decisionCache.lookups, decisionLookups, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&decisionCache.hits, decisionHits, __ATOMIC_RELAXED);
+    decisionLookups = 0;
+    decisionHits = 0;
+}
+
+// Function to pack an endgame decision into cache data
+uint64_t packDecision(const EndgameChoice *choice)
+{
+    uint32_t shots;
+    float expected = (float)choice->expectedShots;
+    memcpy(&shots, &expected, sizeof(shots));
+    return (uint64_t)choice->weapon | (uint64_t)choice->row << 8 | (uint64_t)choice->col << 16 | (uint64_t)(uint8_t)choice->axis << 24 |
+           (uint64_t)(shots & 0x7FFFFFFF) << 32;
+}
+
+// Function to unpack cached data into an endgame decision
+void unpackDecision(uint64_t data, EndgameChoice *choice)
+{
+    uint32_t shots = (uint32_t)(data >> 32) & 0x7FFFFFFF;
+    float expected;
+
+    memcpy(&expected, &shots, sizeof(expected));
+    choice->weapon = (int)(data & 0xFF);
+    choice->row = (int)(data >> 8 & 0xFF);
+    choice->col = (int)(data >> 16 & 0xFF);
+    choice->axis = (char)(data >> 24 & 0xFF);
+    choice->expectedShots = expected;
+}
+
+// Function to print how the decision cache has done
+void printDecisionCacheStats()
+{
+    flushDecisionCounters();
+    uint64_t lookups = __atomic_load_n(&decisionCache.lookups, __ATOMIC_RELAXED);
+    uint64_t hits = __atomic_load_n(&decisionCache.hits, __ATOMIC_RELAXED);
+    uint64_t inserts = __atomic_load_n(&decisionCache.inserts, __ATOMIC_RELAXED);
+    uint64_t evictions = __atomic_load_n(&decisionCache.evictions, __ATOMIC_RELAXED);
+
+    if (decisionCache.setCount == 0)
+        return;
+    printf("\nDecision cache\n");
+    printf("Lookups %llu, hits %llu (%.2f%%), entries %llu of %llu, evictions %llu, memory %.1f MB\n", (unsigned long long)lookups,
+           (unsigned long long)hits, lookups ? 100.0 * (double)hits / (double)lookups : 0.0, (unsigned long long)(inserts - evictions),
+           (unsigned long long)(decisionCache.setCount * DECISION_CACHE_WAYS), (unsigned long long)evictions,
+           (double)(decisionCache.setCount * sizeof(DecisionSet)) / (1024.0 * 1024.0));
+}
+
+// Function to play the exact endgame move once only a few layouts of the
+// remaining ships are possible, returns 0 (and plays nothing) otherwise
+int botPlayEndgame(PlayerState *self, PlayerState *opponent, int trackingDifficulty, ShotReport *report)
+{
+    static THREAD_LOCAL EndgameSearch search;
+    int artilleryReady = isLegalMove(self, MAKE_MOVE(MOVE_ARTILLERY, 0));
+    int torpedoReady = isLegalMove(self, MAKE_MOVE(MOVE_TORPEDO_ROW, 0));
+    uint64_t key = 0, cached;
+    EndgameChoice endgame;
+    int solved = 0;
+
+    if (!findEndgameLayouts(&self->view, &search))
+        return 0; // Not an endgame, leave the cache to positions that are
+
+    // An ending solved before, in any game or thread, is answered from the decision cache.
+    // Only complete solves are stored; a move picked when the node budget ran out is not.
+    if (decisionCache.setCount > 0)
+        key = endgameKey(&search, &self->view, artilleryReady, torpedoReady);
+    if (decisionCache.setCount > 0 && findDecision(key, &cached))
+    {
+        unpackDecision(cached, &endgame);
+        solved = 1;
+    }
+    else
+    {
+        solved = solveEndgame(&self->view, &search, artilleryReady, torpedoReady, &endgame);
+        if (solved == 1 && decisionCache.setCount > 0)
+            storeDecision(key, packDecision(&endgame));
+    }
+    if (!solved)
+        return 0;
+
+    if (endgame.weapon == WEAPON_ARTILLERY)
+    {
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_WEAPON, 0, WEAPON_ARTILLERY);
+        playMove(self, opponent, MAKE_MOVE(MOVE_ARTILLERY, CELL_INDEX(endgame.row, endgame.col)), trackingDifficulty, report);
+    }
+    else if (endgame.weapon == WEAPON_TORPEDO)
+    {
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_WEAPON, 0, WEAPON_TORPEDO);
+        playMove(self, opponent, endgame.axis == 'R' ? MAKE_MOVE(MOVE_TORPEDO_ROW, endgame.row) : MAKE_MOVE(MOVE_TORPEDO_COLUMN, endgame.col),
+                 trackingDifficulty, report);
+    }
+    else
+    {
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_FIRE, 0, endgame.row, endgame.col);
+        playMove(self, opponent, MAKE_MOVE(MOVE_FIRE, CELL_INDEX(endgame.row, endgame.col)), trackingDifficulty, report);
+    }
+    return 1;
+}
+
+// Opening book: hit chances of the cells in early positions, computed offline
+// with --build-book and memory mapped with --book. The file is a header naming
+// the fleet it was built for, then entries sorted by observation hash. While a
+// hunting bot's position is in the book it fires at one of the cells the book
+// rates best, otherwise it hunts at random as before.
+#define OPENING_BOOK_MAGIC 0x4B425342u // "BSBK"
+#define OPENING_BOOK_MARGIN 16         // Cells within this many steps of the best rating are equally good
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t entries;
+    uint8_t depth; // Positions with more cells fired at than this are not in the book
+    uint8_t fleetCount;
+    uint8_t fleetSizes[MAX_SHIPS];
+    uint8_t reserved[2];
+} OpeningBookHeader;
+
+typedef struct
+{
+    uint64_t hash; // Observation hash of the position
+    uint8_t rating[GRID_SIZE * GRID_SIZE]; // Hit chance of each cell, 255 for the likeliest
+    uint8_t reserved[4];
+} OpeningBookEntry;
+
+const OpeningBookEntry *openingBook = NULL;
+uint32_t openingBookEntries = 0;
+int buildingOpeningBook = 0; // Set while --build-book rates positions as the bot reaches them
+
+int bookBuilderRatings(const Observation *view, uint8_t rating[GRID_SIZE * GRID_SIZE]);
+
+// Function to map an opening book file built for the current fleet. Returns 0 if it cannot be used.
+int loadOpeningBook(const char *path)
+{
+#ifdef _WIN32
+    (void)path;
+    printf("Opening books are not supported on Windows.\n");
+    return 0;
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    const OpeningBookHeader *header;
+
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(OpeningBookHeader))
+    {
+        printf("Could not open opening book %s.\n", path);
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+
+    void *mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        printf("Could not map opening book %s.\n", path);
+        return 0;
+    }
+    header = (const OpeningBookHeader *)mapped;
+
+    int matches = header->magic == OPENING_BOOK_MAGIC && header->fleetCount == fleet.count &&
+                  (size_t)info.st_size == sizeof(OpeningBookHeader) + (size_t)header->entries * sizeof(OpeningBookEntry);
+    for (int i = 0; matches && i < fleet.count; i++)
+        matches = header->fleetSizes[i] == fleet.sizes[i];
+    if (!matches)
+    {
+        printf("Opening book %s is damaged or was built for another fleet.\n", path);
+        munmap(mapped, (size_t)info.st_size);
+        return 0;
+    }
+
+    madvise(mapped, (size_t)info.st_size, MADV_RANDOM); // Lookups jump around the file
+    openingBook = (const OpeningBookEntry *)(header + 1);
+    openingBookEntries = header->entries;
+    return 1;
+#endif
+}
+
+// Function to find a position's cell ratings in the opening book, NULL if it is not there
+const uint8_t *findOpeningBookEntry(uint64_t hash)
+{
+    uint32_t low = 0, high = openingBookEntries;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (openingBook[middle].hash < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low < openingBookEntries && openingBook[low].hash == hash ? openingBook[low].rating : NULL;
+}
+
+// Function to pick the cell the opening book suggests for a hunting bot, -1 if the position is not in the book
+int openingBookCell(const Observation *view)
+{
+    const uint8_t *rating = NULL;
+    uint8_t built[GRID_SIZE * GRID_SIZE];
+    unsigned char best[GRID_SIZE * GRID_SIZE];
+    int count = 0, top = 0;
+
+    if (buildingOpeningBook)
+        rating = bookBuilderRatings(view, built) ? built : NULL;
+    else if (openingBook != NULL)
+        rating = findOpeningBookEntry(view->hash);
+    if (rating == NULL)
+        return -1;
+
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        if (rating[cell] > top && observationIsUnknown(view, cell / GRID_SIZE, cell % GRID_SIZE))
+            top = rating[cell];
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        if (top > 0 && rating[cell] + OPENING_BOOK_MARGIN >= top && observationIsUnknown(view, cell / GRID_SIZE, cell % GRID_SIZE))
+            best[count++] = (unsigned char)cell;
+    return count > 0 ? best[gameRand() % count] : -1;
+}
+
+void botTurn(PlayerState *self, PlayerState *opponent, int trackingDifficulty, ShotReport *report)
+{
+    TRACE_SCOPE(TRACE_BOT_TURN);
+    BotState *state = &self->bot;
+    Observation *view = &self->view;
+    int row, col;
+    int hitFlag = 0;
+    ShotReport unused;
+
+    if (report == NULL)
+        report = &unused;
+    report->hits = 0;
+
+    int artilleryReady = isLegalMove(self, MAKE_MOVE(MOVE_ARTILLERY, 0));
+    int torpedoReady = isLegalMove(self, MAKE_MOVE(MOVE_TORPEDO_ROW, 0));
+
+    // Play exactly once only a few layouts of the remaining ships are possible
+    if (botPlayEndgame(self, opponent, trackingDifficulty, report))
+        return;
+
+    // Hide the fleet when the opponent's next radar sweep is likely to find it.
+    // The planner draws from its own random stream, so deciding against smoke
+    // leaves the rest of the turn as it would have been.
+    if (self->smokeScreenUses > 0 && opponent->radarUses > 0 && fleetOpenToSweep(self, opponent))
+    {
+        uint64_t saved = rngState;
+        double share;
+
+        seedGameRand(self->view.hash ^ opponent->view.hash);
+        int cell = planSmoke(self, opponent, &share);
+        rngState = saved;
+        if (cell >= 0 && share >= SMOKE_MIN_SHARE)
+        {
+            playMove(self, opponent, MAKE_MOVE(MOVE_SMOKE, cell), trackingDifficulty, report);
+            return;
+        }
+    }
+
+    // Check if Artillery is available
+    if (artilleryReady)
+    {
+        // Bot decides to use Artillery
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_WEAPON, 0, WEAPON_ARTILLERY);
+        // Random coordinates for artillery (ensure they are within bounds)
+        row = gameRand() % (GRID_SIZE - 1);
+        col = gameRand() % (GRID_SIZE - 1);
+        playMove(self, opponent, MAKE_MOVE(MOVE_ARTILLERY, CELL_INDEX(row, col)), trackingDifficulty, report);
+        return; // Artillery used, end turn
+    }
+
+    // Check if Torpedo is available
+    if (torpedoReady)
+    {
+        // Bot decides to use Torpedo
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_WEAPON, 0, WEAPON_TORPEDO);
+        // Randomly choose between row or column
+        if (gameRand() % 2 == 0)
+            playMove(self, opponent, MAKE_MOVE(MOVE_TORPEDO_ROW, gameRand() % GRID_SIZE), trackingDifficulty, report);
+        else
+            playMove(self, opponent, MAKE_MOVE(MOVE_TORPEDO_COLUMN, gameRand() % GRID_SIZE), trackingDifficulty, report);
+        return; // Torpedo used, end turn
+    }
+
+    // Existing bot logic...
+
+    if (state->torpedoTurns > 0)
+    {
+        // Follow-up torpedoes after a hit are the bot's own strategy and are
+        // not gated by the player rules, so they bypass the legal move check
+        report->weapon = WEAPON_TORPEDO;
+        report->cells = GRID_SIZE;
+        self->movesPlayed[MOVE_TORPEDO_ROW]++;
+
+        if (state->torpedoState == 0)
+        {
+            // Perform torpedo on column
+            LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_TORPEDO, 0, 'C', state->torpedoCol);
+            hitFlag = torpedoAttack(opponent->grid, 'C', state->torpedoCol, trackingDifficulty, view);
+            report->hits = hitFlag;
+
+            if (hitFlag)
+            {
+                LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_TORPEDO_HIT, 0, 'C', state->torpedoCol);
+                // Reset torpedo state
+                state->torpedoState = 0;
+                state->torpedoTurns = 0;
+                state->torpedoRow = -1;
+                state->torpedoCol = -1;
+            }
+            else
+            {
+                // Proceed to next torpedo attack
+                state->torpedoState = 1;
+                state->torpedoTurns--;
+            }
+        }
+        else if (state->torpedoState == 1)
+        {
+            // Perform torpedo on row
+            LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_TORPEDO, 0, 'R', state->torpedoRow);
+            hitFlag = torpedoAttack(opponent->grid, 'R', state->torpedoRow, trackingDifficulty, view);
+            report->hits = hitFlag;
+
+            if (hitFlag)
+            {
+                LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_TORPEDO_HIT, 0, 'R', state->torpedoRow);
+                // Reset torpedo state
+                state->torpedoState = 0;
+                state->torpedoTurns = 0;
+                state->torpedoRow = -1;
+                state->torpedoCol = -1;
+            }
+            else
+            {
+                // Torpedo attacks completed
+                state->torpedoState = 0;
+                state->torpedoTurns--;
+            }
+        }
+    }
+    else
+    {
+        if (state->lastHitRow != -1 && state->lastHitCol != -1)
+        {
+            // After a hit, target adjacent cells that have not been fired at
+            int directions[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}}; // Up, Down, Left, Right
+            int foundTarget = 0;
+
+            for (int i = 0; i < 4; i++)
+            {
+                int newRow = state->lastHitRow + directions[i][0];
+                int newCol = state->lastHitCol + directions[i][1];
+                if (newRow >= 0 && newRow < GRID_SIZE && newCol >= 0 && newCol < GRID_SIZE && observationIsUnknown(view, newRow, newCol))
+                {
+                    row = newRow;
+                    col = newCol;
+                    foundTarget = 1;
+                    break;
+                }
+            }
+
+            if (!foundTarget)
+            {
+                // No adjacent targets left, fire randomly
+                state->lastHitRow = -1;
+                state->lastHitCol = -1;
+            }
+        }
+
+        if (state->lastHitRow == -1 || state->lastHitCol == -1)
+        {
+            // Sweep instead of firing while some window's answer is hard to guess
+            double gain;
+            int window = self->radarUses > 0 ? planRadar(view, &gain) : -1;
+            if (window >= 0 && gain >= RADAR_MIN_GAIN)
+            {
+                playMove(self, opponent, MAKE_MOVE(MOVE_RADAR, window), trackingDifficulty, report);
+                return;
+            }
+
+            // Random targeting, only cells not fired at yet: inside windows the
+            // radar found ships in first, then from the opening book, then on
+            // one checkerboard colour, preferably outside windows it found empty
+            BitBoard contact = bitboardAndNot(view->radarContact, bitboardOr(view->hit, view->miss));
+            int cell = sampleBoardCell(contact);
+            if (cell < 0)
+                cell = openingBookCell(view);
+            if (cell < 0)
+                cell = sampleHuntCell(view);
+            for (int tries = 0; tries < 8 && cell >= 0 && bitboardTest(&view->radarClear, cell); tries++)
+                cell = sampleHuntCell(view);
+            if (cell < 0)
+            {
+                report->weapon = WEAPON_FIRE;
+                report->cells = 0;
+                return;
+            }
+            row = cell / GRID_SIZE;
+            col = cell % GRID_SIZE;
+        }
+
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_FIRE, 0, row, col);
+        playMove(self, opponent, MAKE_MOVE(MOVE_FIRE, CELL_INDEX(row, col)), trackingDifficulty, report);
+        hitFlag = report->hits;
+
+        if (hitFlag)
+        {
+            botRecordHit(state, row, col);
+        }
+        // On a miss keep the last hit, the next turn tries another neighbour
+    }
+}
+
+#define SAMPLE_LAYOUT_TRIES 256
+
+// Function to draw one layout of the given fleet ships that covers every cell
+// of mustCover and keeps off blocked. The ships are shuffled into order and
+// the kernel index of each one's placement goes to placements, the cells they
+// take to occupied. Returns 0 if no layout turned up in SAMPLE_LAYOUT_TRIES draws.
+int sampleShipLayout(const int *ships, int count, BitBoard blocked, BitBoard mustCover, int order[MAX_SHIPS], int placements[MAX_SHIPS], BitBoard *occupied)
+{
+    for (int attempt = 0; attempt < SAMPLE_LAYOUT_TRIES; attempt++)
+    {
+        BitBoard used = {{0, 0}};
+        int placed;
+
+        memcpy(order, ships, sizeof(int) * (size_t)count);
+        for (int k = count - 1; k > 0; k--)
+        {
+            int swap = gameRand() % (k + 1), ship = order[k];
+            order[k] = order[swap];
+            order[swap] = ship;
+        }
+
+        for (placed = 0; placed < count; placed++)
+        {
+            const PlacementKernel *kernel = &placementKernels[fleet.sizes[order[placed]]];
+            BitBoard taken = bitboardOr(blocked, used);
+            BitBoard open = bitboardAndNot(mustCover, used);
+            int choice = -1;
+
+            // Usually put the ship over an unexplained hit, picked uniformly among the placements through it
+            if (!bitboardIsEmpty(open) && gameRand() % 4 != 0)
+            {
+                int cell = bitboardPopFirst(&open), seen = 0;
+                for (int c = kernel->coverStart[cell]; c < kernel->coverStart[cell + 1]; c++)
+                {
+                    int p = kernel->coverList[c];
+                    if (bitboardIsEmpty(bitboardAnd(kernel->masks[p], taken)) && gameRand() % ++seen == 0)
+                        choice = p;
+                }
+            }
+            for (int tries = 0; tries < 32 && choice < 0; tries++)
+            {
+                int p = gameRand() % kernel->count;
+                if (bitboardIsEmpty(bitboardAnd(kernel->masks[p], taken)))
+                    choice = p;
+            }
+            if (choice < 0)
+                break;
+            placements[placed] = choice;
+            used = bitboardOr(used, kernel->masks[choice]);
+        }
+        if (placed == count && bitboardIsEmpty(bitboardAndNot(mustCover, used)))
+        {
+            *occupied = used;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Radar and smoke planner. Layouts of the opponent's remaining ships are drawn
+// the way the analyzer draws them, and for each layout the radar windows (named
+// by their top left cell) that would report a ship are found for every window
+// at once with two shifts of its bitboard. Bit-sliced counters add those boards
+// up, so each layout costs a handful of word operations for all windows. The
+// best sweep is the window whose answer is hardest to predict, the one that
+// carries the most bits of information. The best smoke screen is the one that
+// would hide the fleet from the most sweeps the opponent is likely to make.
+
+// Function to get the information, in bits, of a yes or no answer that is yes with chance p
+double answerEntropy(double p)
+{
+    if (p <= 0.0 || p >= 1.0)
+        return 0.0;
+    return -p * log2(p) - (1.0 - p) * log2(1.0 - p);
+}
+
+// Function to build the cells a radar sweep or smoke screen at row, col covers
+BitBoard radarWindowCells(int row, int col)
+{
+    BitBoard cells = {{0, 0}};
+
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+            bitboardSet(&cells, CELL_INDEX(i, j));
+    return cells;
+}
+
+// Function to find every radar window that would report a ship on the cells of
+// ships. lastColumn masks the cells the right shift would pull from the next row.
+BitBoard radarWindowContacts(BitBoard ships, BitBoard lastColumn)
+{
+    BitBoard pairs = bitboardOr(ships, bitboardAndNot(bitboardShiftDown(ships, 1), lastColumn));
+    return bitboardOr(pairs, bitboardShiftDown(pairs, GRID_SIZE));
+}
+
+// Function to estimate the chance that a sweep of each window reports ships,
+// over layouts of the remaining ships that agree with view. Cells already hit
+// no longer count, as radarSweep looks for unharmed ship cells only. Returns
+// the number of layouts drawn, 0 if none agree with view.
+int radarContactChances(const Observation *view, double chance[GRID_SIZE * GRID_SIZE])
+{
+    int remaining[MAX_SHIPS], count = 0, order[MAX_SHIPS], placements[MAX_SHIPS];
+    int drawn = 0;
+    BitBoard mustCover = bitboardAndNot(view->hit, view->sunk);
+    BitBoard plain = bitboardOr(view->miss, view->sunk);
+    BitBoard blocked = bitboardOr(plain, bitboardAndNot(view->radarClear, view->hit));
+    BitBoard occupied, lastColumn = {{0, 0}};
+    BitBoard counter[PLAN_COUNTER_BITS];
+
+    memset(counter, 0, sizeof(counter));
+    for (int i = 0; i < GRID_SIZE; i++)
+        bitboardSet(&lastColumn, CELL_INDEX(i, GRID_SIZE - 1));
+    for (int i = 0; i < fleet.count; i++)
+        if (!(view->sunkShips & (1 << i)))
+            remaining[count++] = i;
+
+    for (int s = 0; s < PLAN_SAMPLES; s++)
+    {
+        if (!sampleShipLayout(remaining, count, blocked, mustCover, order, placements, &occupied))
+        {
+            // Smoke may have hidden ships from a sweep; without even that, give up
+            if (drawn > 0 || bitboardEqual(blocked, plain))
+                break;
+            blocked = plain;
+            s--;
+            continue;
+        }
+
+        // Ripple carry the layout's contacts into the counters, every window in parallel
+        BitBoard carry = radarWindowContacts(bitboardAndNot(occupied, view->hit), lastColumn);
+        for (int b = 0; b < PLAN_COUNTER_BITS && !bitboardIsEmpty(carry); b++)
+        {
+            BitBoard next = bitboardAnd(counter[b], carry);
+            counter[b] = bitboardXor(counter[b], carry);
+            carry = next;
+        }
+        drawn++;
+    }
+
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        int contacts = 0;
+        for (int b = 0; b < PLAN_COUNTER_BITS; b++)
+            contacts |= bitboardTest(&counter[b], cell) << b;
+        chance[cell] = drawn == 0 ? 0.0 : (double)contacts / drawn;
+    }
+    return drawn;
+}
+
+// Function to choose the radar window that tells the most about the remaining
+// ships. Its information goes to gain. Returns -1 if no sweep tells anything.
+int planRadar(const Observation *view, double *gain)
+{
+    double chance[GRID_SIZE * GRID_SIZE];
+    int best = -1;
+
+    *gain = 0.0;
+    if (!radarContactChances(view, chance))
+        return -1;
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        double bits = answerEntropy(chance[cell]);
+        if (bits > *gain)
+        {
+            *gain = bits;
+            best = cell;
+        }
+    }
+    return best;
+}
+
+// Function to check, before planning a smoke screen, that the opponent is
+// hunting (it has no hit on self's fleet left to follow up, so it may sweep)
+// and that some cell of self's fleet is neither hit nor under smoke
+int fleetOpenToSweep(const PlayerState *self, const PlayerState *opponent)
+{
+    if (!bitboardIsEmpty(bitboardAndNot(opponent->view.hit, opponent->view.sunk)))
+        return 0;
+    for (int i = 0; i < GRID_SIZE; i++)
+        for (int j = 0; j < GRID_SIZE; j++)
+            if (self->grid[i][j] == 'S' && self->smokeDurationGrid[i][j] == 0)
+                return 1;
+    return 0;
+}
+
+// Function to choose where a smoke screen best hides self's fleet from the
+// opponent's next sweep. The opponent is taken to sweep by the same plan from
+// what it knows of self's board, favouring each window by
+// exp(SMOKE_SHARPNESS * (its gain - the best gain)). share gets the
+// part of that weight on sweeps the smoke turns from a contact into a clear.
+// Returns -1 if no likely sweep can be foiled.
+int planSmoke(const PlayerState *self, const PlayerState *opponent, double *share)
+{
+    double chance[GRID_SIZE * GRID_SIZE], weight[GRID_SIZE * GRID_SIZE], foiled[GRID_SIZE * GRID_SIZE] = {0};
+    double bestGain = 0.0, total = 0.0;
+    BitBoard ships = {{0, 0}};
+    int best = -1;
+
+    *share = 0.0;
+    if (!radarContactChances(&opponent->view, chance))
+        return -1;
+    for (int i = 0; i < GRID_SIZE; i++)
+        for (int j = 0; j < GRID_SIZE; j++)
+            if (self->grid[i][j] == 'S')
+                bitboardSet(&ships, CELL_INDEX(i, j));
+
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        weight[cell] = answerEntropy(chance[cell]);
+        if (weight[cell] > bestGain)
+            bestGain = weight[cell];
+    }
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        if (weight[cell] <= 0.0)
+            continue;
+        weight[cell] = exp(SMOKE_SHARPNESS * (weight[cell] - bestGain));
+        total += weight[cell];
+
+        // A sweep is foiled by a screen over every ship cell it would see
+        int row = cell / GRID_SIZE, col = cell % GRID_SIZE;
+        BitBoard seen = bitboardAnd(ships, radarWindowCells(row, col));
+        if (bitboardIsEmpty(seen))
+            continue;
+        for (int i = row - 1; i <= row + 1; i++)
+            for (int j = col - 1; j <= col + 1; j++)
+                if (i >= 0 && j >= 0 && i < GRID_SIZE && j < GRID_SIZE &&
+                    bitboardIsEmpty(bitboardAndNot(seen, radarWindowCells(i, j))))
+                    foiled[CELL_INDEX(i, j)] += weight[cell];
+    }
+
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        if (foiled[cell] > 0.0 && (best < 0 || foiled[cell] > foiled[best]))
+            best = cell;
+    if (best >= 0)
+        *share = foiled[best] / total;
+    return best;
+}
+
+// Function to print the planner's radar and smoke advice for a human player.
+// It draws from its own random stream, so asking does not change the game.
+void printMoveHint(const PlayerState *self, const PlayerState *opponent)
+{
+    uint64_t saved = rngState;
+    double gain, share;
+
+    seedGameRand(self->view.hash);
+    int window = planRadar(&self->view, &gain);
+    if (self->radarUses == 0)
+        printf("No radar sweeps left.\n");
+    else if (window < 0)
+        printf("No radar sweep would tell you anything new.\n");
+    else
+        printf("Best radar sweep: RADAR %c%d, worth %.2f bits of information.\n", 'A' + window % GRID_SIZE, window / GRID_SIZE + 1, gain);
+
+    int cover = planSmoke(self, opponent, &share);
+    if (self->smokeScreenUses == 0)
+        printf("No smoke screens left.\n");
+    else if (opponent->radarUses == 0)
+        printf("Your opponent has no radar sweeps left to hide from.\n");
+    else if (cover < 0)
+        printf("No smoke screen would hide your ships from a likely sweep.\n");
+    else
+        printf("Best smoke screen: SMOKE %c%d, foils %.0f%% of the sweeps your opponent is likely to try.\n",
+               'A' + cover % GRID_SIZE, cover / GRID_SIZE + 1, share * 100.0);
+    rngState = saved;
+}
+
+// Monte Carlo tree search bot. Every iteration draws one layout of the
+// opponent's remaining ships that agrees with the bot's observation, plays the
+// bot's own moves forward on it (fire, radar, smoke, artillery, torpedoes and
+// the follow-up torpedo the classic bot gets after a hit) and scores how soon
+// the fleet goes down. The tree is over move sequences (open loop), so one tree
+// serves every sampled layout. Threads grow independent trees until the time
+// budget runs out and their root visits are summed (root parallel search).
+#define BOT_CLASSIC 0
+#define BOT_MCTS 1
+#define NUM_BOTS 2
+
+#define MOVE_FOLLOW_UP 6 // Bot only: torpedo through the last hit, target 0 = its column, 1 = its row
+
+#define MCTS_MAX_NODES 65536 // Tree nodes per search thread
+#define MCTS_MAX_TURNS 120   // Playouts stop here, no game needs as many turns
+#define MCTS_MAX_CANDIDATES (MAX_LEGAL_MOVES + 2)
+#define MCTS_EXPLORATION 1.0
+
+const char *botNames[NUM_BOTS] = {"classic", "mcts"};
+int opponentBot = BOT_CLASSIC; // Bot of Player vs Bot games, and of Bot 2 in simulations
+int mctsBudgetMs = 20;         // Thinking time per move
+int mctsThreads = 1;
+
+typedef struct
+{
+    Move move;
+    int firstChild, nextSibling; // -1 when there is none
+    int cursor;                  // Next candidate to try when the node widens
+    double prior;                // Share of the candidates' prior weight
+    uint32_t visits;
+    double reward; // Sum of playout rewards
+} MctsNode;
+
+// Search inputs shared by every thread, read only while they run
+typedef struct
+{
+    const PlayerState *self;
+    int trackingDifficulty;
+    int remaining[MAX_SHIPS]; // Fleet indices of the ships not sunk yet
+    int remainingCount;
+    BitBoard mustCover; // Hits no sunk ship explains
+    BitBoard blocked;   // Cells no remaining ship can be on
+    double density[GRID_SIZE * GRID_SIZE]; // Weighted placements over each unknown cell
+    Move candidates[MCTS_MAX_CANDIDATES];  // Most promising first
+    double priors[MCTS_MAX_CANDIDATES];    // Normalised to sum to 1
+    int candidateCount;
+    double deadline;
+} MctsShared;
+
+typedef struct
+{
+    const MctsShared *shared;
+    uint64_t seed; // 0 keeps the calling thread's random stream
+    MctsNode *nodes;
+    int nodeCount;
+} MctsWorker;
+
+// Function to check if a 2x2 area starting at row, col holds a cell not fired at
+int windowHasUnknown(const Observation *view, int row, int col)
+{
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+            if (observationIsUnknown(view, i, j))
+                return 1;
+    return 0;
+}
+
+// Function to sum the density of the unknown cells of a 2x2 area
+double mctsWindowScore(const MctsShared *shared, const Observation *view, int row, int col)
+{
+    double score = 0.0;
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+            if (observationIsUnknown(view, i, j))
+                score += shared->density[CELL_INDEX(i, j)];
+    return score;
+}
+
+// Function to sum the density of the unknown cells of a row ('R') or column ('C')
+double mctsLineScore(const MctsShared *shared, const Observation *view, char axis, int line)
+{
+    double score = 0.0;
+    for (int k = 0; k < GRID_SIZE; k++)
+    {
+        int row = axis == 'R' ? line : k, col = axis == 'R' ? k : line;
+        if (observationIsUnknown(view, row, col))
+            score += shared->density[CELL_INDEX(row, col)] + 1e-3; // Unknown cells count even with no density
+    }
+    return score;
+}
+
+// Function to check if a move can still tell the bot anything (or, for smoke, protect anything)
+int mctsUseful(const MctsShared *shared, const PlayerState *me, Move move)
+{
+    int target = MOVE_TARGET(move);
+    int row = target / GRID_SIZE, col = target % GRID_SIZE;
+
+    switch (MOVE_TYPE(move))
+    {
+    case MOVE_FOLLOW_UP:
+        if (me->bot.torpedoTurns <= 0 || me->bot.torpedoState != target)
+            return 0;
+        return mctsLineScore(shared, &me->view, target ? 'R' : 'C', target ? me->bot.torpedoRow : me->bot.torpedoCol) > 0.0;
+    case MOVE_FIRE:
+        return observationIsUnknown(&me->view, row, col);
+    case MOVE_RADAR:
+        if (me->radarUses <= 0 || !windowHasUnknown(&me->view, row, col))
+            return 0;
+        for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+            for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+                if (!bitboardTest(&me->view.radarContact, CELL_INDEX(i, j)) && !bitboardTest(&me->view.radarClear, CELL_INDEX(i, j)))
+                    return 1;
+        return 0;
+    case MOVE_SMOKE:
+        if (me->smokeScreenUses <= 0)
+            return 0;
+        for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+            for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+                if (me->grid[i][j] == 'S' && me->smokeDurationGrid[i][j] == 0)
+                    return 1;
+        return 0;
+    case MOVE_ARTILLERY:
+        return me->artilleryLifetime > 0 && windowHasUnknown(&me->view, row, col);
+    case MOVE_TORPEDO_ROW:
+    case MOVE_TORPEDO_COLUMN:
+        return isLegalMove(me, move) && mctsLineScore(shared, &me->view, MOVE_TYPE(move) == MOVE_TORPEDO_ROW ? 'R' : 'C', target) > 0.0;
+    }
+    return 0;
+}
+
+// Function to play a move of the MCTS bot, including its follow-up torpedo, with the usual messages
+void mctsPlayMove(PlayerState *self, PlayerState *opponent, Move move, int trackingDifficulty, ShotReport *report)
+{
+    BotState *state = &self->bot;
+    int target = MOVE_TARGET(move);
+
+    if (MOVE_TYPE(move) == MOVE_FOLLOW_UP)
+    {
+        char axis = target ? 'R' : 'C';
+        int line = target ? state->torpedoRow : state->torpedoCol;
+
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_TORPEDO, 0, axis, line);
+        report->weapon = WEAPON_TORPEDO;
+        report->cells = GRID_SIZE;
+        self->movesPlayed[MOVE_TORPEDO_ROW]++;
+        report->hits = torpedoAttack(opponent->grid, axis, line, trackingDifficulty, &self->view);
+        if (report->hits)
+        {
+            LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_TORPEDO_HIT, 0, axis, line);
+            state->torpedoState = 0;
+            state->torpedoTurns = 0;
+            state->torpedoRow = -1;
+            state->torpedoCol = -1;
+        }
+        else
+        {
+            state->torpedoState = 1 - state->torpedoState;
+            state->torpedoTurns--;
+        }
+        return;
+    }
+
+    // Any other move passes up the pending follow-up torpedo
+    if (state->torpedoTurns > 0)
+    {
+        state->torpedoState = 1 - state->torpedoState;
+        state->torpedoTurns--;
+    }
+
+    if (MOVE_TYPE(move) == MOVE_FIRE)
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_FIRE, 0, target / GRID_SIZE, target % GRID_SIZE);
+    else if (MOVE_TYPE(move) == MOVE_ARTILLERY)
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_WEAPON, 0, WEAPON_ARTILLERY);
+    else if (MOVE_TYPE(move) == MOVE_TORPEDO_ROW || MOVE_TYPE(move) == MOVE_TORPEDO_COLUMN)
+        LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_WEAPON, 0, WEAPON_TORPEDO);
+    playMove(self, opponent, move, trackingDifficulty, report);
+    if (MOVE_TYPE(move) == MOVE_FIRE && report->hits)
+        botRecordHit(state, target / GRID_SIZE, target % GRID_SIZE);
+}
+
+// Function to draw a layout of the remaining ships that agrees with the bot's
+// observation and set opponent up with it. Returns 0 if no layout turned up.
+int mctsSampleLayout(const MctsShared *shared, PlayerState *opponent)
+{
+    const Observation *view = &shared->self->view;
+    int order[MAX_SHIPS], placements[MAX_SHIPS];
+    BitBoard occupied;
+
+    if (!sampleShipLayout(shared->remaining, shared->remainingCount, shared->blocked, shared->mustCover, order, placements, &occupied))
+        return 0;
+
+    // Cells already fired at keep their marks, sunk ships are already reported
+    memset(opponent, 0, sizeof(*opponent));
+    initializeGrid(opponent->grid);
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        if (bitboardTest(&view->hit, cell))
+            opponent->grid[cell / GRID_SIZE][cell % GRID_SIZE] = '*';
+        else if (bitboardTest(&view->miss, cell))
+            opponent->grid[cell / GRID_SIZE][cell % GRID_SIZE] = 'o';
+    }
+    for (int i = 0; i < fleet.count; i++)
+        opponent->ships[i].shipSize = fleet.sizes[i];
+    for (int k = 0; k < shared->remainingCount; k++)
+    {
+        Ship *ship = &opponent->ships[order[k]];
+        BitBoard cells = placementKernels[ship->shipSize].masks[placements[k]];
+        ship->sunk = 1;
+        for (int i = 0, cell = bitboardPopFirst(&cells); cell >= 0; i++, cell = bitboardPopFirst(&cells))
+        {
+            ship->coords[i][0] = cell / GRID_SIZE;
+            ship->coords[i][1] = cell % GRID_SIZE;
+            if (opponent->grid[cell / GRID_SIZE][cell % GRID_SIZE] == '~')
+                opponent->grid[cell / GRID_SIZE][cell % GRID_SIZE] = 'S';
+        }
+    }
+    return 1;
+}
+
+// Function to choose a playout move: follow-up torpedo, then the densest
+// special weapon, then finish off hits and radar contacts, else hunt
+Move mctsPlayoutMove(const MctsShared *shared, const PlayerState *me)
+{
+    const Observation *view = &me->view;
+    int best = -1;
+    double bestScore = -1.0;
+
+    if (mctsUseful(shared, me, MAKE_MOVE(MOVE_FOLLOW_UP, me->bot.torpedoState)))
+        return MAKE_MOVE(MOVE_FOLLOW_UP, me->bot.torpedoState);
+
+    if (me->artilleryLifetime > 0)
+    {
+        for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        {
+            int row = cell / GRID_SIZE, col = cell % GRID_SIZE;
+            double score = row < GRID_SIZE - 1 && col < GRID_SIZE - 1 ? mctsWindowScore(shared, view, row, col) : -1.0;
+            if (score > bestScore)
+            {
+                best = cell;
+                bestScore = score;
+            }
+        }
+        if (bestScore > 0.0)
+            return MAKE_MOVE(MOVE_ARTILLERY, best);
+    }
+
+    if (isLegalMove(me, MAKE_MOVE(MOVE_TORPEDO_ROW, 0)))
+    {
+        for (int line = 0; line < 2 * GRID_SIZE; line++)
+        {
+            double score = mctsLineScore(shared, view, line < GRID_SIZE ? 'R' : 'C', line % GRID_SIZE);
+            if (score > bestScore)
+            {
+                best = line;
+                bestScore = score;
+            }
+        }
+        if (bestScore > 0.0)
+            return MAKE_MOVE(best < GRID_SIZE ? MOVE_TORPEDO_ROW : MOVE_TORPEDO_COLUMN, best % GRID_SIZE);
+    }
+
+    // Next to an unexplained hit, preferring cells that extend a line of hits
+    int directions[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    BitBoard open = bitboardAndNot(view->hit, view->sunk);
+    for (int cell = bitboardPopFirst(&open); cell >= 0; cell = bitboardPopFirst(&open))
+    {
+        for (int d = 0; d < 4; d++)
+        {
+            int row = cell / GRID_SIZE + directions[d][0], col = cell % GRID_SIZE + directions[d][1];
+            int backRow = cell / GRID_SIZE - directions[d][0], backCol = cell % GRID_SIZE - directions[d][1];
+            if (row < 0 || row >= GRID_SIZE || col < 0 || col >= GRID_SIZE || !observationIsUnknown(view, row, col))
+                continue;
+            double score = shared->density[CELL_INDEX(row, col)] + 1e-3;
+            if (backRow >= 0 && backRow < GRID_SIZE && backCol >= 0 && backCol < GRID_SIZE && bitboardTest(&view->hit, CELL_INDEX(backRow, backCol)))
+                score *= 4.0;
+            if (score > bestScore)
+            {
+                best = CELL_INDEX(row, col);
+                bestScore = score;
+            }
+        }
+    }
+    if (best >= 0)
+        return MAKE_MOVE(MOVE_FIRE, best);
+
+    // Inside a radar window that reported ships
+    BitBoard contacts = bitboardAndNot(bitboardAndNot(view->radarContact, view->hit), view->miss);
+    for (int cell = bitboardPopFirst(&contacts); cell >= 0; cell = bitboardPopFirst(&contacts))
+    {
+        if (shared->density[cell] + 1e-3 > bestScore)
+        {
+            best = cell;
+            bestScore = shared->density[cell] + 1e-3;
+        }
+    }
+    if (best >= 0)
+        return MAKE_MOVE(MOVE_FIRE, best);
+
+    // Hunt: sometimes sweep the densest unexplored area, otherwise the densest of a few random cells
+    if (me->radarUses > 0 && gameRand() % 4 == 0)
+    {
+        for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        {
+            int row = cell / GRID_SIZE, col = cell % GRID_SIZE;
+            if (row == GRID_SIZE - 1 || col == GRID_SIZE - 1 || !mctsUseful(shared, me, MAKE_MOVE(MOVE_RADAR, cell)))
+                continue;
+            double score = mctsWindowScore(shared, view, row, col);
+            if (score > bestScore)
+            {
+                best = cell;
+                bestScore = score;
+            }
+        }
+        if (best >= 0)
+            return MAKE_MOVE(MOVE_RADAR, best);
+    }
+    for (int k = 0; k < 4; k++)
+    {
+        int cell = sampleFreeCell(view);
+        if (cell >= 0 && shared->density[cell] > bestScore)
+        {
+            best = cell;
+            bestScore = shared->density[cell];
+        }
+    }
+    return MAKE_MOVE(MOVE_FIRE, best < 0 ? 0 : best);
+}
+
+// Function to play one turn of a search, the turn before it has been started already
+void mctsSearchTurn(const MctsShared *shared, PlayerState *me, PlayerState *opponent, Move move)
+{
+    ShotReport report;
+    mctsPlayMove(me, opponent, move, shared->trackingDifficulty, &report);
+    resolveTurn(me, opponent, NULL);
+}
+
+// Function to pick the child of node to follow, adding a new child while the
+// node's visits allow it (progressive widening). Children useless in this
+// sample are passed over. Returns -1 when no move is worth playing.
+int mctsSelectChild(MctsWorker *worker, int node, const PlayerState *me, int *expanded)
+{
+    const MctsShared *shared = worker->shared;
+    MctsNode *parent = &worker->nodes[node];
+    int children = 0;
+
+    *expanded = 0;
+    for (int child = parent->firstChild; child >= 0; child = worker->nodes[child].nextSibling)
+        children++;
+
+    // Widen to 2 + sqrt(visits) children
+    if ((double)children < 2.0 + sqrt((double)parent->visits) && worker->nodeCount < MCTS_MAX_NODES)
+    {
+        while (parent->cursor < shared->candidateCount)
+        {
+            int candidate = parent->cursor++;
+            Move move = shared->candidates[candidate];
+            if (!mctsUseful(shared, me, move))
+                continue;
+
+            MctsNode *child = &worker->nodes[worker->nodeCount];
+            child->move = move;
+            child->prior = shared->priors[candidate];
+            child->firstChild = -1;
+            child->nextSibling = parent->firstChild;
+            child->cursor = 0;
+            child->visits = 0;
+            child->reward = 0.0;
+            parent->firstChild = worker->nodeCount++;
+            *expanded = 1;
+            return parent->firstChild;
+        }
+    }
+
+    // PUCT over the children that make sense here: playout results plus
+    // exploration led by the prior, which fades as a child gathers visits
+    int best = -1;
+    double bestValue = -1.0, rootVisits = sqrt((double)parent->visits);
+    for (int child = parent->firstChild; child >= 0; child = worker->nodes[child].nextSibling)
+    {
+        const MctsNode *candidate = &worker->nodes[child];
+        if (!mctsUseful(shared, me, candidate->move))
+            continue;
+        double mean = candidate->visits ? candidate->reward / candidate->visits : 0.0;
+        double value = mean + MCTS_EXPLORATION * candidate->prior * rootVisits / (1.0 + candidate->visits);
+        if (value > bestValue)
+        {
+            best = child;
+            bestValue = value;
+        }
+    }
+    return best;
+}
+
+// Function to run one iteration: sample a layout, walk down the tree, play out and back up the result
+void mctsIterate(MctsWorker *worker)
+{
+    const MctsShared *shared = worker->shared;
+    PlayerState me = *shared->self;
+    PlayerState opponent;
+    int path[MCTS_MAX_TURNS + 1];
+    int depth = 0, turns = 0, node = 0, expanded = 0;
+    int begun = 1; // The game has started the first turn already
+
+    if (!mctsSampleLayout(shared, &opponent))
+        return;
+
+    path[depth++] = 0;
+    while (!expanded && me.sunkTotal < fleet.count && turns < MCTS_MAX_TURNS)
+    {
+        if (!begun)
+            beginTurn(&me);
+        begun = 1;
+        int child = mctsSelectChild(worker, node, &me, &expanded);
+        if (child < 0)
+            break;
+        mctsSearchTurn(shared, &me, &opponent, worker->nodes[child].move);
+        turns++;
+        begun = 0;
+        path[depth++] = child;
+        node = child;
+    }
+
+    while (me.sunkTotal < fleet.count && turns < MCTS_MAX_TURNS)
+    {
+        if (!begun)
+            beginTurn(&me);
+        mctsSearchTurn(shared, &me, &opponent, mctsPlayoutMove(shared, &me));
+        turns++;
+        begun = 0;
+    }
+
+    // Fewer turns to sink the fleet is better
+    double reward = 1.0 - (double)turns / MCTS_MAX_TURNS;
+    for (int i = 0; i < depth; i++)
+    {
+        worker->nodes[path[i]].visits++;
+        worker->nodes[path[i]].reward += reward;
+    }
+}
+
+// Thread entry point: grow one tree until the deadline
+void *mctsWorkerRun(void *arg)
+{
+    MctsWorker *worker = (MctsWorker *)arg;
+
+    if (worker->seed != 0)
+        seedGameRand(worker->seed);
+    WorkerQuiet saved = enterWorkerQuiet(); // Put back for the search's own thread
+
+    worker->nodes[0].move = 0;
+    worker->nodes[0].firstChild = -1;
+    worker->nodes[0].nextSibling = -1;
+    worker->nodes[0].cursor = 0;
+    worker->nodes[0].prior = 1.0;
+    worker->nodes[0].visits = 0;
+    worker->nodes[0].reward = 0.0;
+    worker->nodeCount = 1;
+    do
+    {
+        for (int i = 0; i < 16; i++)
+            mctsIterate(worker);
+    } while (monotonicSeconds() < worker->shared->deadline);
+    leaveWorkerQuiet(saved);
+    return NULL;
+}
+
+// Function to weigh a candidate before any playout by the density of the
+// unknown cells it shoots at. A sweep only reveals, so it weighs less, and
+// smoke weighs almost nothing. Weights are normalised over the candidates.
+double mctsPrior(const MctsShared *shared, Move move)
+{
+    const Observation *view = &shared->self->view;
+    const BotState *state = &shared->self->bot;
+    int target = MOVE_TARGET(move);
+
+    switch (MOVE_TYPE(move))
+    {
+    case MOVE_FOLLOW_UP:
+        return mctsLineScore(shared, view, target ? 'R' : 'C', target ? state->torpedoRow : state->torpedoCol);
+    case MOVE_ARTILLERY:
+        return mctsWindowScore(shared, view, target / GRID_SIZE, target % GRID_SIZE);
+    case MOVE_TORPEDO_ROW:
+    case MOVE_TORPEDO_COLUMN:
+        return mctsLineScore(shared, view, MOVE_TYPE(move) == MOVE_TORPEDO_ROW ? 'R' : 'C', target);
+    case MOVE_FIRE:
+        return shared->density[target] + 1e-3;
+    case MOVE_RADAR:
+        return 0.25 * mctsWindowScore(shared, view, target / GRID_SIZE, target % GRID_SIZE) + 1e-3;
+    }
+    return 1e-3;
+}
+
+// Function to set up a search: remaining ships, sampling constraints, the
+// density of every cell and the candidate moves in prior order
+void mctsPrepare(MctsShared *shared, const PlayerState *self, int trackingDifficulty)
+{
+    const Observation *view = &self->view;
+    Move moves[MAX_LEGAL_MOVES];
+    double *priors = shared->priors;
+    double total = 0.0;
+
+    memset(shared, 0, sizeof(*shared));
+    shared->self = self;
+    shared->trackingDifficulty = trackingDifficulty;
+    for (int i = 0; i < fleet.count; i++)
+        if (!(view->sunkShips & (1 << i)))
+            shared->remaining[shared->remainingCount++] = i;
+    shared->mustCover = bitboardAndNot(view->hit, view->sunk);
+
+    // Radar windows that reported nothing hold no ships, unless the opponent's
+    // smoke hid them; drop that rule when no layout agrees with it
+    shared->blocked = bitboardOr(bitboardOr(view->miss, view->sunk), bitboardAndNot(view->radarClear, view->hit));
+    PlayerState scratch;
+    if (!mctsSampleLayout(shared, &scratch))
+        shared->blocked = bitboardOr(view->miss, view->sunk);
+
+    // Placements through unexplained hits weigh more, those in radar contacts a little more
+    for (int k = 0; k < shared->remainingCount; k++)
+    {
+        const PlacementKernel *kernel = &placementKernels[fleet.sizes[shared->remaining[k]]];
+        for (int p = 0; p < kernel->count; p++)
+        {
+            BitBoard cells = kernel->masks[p];
+            if (!bitboardIsEmpty(bitboardAnd(cells, shared->blocked)))
+                continue;
+            double weight = 1.0 + 8.0 * bitboardCount(bitboardAnd(cells, shared->mustCover));
+            if (!bitboardIsEmpty(bitboardAnd(cells, view->radarContact)))
+                weight *= 2.0;
+            for (int cell = bitboardPopFirst(&cells); cell >= 0; cell = bitboardPopFirst(&cells))
+                if (observationIsUnknown(view, cell / GRID_SIZE, cell % GRID_SIZE))
+                    shared->density[cell] += weight;
+        }
+    }
+
+    // Areas are only tried from inside the grid, a clipped area covers less than the one beside it
+    int count = generateLegalMoves(self, 1, moves);
+    for (int target = 0; target < 2; target++)
+        if (mctsUseful(shared, self, MAKE_MOVE(MOVE_FOLLOW_UP, target)))
+            shared->candidates[shared->candidateCount++] = MAKE_MOVE(MOVE_FOLLOW_UP, target);
+    for (int i = 0; i < count; i++)
+    {
+        int type = MOVE_TYPE(moves[i]), target = MOVE_TARGET(moves[i]);
+        if ((type == MOVE_RADAR || type == MOVE_SMOKE || type == MOVE_ARTILLERY) &&
+            (target / GRID_SIZE == GRID_SIZE - 1 || target % GRID_SIZE == GRID_SIZE - 1))
+            continue;
+        if (mctsUseful(shared, self, moves[i]))
+            shared->candidates[shared->candidateCount++] = moves[i];
+    }
+    for (int i = 0; i < shared->candidateCount; i++)
+        priors[i] = mctsPrior(shared, shared->candidates[i]);
+
+    // Insertion sort, best prior first
+    for (int i = 1; i < shared->candidateCount; i++)
+    {
+        Move move = shared->candidates[i];
+        double prior = priors[i];
+        int j = i - 1;
+        for (; j >= 0 && priors[j] < prior; j--)
+        {
+            shared->candidates[j + 1] = shared->candidates[j];
+            priors[j + 1] = priors[j];
+        }
+        shared->candidates[j + 1] = move;
+        priors[j + 1] = prior;
+    }
+    for (int i = 0; i < shared->candidateCount; i++)
+        total += priors[i];
+    for (int i = 0; i < shared->candidateCount; i++)
+        priors[i] /= total;
+}
+
+// Function to search for the MCTS bot's move, returns -1 if it found none
+// (no layout agrees with what the bot saw), the caller then plays the classic bot
+int mctsSearch(const PlayerState *self, int trackingDifficulty)
+{
+    MctsShared shared;
+    int threadCount = mctsThreads < 1 ? 1 : mctsThreads;
+    uint64_t visits[1 << 10] = {0}; // Indexed by move
+    double rewards[1 << 10] = {0};
+    int best = -1;
+
+    mctsPrepare(&shared, self, trackingDifficulty);
+    if (shared.candidateCount == 0)
+        return -1;
+#ifdef _WIN32
+    threadCount = 1; // No worker threads on Windows
+#endif
+
+    MctsWorker *workers = (MctsWorker *)calloc((size_t)threadCount, sizeof(MctsWorker));
+    if (workers == NULL)
+        return -1;
+    int workerCount = threadCount;
+    for (int t = 0; t < workerCount; t++)
+    {
+        workers[t].shared = &shared;
+        workers[t].seed = t == 0 ? 0 : ((uint64_t)gameRand() << 31) ^ (uint64_t)gameRand() ^ (uint64_t)t;
+        workers[t].nodes = (MctsNode *)malloc(sizeof(MctsNode) * MCTS_MAX_NODES);
+        if (workers[t].nodes == NULL)
+        {
+            threadCount = t; // Search with the threads that got their memory
+            break;
+        }
+    }
+    shared.deadline = monotonicSeconds() + mctsBudgetMs / 1000.0;
+
+    if (threadCount > 0)
+    {
+        // This thread searches too
+#ifndef _WIN32
+        // Every tree searches until the same deadline, so trees whose thread
+        // cannot be started are left out rather than searched afterwards
+        pthread_t threads[threadCount];
+        int started = 1;
+        while (started < threadCount && pthread_create(&threads[started], NULL, mctsWorkerRun, &workers[started]) == 0)
+            started++;
+        threadCount = started;
+#endif
+        mctsWorkerRun(&workers[0]);
+#ifndef _WIN32
+        for (int t = 1; t < threadCount; t++)
+            pthread_join(threads[t], NULL);
+#endif
+    }
+
+    // The most visited root move over all trees
+    for (int t = 0; t < threadCount; t++)
+    {
+        for (int child = workers[t].nodes[0].firstChild; child >= 0; child = workers[t].nodes[child].nextSibling)
+        {
+            Move move = workers[t].nodes[child].move;
+            visits[move] += workers[t].nodes[child].visits;
+            rewards[move] += workers[t].nodes[child].reward;
+        }
+    }
+    for (int move = 0; move < (1 << 10); move++)
+    {
+        if (visits[move] > 0 && (best < 0 || visits[move] > visits[best] ||
+                                 (visits[move] == visits[best] && rewards[move] > rewards[best])))
+            best = move;
+    }
+
+    for (int t = 0; t < workerCount; t++)
+        free(workers[t].nodes);
+    free(workers);
+    return best;
+}
+
+// Function to play the MCTS bot's turn
+void mctsBotTurn(PlayerState *self, PlayerState *opponent, int trackingDifficulty, ShotReport *report)
+{
+    TRACE_SCOPE(TRACE_MCTS);
+    ShotReport unused;
+
+    if (report == NULL)
+        report = &unused;
+    report->hits = 0;
+
+    // The exact solver beats sampling once only a few layouts are left
+    if (botPlayEndgame(self, opponent, trackingDifficulty, report))
+        return;
+
+    int move = mctsSearch(self, trackingDifficulty);
+    if (move < 0)
+    {
+        botTurn(self, opponent, trackingDifficulty, report);
+        return;
+    }
+    mctsPlayMove(self, opponent, (Move)move, trackingDifficulty, report);
+}
+
+// Function to play a turn of the chosen bot
+void playBotTurn(int bot, PlayerState *self, PlayerState *opponent, int trackingDifficulty, ShotReport *report)
+{
+    if (bot == BOT_MCTS)
+        mctsBotTurn(self, opponent, trackingDifficulty, report);
+    else
+        botTurn(self, opponent, trackingDifficulty, report);
+}
+
+// Fleet placement optimizer: simulated annealing over non-touching layouts
+// (the rules autoPlaceShips keeps) for the one a targeting model needs the
+// most shots to sink. The model is the classic bot, played against each layout
+// on the same seeds so layouts are compared on equal luck, or a heat map of
+// where logged games shot first. Threads run independent chains until the time
+// budget runs out and the best layout of any chain wins.
+#define PLACEMENT_RANDOM 0
+#define PLACEMENT_OPTIMIZED 1
+
+#define PLACEMENT_EVAL_GAMES 8 // Classic bot games per layout
+#define PLACEMENT_MOVE_TRIES 64
+
+int botPlacement = PLACEMENT_RANDOM;
+int placementBudgetMs = 300;
+int placementThreads = 1;
+
+// Heat map model: mean index of the shot that first hit each cell in logged
+// games (cells never fired at count as fired after the last shot)
+double heatRank[GRID_SIZE * GRID_SIZE];
+int heatLoaded = 0;
+
+// One annealing chain
+typedef struct
+{
+    const int *fixed;   // Kernel placements of the ships before firstFree, not moved
+    int firstFree;
+    uint64_t evalSeed;  // Same for every chain, so their scores compare
+    double deadline;
+    int best[MAX_SHIPS];
+    double bestScore;
+} PlacementWorker;
+
+// Function to add the cells around every cell of mask (and the cells themselves)
+BitBoard placementHalo(BitBoard mask)
+{
+    BitBoard halo = mask;
+
+    for (int cell = bitboardPopFirst(&mask); cell >= 0; cell = bitboardPopFirst(&mask))
+    {
+        for (int i = cell / GRID_SIZE - 1; i <= cell / GRID_SIZE + 1; i++)
+            for (int j = cell % GRID_SIZE - 1; j <= cell % GRID_SIZE + 1; j++)
+                if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE)
+                    bitboardSet(&halo, CELL_INDEX(i, j));
+    }
+    return halo;
+}
+
+// Function to find the kernel placement of a placed ship, returns -1 if it has none
+int shipPlacementIndex(const Ship *ship)
+{
+    const PlacementKernel *kernel = &placementKernels[ship->shipSize];
+    BitBoard mask = {{0, 0}};
+
+    for (int i = 0; i < ship->shipSize; i++)
+        bitboardSet(&mask, CELL_INDEX(ship->coords[i][0], ship->coords[i][1]));
+    for (int p = 0; p < kernel->count; p++)
+        if (bitboardEqual(kernel->masks[p], mask))
+            return p;
+    return -1;
+}
+
+// Function to get the top left cell and orientation of a kernel placement
+void placementPosition(int shipSize, int placement, int *row, int *col, char *orientation)
+{
+    BitBoard cells = placementKernels[shipSize].masks[placement];
+    int first = bitboardPopFirst(&cells), second = bitboardPopFirst(&cells);
+
+    *row = first / GRID_SIZE;
+    *col = first % GRID_SIZE;
+    *orientation = second < 0 || second == first + 1 ? 'H' : 'V';
+}
+
+// Function to put ship shipIndex on the grid at a kernel placement
+void applyShipPlacement(char grid[GRID_SIZE][GRID_SIZE], Ship *ship, int shipIndex, int placement)
+{
+    BitBoard cells = placementKernels[fleet.sizes[shipIndex]].masks[placement];
+
+    ship->shipSize = fleet.sizes[shipIndex];
+    strcpy(ship->name, fleet.names[shipIndex]);
+    ship->sunk = 1; // Not sunk
+    for (int i = 0, cell = bitboardPopFirst(&cells); cell >= 0; i++, cell = bitboardPopFirst(&cells))
+    {
+        grid[cell / GRID_SIZE][cell % GRID_SIZE] = 'S';
+        ship->coords[i][0] = cell / GRID_SIZE;
+        ship->coords[i][1] = cell % GRID_SIZE;
+    }
+}
+
+// Function to score a whole fleet layout: shots the targeting model needs to sink it
+double scoreFleetLayout(const int placements[MAX_SHIPS], uint64_t evalSeed)
+{
+    if (heatLoaded)
+    {
+        // Mean shot at which a heat map shooter first finds each ship
+        double sum = 0.0;
+        for (int i = 0; i < fleet.count; i++)
+        {
+            BitBoard cells = placementKernels[fleet.sizes[i]].masks[placements[i]];
+            double found = 1e9;
+            for (int cell = bitboardPopFirst(&cells); cell >= 0; cell = bitboardPopFirst(&cells))
+                if (heatRank[cell] < found)
+                    found = heatRank[cell];
+            sum += found;
+        }
+        return sum / fleet.count;
+    }
+
+    PlayerState attacker, defender;
+    int turns = 0;
+
+    for (int game = 0; game < PLACEMENT_EVAL_GAMES; game++)
+    {
+        int gameTurns = 0;
+        seedGameRand(evalSeed + (uint64_t)game);
+        initializePlayer(&attacker, "Bot");
+        initializePlayer(&defender, "Layout");
+        for (int i = 0; i < fleet.count; i++)
+            applyShipPlacement(defender.grid, &defender.ships[i], i, placements[i]);
+        while (attacker.sunkTotal < fleet.count && gameTurns < MCTS_MAX_TURNS)
+        {
+            beginTurn(&attacker);
+            botTurn(&attacker, &defender, 1, NULL);
+            resolveTurn(&attacker, &defender, NULL);
+            gameTurns++;
+        }
+        turns += gameTurns;
+    }
+    return (double)turns / PLACEMENT_EVAL_GAMES;
+}
+
+// Function to move ship k of a layout to a random placement that keeps clear
+// of every other ship, returns 0 if none turned up
+int movePlacedShip(int placements[MAX_SHIPS], int k)
+{
+    const PlacementKernel *kernel = &placementKernels[fleet.sizes[k]];
+    BitBoard others = {{0, 0}};
+
+    for (int i = 0; i < fleet.count; i++)
+        if (i != k && placements[i] >= 0)
+            others = bitboardOr(others, placementHalo(placementKernels[fleet.sizes[i]].masks[placements[i]]));
+    for (int tries = 0; tries < PLACEMENT_MOVE_TRIES; tries++)
+    {
+        int p = gameRand() % kernel->count;
+        if (bitboardIsEmpty(bitboardAnd(kernel->masks[p], others)))
+        {
+            placements[k] = p;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Thread entry point: anneal one chain from a random layout until the deadline
+void *placementWorkerRun(void *arg)
+{
+    PlacementWorker *worker = (PlacementWorker *)arg;
+    int current[MAX_SHIPS];
+    double currentScore;
+    double start = monotonicSeconds();
+    WorkerQuiet saved = enterWorkerQuiet(); // Put back for the optimizer's own thread
+
+    // Random start: free ships one by one, from scratch if one does not fit
+    worker->bestScore = -1.0; // No layout fits around the fixed ships
+    for (int placed = 0, restarts = 0; placed < fleet.count;)
+    {
+        if (placed < worker->firstFree)
+        {
+            current[placed] = worker->fixed[placed];
+            placed++;
+            continue;
+        }
+        for (int i = placed; i < fleet.count; i++)
+            current[i] = -1;
+        if (movePlacedShip(current, placed))
+            placed++;
+        else if (++restarts > PLACEMENT_MOVE_TRIES)
+        {
+            leaveWorkerQuiet(saved);
+            return NULL;
+        }
+        else
+            placed = worker->firstFree;
+    }
+    currentScore = scoreFleetLayout(current, worker->evalSeed);
+    memcpy(worker->best, current, sizeof(current));
+    worker->bestScore = currentScore;
+
+    while (worker->firstFree < fleet.count)
+    {
+        double now = monotonicSeconds();
+        if (now >= worker->deadline)
+            break;
+
+        // Temperature falls linearly from two shots to a tenth of one
+        double progress = (now - start) / (worker->deadline - start);
+        double temperature = 2.0 * (1.0 - progress) + 0.1 * progress;
+        int candidate[MAX_SHIPS];
+        memcpy(candidate, current, sizeof(current));
+        int k = worker->firstFree + gameRand() % (fleet.count - worker->firstFree);
+        if (!movePlacedShip(candidate, k))
+            continue;
+
+        double score = scoreFleetLayout(candidate, worker->evalSeed);
+        if (score >= currentScore || (double)gameRand() / 2147483648.0 < exp((score - currentScore) / temperature))
+        {
+            memcpy(current, candidate, sizeof(current));
+            currentScore = score;
+            if (score > worker->bestScore)
+            {
+                memcpy(worker->best, candidate, sizeof(candidate));
+                worker->bestScore = score;
+            }
+        }
+    }
+    leaveWorkerQuiet(saved);
+    return NULL;
+}
+
+// Function to find the layout of ships firstFree onwards, around the fixed
+// placements of the ships before them, that the targeting model takes longest
+// to sink. Writes every ship's kernel placement to placements and returns the layout's score.
+double optimizeFleetPlacement(const int *fixed, int firstFree, int placements[MAX_SHIPS])
+{
+    int threadCount = placementThreads < 1 ? 1 : placementThreads;
+    PlacementWorker workers[threadCount];
+    uint64_t evalSeed = ((uint64_t)gameRand() << 31) ^ (uint64_t)gameRand();
+    uint64_t rng = rngState; // The chains draw from this thread's stream, the game's goes on afterwards
+
+#ifdef _WIN32
+    threadCount = 1; // No worker threads on Windows
+#endif
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].fixed = fixed;
+        workers[t].firstFree = firstFree;
+        workers[t].evalSeed = evalSeed;
+        workers[t].deadline = monotonicSeconds() + placementBudgetMs / 1000.0;
+    }
+#ifndef _WIN32
+    // The chains anneal until the same deadline, so chains whose thread cannot be started are left out
+    pthread_t threads[threadCount];
+    int started = 1;
+    while (started < threadCount && pthread_create(&threads[started], NULL, placementWorkerRun, &workers[started]) == 0)
+        started++;
+    threadCount = started;
+#endif
+    seedGameRand(evalSeed ^ 0x5DEECE66DULL);
+    placementWorkerRun(&workers[0]);
+#ifndef _WIN32
+    for (int t = 1; t < threadCount; t++)
+        pthread_join(threads[t], NULL);
+#endif
+    rngState = rng;
+
+    int best = 0;
+    for (int t = 1; t < threadCount; t++)
+        if (workers[t].bestScore > workers[best].bestScore)
+            best = t;
+    memcpy(placements, workers[best].best, sizeof(int) * MAX_SHIPS);
+    return workers[best].bestScore;
+}
+
+// Function to place a bot's fleet in the chosen placement mode
+void placeBotFleet(char grid[GRID_SIZE][GRID_SIZE], Ship ships[MAX_SHIPS])
+{
+    int placements[MAX_SHIPS];
+
+    if (botPlacement != PLACEMENT_OPTIMIZED)
+    {
+        autoPlaceShips(grid, ships);
+        return;
+    }
+
+    TRACE_SCOPE(TRACE_AUTO_PLACE);
+    if (optimizeFleetPlacement(NULL, 0, placements) < 0.0)
+    {
+        autoPlaceShips(grid, ships); // Too crowded for the optimizer's chains to start
+        return;
+    }
+    for (int i = 0; i < fleet.count; i++)
+        applyShipPlacement(grid, &ships[i], i, placements[i]);
+    LOG_EVENT(LOG_LEVEL_ALL, LOG_BOT_PLACED, 0, 0);
+}
+
+// Function to print a placement for the ships from shipIndex on, around the ones already placed
+void suggestPlacement(Ship ships[MAX_SHIPS], int shipIndex)
+{
+    int fixed[MAX_SHIPS], placements[MAX_SHIPS];
+
+    for (int i = 0; i < shipIndex; i++)
+    {
+        fixed[i] = shipPlacementIndex(&ships[i]);
+    }
+
+    printf("Thinking about your fleet...\n");
+    double score = optimizeFleetPlacement(fixed, shipIndex, placements);
+    if (score < 0.0)
+    {
+        printf("The rest of your fleet cannot keep clear of the ships you have placed.\n");
+        return;
+    }
+    if (heatLoaded)
+        printf("Suggested placement (the heat map's shooter finds your ships at shot %.1f on average):\n", score + 1.0);
+    else
+        printf("Suggested placement (the bot needs about %.1f turns to sink it):\n", score);
+    for (int i = shipIndex; i < fleet.count; i++)
+    {
+        int row, col;
+        char orientation;
+        placementPosition(fleet.sizes[i], placements[i], &row, &col, &orientation);
+        printf("  PLACE %s %c%d %c\n", fleet.names[i], 'A' + col, row + 1, orientation);
+    }
+}
+
+// Function to learn the heat map model from an NDJSON log: the mean index of
+// the shot at each cell over every player's game. Returns 0 if the file cannot be read.
+int loadHeatMap(const char *path)
+{
+    typedef struct
+    {
+        uint32_t game;
+        int shots[2];
+        BitBoard fired[2];
+    } HeatGame;
+
+    FILE *file = fopen(path, "r");
+    HeatGame open[64]; // Games in progress, parallel runs interleave a few
+    int openCount = 0;
+    double rankSum[GRID_SIZE * GRID_SIZE] = {0};
+    uint64_t games = 0;
+    char line[512];
+
+    if (file == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned game;
+        int player, row, col, index;
+        char event[24];
+
+        if (sscanf(line, "{\"game\":%u,\"player\":%d,\"event\":\"%23[a-z_]\"", &game, &player, event) != 3 || player < 0 || player > 1)
+            continue;
+        for (index = 0; index < openCount && open[index].game != game; index++)
+            ;
+
+        if (strcmp(event, "game_start") == 0 && index == openCount && openCount < 64)
+        {
+            memset(&open[openCount], 0, sizeof(HeatGame));
+            open[openCount++].game = game;
+        }
+        else if (index == openCount)
+            continue;
+        else if (strcmp(event, "fire") == 0 && strstr(line, "\"row\"") != NULL &&
+                 sscanf(strstr(line, "\"row\""), "\"row\":%d,\"col\":%d", &row, &col) == 2 &&
+                 row >= 0 && row < GRID_SIZE && col >= 0 && col < GRID_SIZE)
+        {
+            HeatGame *heat = &open[index];
+            if (!bitboardTest(&heat->fired[player], CELL_INDEX(row, col)))
+            {
+                bitboardSet(&heat->fired[player], CELL_INDEX(row, col));
+                rankSum[CELL_INDEX(row, col)] += heat->shots[player];
+            }
+            heat->shots[player]++;
+        }
+        else if (strcmp(event, "game_over") == 0)
+        {
+            // Cells a player never fired at rank after their last shot
+            for (int p = 0; p < 2; p++)
+                for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+                    if (!bitboardTest(&open[index].fired[p], cell))
+                        rankSum[cell] += open[index].shots[p];
+            games += 2;
+            open[index] = open[--openCount];
+        }
+    }
+    fclose(file);
+
+    if (games == 0)
+        return 0;
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        heatRank[cell] = rankSum[cell] / (double)games;
+    heatLoaded = 1;
+    return 1;
+}
+
+// Match store: every finished game appended to a file of fixed size,
+// checksummed records, with each player's rating, record and newest match kept
+// in a table updated as matches are added. The table is saved next to the
+// records (FILE.idx) every STORE_INDEX_INTERVAL matches and on exit; on open it
+// is loaded and only the matches after it are replayed. A record that fails its
+// checksum, as a write cut short by a crash leaves, ends the file and is cut off.
+// Records link to each player's previous match, so a history is read newest first.
+#define STORE_MAGIC 0x4D535042u       // "BPSM"
+#define STORE_INDEX_MAGIC 0x58495342u // "BSIX"
+#define STORE_INDEX_INTERVAL 4096
+#define STORE_READ_RECORDS 4096 // Records read at a time while replaying
+#define STORE_INITIAL_RATING 1500.0
+#define STORE_RATING_K 32.0
+
+// One finished match as stored on disk
+typedef struct
+{
+    uint32_t magic;
+    uint32_t checksum; // FNV-1a of the rest of the record
+    uint64_t time;     // Seconds since the epoch
+    uint64_t previous[2]; // Number of each player's previous match plus one, 0 for none
+    char names[2][NAME_SIZE];
+    uint16_t moves[2][PLAYED_MOVE_TYPES]; // Actions each player took, by type
+    uint8_t winner;
+    uint8_t difficulty;
+    uint8_t reserved[2];
+} MatchRecord;
+
+// A player's standing, in the table and in the saved index
+typedef struct
+{
+    char name[NAME_SIZE]; // Empty while the slot is free
+    double rating;
+    uint64_t games, wins;
+    uint64_t lastMatch; // Number of the newest match plus one
+    uint64_t lastTime;
+} StoredPlayer;
+
+// Header of the saved index, followed by its players
+typedef struct
+{
+    uint32_t magic;
+    uint32_t checksum; // FNV-1a of the rest of the header and of every player
+    uint64_t records;  // Matches the saved ratings include
+    uint64_t players;
+} StoreIndexHeader;
+
+typedef struct
+{
+    int fd; // -1 while no store is open
+    char *indexPath;
+    uint64_t records;
+    StoredPlayer *slots;
+    int capacity; // Power of two
+    int count;
+    StoredPlayer **ranked; // Players in leaderboard order, sorted when records was rankedRecords
+    int rankedCount;
+    uint64_t rankedRecords;
+#ifndef _WIN32
+    pthread_mutex_t lock; // Simulation threads record matches concurrently
+#endif
+} MatchStore;
+
+MatchStore matchStore = {.fd = -1};
+
+// Function to continue an FNV-1a hash over size bytes
+uint32_t storeChecksum(uint32_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// Function to compute the checksum a record should carry
+uint32_t matchRecordChecksum(const MatchRecord *record)
+{
+    return storeChecksum(2166136261u, &record->time, sizeof(MatchRecord) - offsetof(MatchRecord, time));
+}
+
+// Function to give the name a player is stored under: unnamed players are "?"
+const char *storedPlayerName(const char *name)
+{
+    return name[0] ? name : "?";
+}
+
+// Function to find a player's standing without adding it, NULL if the player has no standing
+StoredPlayer *lookupStoredPlayer(const MatchStore *store, const char *name)
+{
+    const char *key = storedPlayerName(name);
+
+    if (store->capacity == 0)
+        return NULL;
+    uint32_t hash = storeChecksum(2166136261u, key, strlen(key));
+    for (int i = (int)(hash & (uint32_t)(store->capacity - 1));; i = (i + 1) & (store->capacity - 1))
+    {
+        StoredPlayer *slot = &store->slots[i];
+        if (slot->name[0] == '\0')
+            return NULL;
+        if (strcmp(slot->name, key) == 0)
+            return slot;
+    }
+}
+
+// Function to find a player's standing, adding a new player at the initial rating.
+// Returns NULL if memory runs out. Adding a player may move the others, finding one never does.
+StoredPlayer *findStoredPlayer(MatchStore *store, const char *name)
+{
+    const char *key = storedPlayerName(name);
+
+    if (store->capacity > 0)
+    {
+        uint32_t hash = storeChecksum(2166136261u, key, strlen(key));
+        for (int i = (int)(hash & (uint32_t)(store->capacity - 1));; i = (i + 1) & (store->capacity - 1))
+        {
+            StoredPlayer *slot = &store->slots[i];
+            if (strcmp(slot->name, key) == 0)
+                return slot;
+            if (slot->name[0] == '\0' && (store->count + 1) * 10 < store->capacity * 7)
+            {
+                strncpy(slot->name, key, NAME_SIZE - 1);
+                slot->rating = STORE_INITIAL_RATING;
+                store->count++;
+                return slot;
+            }
+            if (slot->name[0] == '\0')
+                break; // Full enough to grow first
+        }
+    }
+
+    // Grow to twice the size, put every player back and add this one
+    MatchStore grown = *store;
+    grown.capacity = store->capacity ? store->capacity * 2 : 256;
+    grown.count = 0;
+    grown.slots = grown.capacity > 0 ? (StoredPlayer *)calloc((size_t)grown.capacity, sizeof(StoredPlayer)) : NULL;
+    if (grown.slots == NULL)
+        return NULL;
+    for (int i = 0; i < store->capacity; i++)
+    {
+        if (store->slots[i].name[0] != '\0')
+            *findStoredPlayer(&grown, store->slots[i].name) = store->slots[i];
+    }
+    free(store->slots);
+    store->slots = grown.slots;
+    store->capacity = grown.capacity;
+    store->count = grown.count;
+    return findStoredPlayer(store, key);
+}
+
+// Function to fold match number index into the players' standings (Elo ratings)
+int applyMatchRecord(MatchStore *store, const MatchRecord *record, uint64_t index)
+{
+    StoredPlayer *players[2];
+
+    players[0] = findStoredPlayer(store, record->names[0]);
+    players[1] = findStoredPlayer(store, record->names[1]);
+    players[0] = findStoredPlayer(store, record->names[0]); // Adding player 1 may have moved player 0
+    if (players[0] == NULL || players[1] == NULL)
+        return 0;
+
+    // Expected score of player 0 is 1 / (1 + 10^(difference / 400))
+    double expected = 1.0 / (1.0 + pow(10.0, (players[1]->rating - players[0]->rating) / 400.0));
+    double change = STORE_RATING_K * ((record->winner == 0 ? 1.0 : 0.0) - expected);
+
+    players[0]->rating += change;
+    players[1]->rating -= change;
+    for (int p = 0; p < 2; p++)
+    {
+        players[p]->games++;
+        players[p]->wins += record->winner == p;
+        players[p]->lastMatch = index + 1;
+        players[p]->lastTime = record->time;
+    }
+    return 1;
+}
+
+// Function to save the standings to the index file: written beside it, flushed
+// to disk, then renamed over it so a crash leaves the old or the new one
+int writeStoreIndex(MatchStore *store)
+{
+#ifdef _WIN32
+    (void)store;
+    return 0;
+#else
+    char tempPath[4096];
+    StoreIndexHeader header = {STORE_INDEX_MAGIC, 0, store->records, 0};
+
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", store->indexPath);
+    FILE *file = fopen(tempPath, "wb");
+    if (file == NULL)
+        return 0;
+
+    // Records first, so the index never claims matches the disk might not have
+    fdatasync(store->fd);
+
+    header.players = 0;
+    for (int i = 0; i < store->capacity; i++)
+        header.players += store->slots[i].games > 0;
+    header.checksum = storeChecksum(2166136261u, &header.records, sizeof(header) - offsetof(StoreIndexHeader, records));
+    for (int i = 0; i < store->capacity; i++)
+        if (store->slots[i].games > 0) // Names looked up but never in a match are left out
+            header.checksum = storeChecksum(header.checksum, &store->slots[i], sizeof(StoredPlayer));
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; ok && i < store->capacity; i++)
+        if (store->slots[i].games > 0)
+            ok = fwrite(&store->slots[i], sizeof(StoredPlayer), 1, file) == 1;
+    ok = fflush(file) == 0 && ok && fsync(fileno(file)) == 0;
+    fclose(file);
+    if (!ok || rename(tempPath, store->indexPath) != 0)
+    {
+        unlink(tempPath);
+        return 0;
+    }
+    return 1;
+#endif
+}
+
+// Function to load the saved standings. Returns 0, with the table left empty,
+// if the index is missing, damaged or covers more matches than recordCount.
+int readStoreIndex(MatchStore *store, uint64_t recordCount)
+{
+    StoreIndexHeader header;
+    StoredPlayer player;
+    FILE *file = fopen(store->indexPath, "rb");
+    int ok = 0;
+
+    if (file == NULL)
+        return 0;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == STORE_INDEX_MAGIC && header.records <= recordCount)
+    {
+        uint32_t checksum = storeChecksum(2166136261u, &header.records, sizeof(header) - offsetof(StoreIndexHeader, records));
+        uint64_t read = 0;
+        for (; read < header.players && fread(&player, sizeof(player), 1, file) == 1; read++)
+        {
+            StoredPlayer *slot;
+            checksum = storeChecksum(checksum, &player, sizeof(player));
+            player.name[NAME_SIZE - 1] = '\0';
+            if (player.name[0] == '\0' || (slot = findStoredPlayer(store, player.name)) == NULL)
+                break;
+            *slot = player;
+        }
+        ok = read == header.players && checksum == header.checksum;
+    }
+    fclose(file);
+
+    if (!ok)
+    {
+        free(store->slots);
+        store->slots = NULL;
+        store->capacity = store->count = 0;
+        return 0;
+    }
+    store->records = header.records;
+    return 1;
+}
+
+// Function to open (or create) the match store at path: load the saved
+// standings, replay newer matches and cut off a damaged end. Returns 0 on failure.
+int openMatchStore(const char *path)
+{
+#ifdef _WIN32
+    (void)path;
+    printf("The match store is not supported on Windows.\n");
+    return 0;
+#else
+    MatchStore *store = &matchStore;
+    struct stat info;
+
+    store->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    store->indexPath = (char *)malloc(strlen(path) + 5);
+    if (store->fd < 0 || fstat(store->fd, &info) != 0 || store->indexPath == NULL)
+    {
+        printf("Could not open match store %s.\n", path);
+        return 0;
+    }
+    sprintf(store->indexPath, "%s.idx", path);
+    pthread_mutex_init(&store->lock, NULL);
+
+    uint64_t recordCount = (uint64_t)info.st_size / sizeof(MatchRecord);
+    readStoreIndex(store, recordCount);
+
+    // Replay the matches the index does not include, checking each one
+    MatchRecord *batch = (MatchRecord *)malloc(STORE_READ_RECORDS * sizeof(MatchRecord));
+    if (batch == NULL)
+    {
+        printf("Out of memory.\n");
+        return 0;
+    }
+    uint64_t replayed = store->records;
+    int damaged = 0;
+    while (replayed < recordCount && !damaged)
+    {
+        uint64_t count = recordCount - replayed < STORE_READ_RECORDS ? recordCount - replayed : STORE_READ_RECORDS;
+        ssize_t got = pread(store->fd, batch, count * sizeof(MatchRecord), (off_t)(replayed * sizeof(MatchRecord)));
+        if (got < (ssize_t)(count * sizeof(MatchRecord)))
+            break;
+        for (uint64_t i = 0; i < count && !damaged; i++)
+        {
+            damaged = batch[i].magic != STORE_MAGIC || batch[i].checksum != matchRecordChecksum(&batch[i]);
+            if (!damaged && !applyMatchRecord(store, &batch[i], replayed))
+            {
+                printf("Out of memory.\n");
+                free(batch);
+                return 0;
+            }
+            replayed += !damaged;
+        }
+    }
+    free(batch);
+    store->records = replayed;
+
+    if ((uint64_t)info.st_size != replayed * sizeof(MatchRecord))
+    {
+        printf("Match store %s: dropped %llu damaged bytes after match %llu.\n", path,
+               (unsigned long long)((uint64_t)info.st_size - replayed * sizeof(MatchRecord)), (unsigned long long)replayed);
+        if (ftruncate(store->fd, (off_t)(replayed * sizeof(MatchRecord))) != 0)
+        {
+            printf("Could not repair match store %s.\n", path);
+            return 0;
+        }
+    }
+    return 1;
+#endif
+}
+
+// Function to save the standings and close the match store (registered with atexit)
+void closeMatchStore()
+{
+    if (matchStore.fd < 0)
+        return;
+
+#ifndef _WIN32
+    pthread_mutex_lock(&matchStore.lock);
+    writeStoreIndex(&matchStore);
+    close(matchStore.fd);
+    matchStore.fd = -1;
+    pthread_mutex_unlock(&matchStore.lock);
+#endif
+    free(matchStore.slots);
+    free(matchStore.indexPath);
+    free(matchStore.ranked);
+    matchStore.ranked = NULL;
+    matchStore.slots = NULL;
+    matchStore.indexPath = NULL;
+}
+
+// Function to cut the match store back to its first records matches, for a
+// resumed simulation about to play the later ones again. Returns 0 on failure.
+int truncateMatchStore(uint64_t records)
+{
+#ifndef _WIN32
+    char path[4096];
+
+    if (matchStore.fd < 0 || matchStore.records <= records)
+        return 1;
+    // The index is FILE.idx; once cut, the file holds fewer matches than the
+    // index covers, so opening it again rebuilds the standings from the records
+    snprintf(path, sizeof(path), "%.*s", (int)strlen(matchStore.indexPath) - 4, matchStore.indexPath);
+    closeMatchStore();
+    matchStore = (MatchStore){.fd = -1};
+    if (truncate(path, (off_t)(records * sizeof(MatchRecord))) != 0)
+        return 0;
+    return openMatchStore(path);
+#else
+    (void)records;
+    return 1;
+#endif
+}
+
+// Function to add a finished game to the match store, if one is open
+void recordMatch(const GameState *game, int winner)
+{
+#ifndef _WIN32
+    MatchRecord record;
+
+    if (matchStore.fd < 0)
+        return;
+
+    memset(&record, 0, sizeof(record)); // Padding is checksummed too
+    record.magic = STORE_MAGIC;
+    record.time = (uint64_t)time(NULL);
+    record.winner = (uint8_t)winner;
+    record.difficulty = (uint8_t)game->trackingDifficulty;
+    for (int p = 0; p < 2; p++)
+    {
+        memcpy(record.names[p], game->players[p].name, NAME_SIZE);
+        for (int m = 0; m < PLAYED_MOVE_TYPES; m++)
+            record.moves[p][m] = (uint16_t)game->players[p].movesPlayed[m];
+    }
+
+    pthread_mutex_lock(&matchStore.lock);
+    for (int p = 0; p < 2; p++)
+    {
+        StoredPlayer *player = findStoredPlayer(&matchStore, record.names[p]);
+        record.previous[p] = player != NULL ? player->lastMatch : 0;
+    }
+    record.checksum = matchRecordChecksum(&record);
+    if (write(matchStore.fd, &record, sizeof(record)) != (ssize_t)sizeof(record))
+    {
+        // Leave no partial record behind for the next match to follow
+        if (ftruncate(matchStore.fd, (off_t)(matchStore.records * sizeof(MatchRecord))) != 0)
+            printf("Could not write to the match store.\n");
+    }
+    else
+    {
+        applyMatchRecord(&matchStore, &record, matchStore.records);
+        matchStore.records++;
+        if (matchStore.records % STORE_INDEX_INTERVAL == 0)
+            writeStoreIndex(&matchStore);
+    }
+    pthread_mutex_unlock(&matchStore.lock);
+#else
+    (void)game;
+    (void)winner;
+#endif
+}
+
+// Function to order players by rating, best first
+int compareStoredPlayers(const void *a, const void *b)
+{
+    const StoredPlayer *x = *(const StoredPlayer *const *)a, *y = *(const StoredPlayer *const *)b;
+
+    if (x->rating != y->rating)
+        return x->rating < y->rating ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+// Function to bring the leaderboard order up to date, sorting only if matches
+// were added since the last sort. Returns 0 if memory runs out.
+int rankStoredPlayers(MatchStore *store)
+{
+    if (store->ranked != NULL && store->rankedRecords == store->records)
+        return 1;
+
+    StoredPlayer **ranked = (StoredPlayer **)realloc(store->ranked, (size_t)(store->count + 1) * sizeof(StoredPlayer *));
+    if (ranked == NULL)
+        return 0;
+    store->ranked = ranked;
+    store->rankedCount = 0;
+    for (int i = 0; i < store->capacity; i++)
+        if (store->slots[i].name[0] != '\0' && store->slots[i].games > 0)
+            ranked[store->rankedCount++] = &store->slots[i];
+    qsort(ranked, (size_t)store->rankedCount, sizeof(StoredPlayer *), compareStoredPlayers);
+    store->rankedRecords = store->records;
+    return 1;
+}
+
+// Function to print the top count players of the match store
+int printLeaderboard(int count)
+{
+    double start = monotonicSeconds();
+
+#ifndef _WIN32
+    pthread_mutex_lock(&matchStore.lock);
+#endif
+    int ok = rankStoredPlayers(&matchStore);
+#ifndef _WIN32
+    pthread_mutex_unlock(&matchStore.lock);
+#endif
+    if (!ok)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    StoredPlayer **ranked = matchStore.ranked;
+    int players = matchStore.rankedCount;
+
+    printf("Rank  %-20s %8s %8s %8s %7s\n", "Player", "Rating", "Games", "Wins", "Wins %");
+    for (int i = 0; i < players && i < count; i++)
+    {
+        printf("%4d  %-20.20s %8.1f %8llu %8llu %7.2f\n", i + 1, ranked[i]->name, ranked[i]->rating, (unsigned long long)ranked[i]->games,
+               (unsigned long long)ranked[i]->wins, 100.0 * (double)ranked[i]->wins / (double)ranked[i]->games);
+    }
+    printf("%d players, %llu matches, ranked in %.2f ms\n", players, (unsigned long long)matchStore.records,
+           (monotonicSeconds() - start) * 1000.0);
+    return 0;
+}
+
+// Function to print a player's newest count matches, following the records' links back in time
+int printMatchHistory(const char *name, int count)
+{
+#ifdef _WIN32
+    (void)name;
+    (void)count;
+    return 1;
+#else
+    const char *moveNames[PLAYED_MOVE_TYPES] = {"fire", "radar", "smoke", "artillery", "torpedo"};
+    StoredPlayer *player = lookupStoredPlayer(&matchStore, name);
+    uint64_t next = player != NULL ? player->lastMatch : 0;
+
+    if (next == 0 || player->games == 0)
+    {
+        printf("No matches for %s.\n", name);
+        return 1;
+    }
+    printf("%s: rating %.1f, %llu games, %llu wins\n", player->name, player->rating, (unsigned long long)player->games,
+           (unsigned long long)player->wins);
+
+    for (int shown = 0; next != 0 && shown < count; shown++)
+    {
+        MatchRecord record;
+        if (pread(matchStore.fd, &record, sizeof(record), (off_t)((next - 1) * sizeof(MatchRecord))) != (ssize_t)sizeof(record) ||
+            record.checksum != matchRecordChecksum(&record))
+        {
+            printf("Match %llu is damaged.\n", (unsigned long long)(next - 1));
+            return 1;
+        }
+
+        int me = strcmp(storedPlayerName(record.names[0]), player->name) == 0 ? 0 : 1;
+        char when[32];
+        time_t seconds = (time_t)record.time;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&seconds));
+        printf("#%-8llu %s  %-4s vs %-20.20s %s, %d turns:", (unsigned long long)(next - 1), when, record.winner == me ? "won" : "lost",
+               storedPlayerName(record.names[1 - me]), record.difficulty == 1 ? "easy" : "hard",
+               record.moves[me][0] + record.moves[me][1] + record.moves[me][2] + record.moves[me][3] + record.moves[me][4]);
+        for (int m = 0; m < PLAYED_MOVE_TYPES; m++)
+            if (record.moves[me][m] > 0)
+                printf(" %s %d", moveNames[m], record.moves[me][m]);
+        printf("\n");
+        next = record.previous[me];
+    }
+    return 0;
+#endif
+}
+
+// Streaming quantile sketch: exact buckets for small values, 8 buckets per
+// power of two above that. Fixed size, so memory never depends on the sample count.
+#define SKETCH_LINEAR_BUCKETS 128
+#define SKETCH_SUB_BUCKETS 8
+#define SKETCH_BUCKETS (SKETCH_LINEAR_BUCKETS + 57 * SKETCH_SUB_BUCKETS)
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[SKETCH_BUCKETS];
+} QuantileSketch;
+
+// Function to find the sketch bucket of a value
+int sketchBucket(uint64_t value)
+{
+    if (value < SKETCH_LINEAR_BUCKETS)
+        return (int)value;
+
+    int msb = 63;
+    while (!(value >> msb))
+        msb--;
+
+    int sub = (int)((value >> (msb - 3)) & (SKETCH_SUB_BUCKETS - 1));
+    return SKETCH_LINEAR_BUCKETS + (msb - 7) * SKETCH_SUB_BUCKETS + sub;
+}
+
+// Function to get the smallest value that falls into a sketch bucket
+uint64_t sketchBucketValue(int bucket)
+{
+    if (bucket < SKETCH_LINEAR_BUCKETS)
+        return (uint64_t)bucket;
+
+    int msb = (bucket - SKETCH_LINEAR_BUCKETS) / SKETCH_SUB_BUCKETS + 7;
+    int sub = (bucket - SKETCH_LINEAR_BUCKETS) % SKETCH_SUB_BUCKETS;
+    return ((uint64_t)(SKETCH_SUB_BUCKETS + sub)) << (msb - 3);
+}
+
+void sketchInitialize(QuantileSketch *sketch)
+{
+    memset(sketch, 0, sizeof(*sketch));
+    sketch->min = UINT64_MAX;
+}
+
+void sketchAdd(QuantileSketch *sketch, uint64_t value)
+{
+    sketch->buckets[sketchBucket(value)]++;
+    sketch->count++;
+    sketch->sum += value;
+    if (value < sketch->min)
+        sketch->min = value;
+    if (value > sketch->max)
+        sketch->max = value;
+}
+
+// Function to fold one sketch into another (order of merges does not matter)
+void sketchMerge(QuantileSketch *into, const QuantileSketch *from)
+{
+    for (int i = 0; i < SKETCH_BUCKETS; i++)
+        into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+// Function to estimate the q-th quantile (0.0 to 1.0) of the values in a sketch
+uint64_t sketchQuantile(const QuantileSketch *sketch, double q)
+{
+    if (sketch->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)(sketch->count - 1));
+    uint64_t seen = 0;
+    for (int i = 0; i < SKETCH_BUCKETS; i++)
+    {
+        seen += sketch->buckets[i];
+        if (seen > rank)
+        {
+            uint64_t value = sketchBucketValue(i);
+            if (value < sketch->min)
+                return sketch->min;
+            return value > sketch->max ? sketch->max : value;
+        }
+    }
+    return sketch->max;
+}
+
+// Aggregated results of many simulated games. Every field is a sum or a
+// sketch, so per-thread copies can be merged in any order.
+typedef struct
+{
+    uint64_t games;
+    uint64_t firstPlayerWins;
+    QuantileSketch turnsToWin;
+} DifficultyStats;
+
+typedef struct
+{
+    uint64_t games;
+    DifficultyStats difficulty[2];              // Index 0 = Easy, 1 = Hard
+    uint64_t sinkOrder[MAX_SHIPS][MAX_SHIPS];   // [ship][position in which it was sunk]
+    uint64_t wins[2];                           // Games won by Bot 1 and Bot 2
+    uint64_t weaponUses[NUM_WEAPONS];
+    uint64_t weaponCells[NUM_WEAPONS];
+    uint64_t weaponHits[NUM_WEAPONS];
+} SimStats;
+
+void initializeSimStats(SimStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int d = 0; d < 2; d++)
+        sketchInitialize(&stats->difficulty[d].turnsToWin);
+}
+
+void mergeSimStats(SimStats *into, const SimStats *from)
+{
+    into->games += from->games;
+    for (int d = 0; d < 2; d++)
+    {
+        into->difficulty[d].games += from->difficulty[d].games;
+        into->difficulty[d].firstPlayerWins += from->difficulty[d].firstPlayerWins;
+        sketchMerge(&into->difficulty[d].turnsToWin, &from->difficulty[d].turnsToWin);
+    }
+    into->wins[0] += from->wins[0];
+    into->wins[1] += from->wins[1];
+    for (int i = 0; i < fleet.count; i++)
+        for (int j = 0; j < fleet.count; j++)
+            into->sinkOrder[i][j] += from->sinkOrder[i][j];
+    for (int w = 0; w < NUM_WEAPONS; w++)
+    {
+        into->weaponUses[w] += from->weaponUses[w];
+        into->weaponCells[w] += from->weaponCells[w];
+        into->weaponHits[w] += from->weaponHits[w];
+    }
+}
+
+// Function to play one silent bot versus bot game and add its results to stats.
+// Bot 1 is the classic bot, Bot 2 is opponentBot and places its fleet in botPlacement mode.
+void simulateGame(uint32_t gameIndex, uint64_t seed, int trackingDifficulty, SimStats *stats)
+{
+    GameState game;
+    int bots[2] = {BOT_CLASSIC, opponentBot};
+    int turns[2] = {0, 0};
+    int sunkCount[2] = {0, 0}; // Ships of each player sunk so far
+    int sunkShips[MAX_SHIPS];
+
+    logGame = gameIndex; // Placement records and trace spans belong to this game too
+    seedGameRand(seed);
+    game.trackingDifficulty = trackingDifficulty;
+    initializePlayer(&game.players[0], "Bot 1");
+    initializePlayer(&game.players[1], "Bot 2");
+    logPlayer = 0; // Each placement record carries the player who placed
+    autoPlaceShips(game.players[0].grid, game.players[0].ships);
+    logPlayer = 1;
+    placeBotFleet(game.players[1].grid, game.players[1].ships);
+
+    int firstPlayer = chooseFirstPlayer();
+    game.currentPlayer = firstPlayer;
+    const char *names[2] = {game.players[0].name, game.players[1].name};
+    logGameStart(gameIndex, names, trackingDifficulty, firstPlayer);
+
+    while (1)
+    {
+        PlayerState *current = &game.players[game.currentPlayer];
+        PlayerState *opponent = &game.players[switchPlayer(game.currentPlayer)];
+        ShotReport report;
+        TRACE_SCOPE(TRACE_TURN);
+
+        logTurn(game.currentPlayer);
+        beginTurn(current);
+        playBotTurn(bots[game.currentPlayer], current, opponent, trackingDifficulty, &report);
+        turns[game.currentPlayer]++;
+
+        if (report.cells > 0) // Radar and smoke are not shots
+        {
+            stats->weaponUses[report.weapon]++;
+            stats->weaponCells[report.weapon] += report.cells;
+            stats->weaponHits[report.weapon] += report.hits;
+        }
+
+        int sunk = resolveTurn(current, opponent, sunkShips);
+        int defender = switchPlayer(game.currentPlayer);
+        for (int i = 0; i < sunk; i++)
+        {
+            stats->sinkOrder[sunkShips[i]][sunkCount[defender]]++;
+            sunkCount[defender]++;
+        }
+
+        if (allShipsSunk(opponent->grid))
+            break;
+
+        game.currentPlayer = switchPlayer(game.currentPlayer);
+    }
+
+    LOG_EVENT(LOG_LEVEL_GAMES, LOG_GAME_OVER, LOG_FLAG_PRIVATE, game.currentPlayer);
+    recordMatch(&game, game.currentPlayer);
+
+    DifficultyStats *bucket = &stats->difficulty[trackingDifficulty - 1];
+    stats->games++;
+    stats->wins[game.currentPlayer]++;
+    bucket->games++;
+    if (game.currentPlayer == firstPlayer)
+        bucket->firstPlayerWins++;
+    sketchAdd(&bucket->turnsToWin, (uint64_t)turns[game.currentPlayer]);
+}
+
+// Seed of a simulated game, derived from the run seed and the game's index so
+// the results do not depend on how games are spread over threads
+uint64_t simulationGameSeed(uint64_t runSeed, uint64_t gameIndex)
+{
+    return runSeed ^ (gameIndex * 0xD1B54A32D192ED03ULL);
+}
+
+// Work assigned to one simulation thread
+typedef struct
+{
+    uint64_t runSeed;
+    uint64_t games;
+    uint64_t next; // Index of the thread's next game, past games when it is done
+    int threadIndex;
+    int threadCount;
+    int running; // Set while the worker plays on a thread of its own
+    double checkpointDue;
+    SimStats stats;
+} SimWorker;
+
+// Function to give each of threadCount workers its share of a run: every threadCount-th game
+void initializeSimWorkers(SimWorker *workers, uint64_t games, int threadCount, uint64_t runSeed)
+{
+    memset(workers, 0, sizeof(SimWorker) * (size_t)threadCount);
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].runSeed = runSeed;
+        workers[t].games = games;
+        workers[t].next = (uint64_t)t;
+        workers[t].threadIndex = t;
+        workers[t].threadCount = threadCount;
+        initializeSimStats(&workers[t].stats);
+    }
+}
+
+// Checkpoints of simulation runs. Each thread plays a fixed set of game indices
+// and every game is seeded from its index, so a thread's next index and its
+// stats so far are all it needs to carry on. A run with the same seed, thread
+// count and configuration resumes from the file and ends with the same results.
+// When a thread's checkpoint falls due every thread stops between games, so the
+// checkpoint also holds how many matches the store had and how long the log
+// was; a resumed run cuts both back to that before it plays the rest again.
+// Bots that think for a set time do not play the same game twice, so runs with
+// the MCTS bot or optimized placement are not checkpointed.
+#define CHECKPOINT_MAGIC 0x4B504342u // "BCPK"
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t checksum; // FNV-1a of the rest of the header and of every thread
+    uint64_t runSeed;
+    uint64_t games;
+    uint32_t threadCount;
+    uint32_t config;       // simulationConfigHash of the run
+    uint64_t storeRecords; // Matches in the match store
+    uint64_t logBytes;     // Size of the game log
+} CheckpointHeader;
+
+typedef struct
+{
+    uint64_t next;
+    SimStats stats;
+} CheckpointThread;
+
+const char *checkpointPath = NULL;
+double checkpointSeconds = 30; // Time between a thread's checkpoints
+CheckpointHeader checkpointHeader;
+CheckpointThread *checkpointThreads = NULL; // Latest progress of every thread
+int checkpointWanted = 0;  // Set once a thread's checkpoint falls due, until it is written
+int checkpointPlaying = 0; // Threads playing games
+int checkpointWaiting = 0; // Threads stopped for the checkpoint
+uint64_t checkpointsWritten = 0;
+#ifndef _WIN32
+pthread_mutex_t checkpointLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t checkpointDone = PTHREAD_COND_INITIALIZER;
+#endif
+
+// Function to hash the settings that change the outcome of simulated games
+uint32_t simulationConfigHash()
+{
+    int settings[8] = {opponentBot, mctsBudgetMs, mctsThreads, botPlacement,
+                       placementBudgetMs, placementThreads, endgameLayoutThreshold, heatLoaded};
+    uint32_t hash = storeChecksum(2166136261u, settings, sizeof(settings));
+
+    hash = storeChecksum(hash, &fleet.count, sizeof(fleet.count));
+    for (int i = 0; i < fleet.count; i++)
+    {
+        hash = storeChecksum(hash, &fleet.sizes[i], sizeof(fleet.sizes[i]));
+        hash = storeChecksum(hash, fleet.names[i], strlen(fleet.names[i]));
+    }
+    hash = storeChecksum(hash, &endgameNodeBudget, sizeof(endgameNodeBudget));
+    return storeChecksum(hash, &openingBookEntries, sizeof(openingBookEntries));
+}
+
+// Function to checksum the checkpoint held in memory
+uint32_t checkpointChecksum()
+{
+    uint32_t hash = storeChecksum(2166136261u, &checkpointHeader.runSeed, sizeof(CheckpointHeader) - offsetof(CheckpointHeader, runSeed));
+    return storeChecksum(hash, checkpointThreads, sizeof(CheckpointThread) * checkpointHeader.threadCount);
+}
+
+// Function to write the checkpoint beside its file, flush it to disk and
+// rename it over the old one, so a crash leaves one or the other intact
+int writeSimCheckpoint()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    char tempPath[4096];
+
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", checkpointPath);
+    FILE *file = fopen(tempPath, "wb");
+    if (file == NULL)
+        return 0;
+
+    checkpointHeader.storeRecords = matchStore.records;
+    checkpointHeader.logBytes = syncGameLog();
+    checkpointHeader.checksum = checkpointChecksum();
+    int ok = fwrite(&checkpointHeader, sizeof(checkpointHeader), 1, file) == 1 &&
+             fwrite(checkpointThreads, sizeof(CheckpointThread), checkpointHeader.threadCount, file) == checkpointHeader.threadCount;
+    ok = fflush(file) == 0 && ok && fsync(fileno(file)) == 0;
+    fclose(file);
+    if (!ok || rename(tempPath, checkpointPath) != 0)
+    {
+        unlink(tempPath);
+        return 0;
+    }
+    return 1;
+#endif
+}
+
+// Function to load a checkpoint of this run into the workers. Returns 0, with
+// the workers left at their start, if there is none or it belongs to another run.
+int readSimCheckpoint(SimWorker *workers)
+{
+    CheckpointHeader header;
+    FILE *file = fopen(checkpointPath, "rb");
+    int ok = 0;
+
+    if (file == NULL)
+        return 0;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == CHECKPOINT_MAGIC)
+    {
+        if (header.runSeed != checkpointHeader.runSeed || header.games != checkpointHeader.games ||
+            header.threadCount != checkpointHeader.threadCount || header.config != checkpointHeader.config)
+            printf("Checkpoint %s is from a different run, starting over.\n", checkpointPath);
+        else
+        {
+            checkpointHeader.storeRecords = header.storeRecords;
+            checkpointHeader.logBytes = header.logBytes;
+            ok = fread(checkpointThreads, sizeof(CheckpointThread), header.threadCount, file) == header.threadCount &&
+                 checkpointChecksum() == header.checksum;
+            for (uint32_t t = 0; ok && t < header.threadCount; t++)
+            {
+                // A thread's games are t, t + threadCount, ... so its next index follows from its game count
+                CheckpointThread *saved = &checkpointThreads[t];
+                ok = saved->next == t + saved->stats.games * header.threadCount;
+            }
+            if (!ok)
+                printf("Checkpoint %s is damaged, starting over.\n", checkpointPath);
+        }
+    }
+    fclose(file);
+
+    if (!ok)
+        return 0;
+    for (int t = 0; t < workers[0].threadCount; t++)
+    {
+        workers[t].next = checkpointThreads[t].next;
+        workers[t].stats = checkpointThreads[t].stats;
+    }
+    return 1;
+}
+
+// Function to hand in a worker's progress between games. Unless leaving, the
+// worker waits until the checkpoint is written; the last thread to stop writes it.
+void stopForSimCheckpoint(SimWorker *worker, int leaving)
+{
+#ifndef _WIN32
+    flushLogThread();
+    pthread_mutex_lock(&checkpointLock);
+    checkpointThreads[worker->threadIndex].next = worker->next;
+    checkpointThreads[worker->threadIndex].stats = worker->stats;
+    if (leaving)
+        checkpointPlaying--;
+    else
+    {
+        checkpointWanted = 1;
+        checkpointWaiting++;
+    }
+    if (checkpointWanted && checkpointWaiting == checkpointPlaying)
+    {
+        // Every thread still playing is stopped, the store and log hold exactly the games handed in
+        if (!writeSimCheckpoint())
+            printf("Could not write checkpoint %s.\n", checkpointPath);
+        __atomic_store_n(&checkpointWanted, 0, __ATOMIC_RELAXED);
+        checkpointWaiting = 0;
+        checkpointsWritten++;
+        pthread_cond_broadcast(&checkpointDone);
+    }
+    else if (!leaving)
+    {
+        for (uint64_t written = checkpointsWritten; written == checkpointsWritten;)
+            pthread_cond_wait(&checkpointDone, &checkpointLock);
+    }
+    pthread_mutex_unlock(&checkpointLock);
+    worker->checkpointDue = monotonicSeconds() + checkpointSeconds;
+#else
+    (void)worker;
+    (void)leaving;
+#endif
+}
+
+// Thread entry point: plays every threadCount-th game from worker->next on.
+// Games alternate between Easy and Hard.
+void *simulationWorker(void *arg)
+{
+    SimWorker *worker = (SimWorker *)arg;
+
+    configureLogThread(0);
+#ifndef _WIN32
+    if (checkpointThreads != NULL)
+    {
+        pthread_mutex_lock(&checkpointLock);
+        checkpointPlaying++;
+        pthread_mutex_unlock(&checkpointLock);
+    }
+#endif
+    for (uint64_t i = worker->next; i < worker->games; i += (uint64_t)worker->threadCount)
+    {
+        simulateGame((uint32_t)i, simulationGameSeed(worker->runSeed, i), (int)(i % 2) + 1, &worker->stats);
+        worker->next = i + (uint64_t)worker->threadCount;
+        if (checkpointThreads != NULL && (__atomic_load_n(&checkpointWanted, __ATOMIC_RELAXED) || monotonicSeconds() >= worker->checkpointDue))
+            stopForSimCheckpoint(worker, 0);
+    }
+    flushLogThread();
+    flushDecisionCounters();
+    if (checkpointThreads != NULL)
+        stopForSimCheckpoint(worker, 1);
+    return NULL;
+}
+
+// Function to play the workers' games, each worker on a thread of its own.
+// A worker whose thread cannot be started plays on this thread instead.
+void playSimWorkers(SimWorker *workers, int threadCount)
+{
+#ifdef _WIN32
+    // No worker threads on Windows, play everything on this thread
+    for (int t = 0; t < threadCount; t++)
+        simulationWorker(&workers[t]);
+    configureLogThread(1);
+#else
+    pthread_t *threads = (pthread_t *)calloc((size_t)threadCount, sizeof(pthread_t));
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].running = threads != NULL && pthread_create(&threads[t], NULL, simulationWorker, &workers[t]) == 0;
+        if (!workers[t].running)
+        {
+            simulationWorker(&workers[t]);
+            configureLogThread(1);
+        }
+    }
+    for (int t = 0; t < threadCount; t++)
+    {
+        if (workers[t].running)
+            pthread_join(threads[t], NULL);
+    }
+    free(threads);
+#endif
+}
+
+// Function to print the summary tables of a simulation run
+void printSimStats(const SimStats *stats)
+{
+    const char *weaponNames[NUM_WEAPONS] = {"Fire", "Artillery", "Torpedo"};
+    const char *difficultyNames[2] = {"Easy", "Hard"};
+
+    printf("Simulated games: %llu\n\n", (unsigned long long)stats->games);
+
+    printf("Turns to win by tracking difficulty\n");
+    printf("%-6s %10s %8s %6s %6s %6s %6s %6s %6s %14s\n",
+           "Mode", "Games", "Mean", "Min", "p25", "p50", "p90", "p99", "Max", "First wins %");
+    for (int d = 0; d < 2; d++)
+    {
+        const DifficultyStats *bucket = &stats->difficulty[d];
+        const QuantileSketch *sketch = &bucket->turnsToWin;
+        if (bucket->games == 0)
+            continue;
+        printf("%-6s %10llu %8.2f %6llu %6llu %6llu %6llu %6llu %6llu %14.2f\n",
+               difficultyNames[d], (unsigned long long)bucket->games,
+               (double)sketch->sum / (double)sketch->count,
+               (unsigned long long)sketch->min,
+               (unsigned long long)sketchQuantile(sketch, 0.25),
+               (unsigned long long)sketchQuantile(sketch, 0.50),
+               (unsigned long long)sketchQuantile(sketch, 0.90),
+               (unsigned long long)sketchQuantile(sketch, 0.99),
+               (unsigned long long)sketch->max,
+               100.0 * (double)bucket->firstPlayerWins / (double)bucket->games);
+    }
+
+    printf("\nWins by bot\n");
+    printf("%-6s %-8s %10s %8s\n", "Seat", "Bot", "Wins", "Wins %");
+    for (int p = 0; p < 2; p++)
+    {
+        printf("Bot %d  %-8s %10llu %8.2f\n", p + 1, botNames[p == 0 ? BOT_CLASSIC : opponentBot],
+               (unsigned long long)stats->wins[p], stats->games ? 100.0 * (double)stats->wins[p] / (double)stats->games : 0.0);
+    }
+
+    printf("\nSink order frequency (%% of sinkings of each ship)\n");
+    printf("%-12s", "Ship");
+    for (int j = 0; j < fleet.count; j++)
+        printf(" %7s%d", "#", j + 1);
+    printf("\n");
+    for (int i = 0; i < fleet.count; i++)
+    {
+        uint64_t total = 0;
+        for (int j = 0; j < fleet.count; j++)
+            total += stats->sinkOrder[i][j];
+        printf("%-12s", fleet.names[i]);
+        for (int j = 0; j < fleet.count; j++)
+            printf(" %8.2f", total ? 100.0 * (double)stats->sinkOrder[i][j] / (double)total : 0.0);
+        printf("\n");
+    }
+
+    printf("\nHit yield by weapon\n");
+    printf("%-10s %12s %14s %12s %10s\n", "Weapon", "Uses", "Cells", "Hits", "Yield %");
+    for (int w = 0; w < NUM_WEAPONS; w++)
+    {
+        printf("%-10s %12llu %14llu %12llu %10.2f\n", weaponNames[w],
+               (unsigned long long)stats->weaponUses[w],
+               (unsigned long long)stats->weaponCells[w],
+               (unsigned long long)stats->weaponHits[w],
+               stats->weaponCells[w] ? 100.0 * (double)stats->weaponHits[w] / (double)stats->weaponCells[w] : 0.0);
+    }
+    printDecisionCacheStats();
+}
+
+// Function to run many silent games across threads and print aggregated statistics
+void runSimulation(uint64_t games, int threadCount, uint64_t runSeed)
+{
+    SimWorker *workers = (SimWorker *)calloc((size_t)threadCount, sizeof(SimWorker));
+    SimStats total;
+
+    if (workers == NULL)
+    {
+        printf("Out of memory.\n");
+        return;
+    }
+
+    initializeSimWorkers(workers, games, threadCount, runSeed);
+
+    if (checkpointPath != NULL && (opponentBot == BOT_MCTS || botPlacement == PLACEMENT_OPTIMIZED))
+        printf("Games of the MCTS bot or optimized placements cannot be played again the same way, not checkpointing.\n");
+    else if (checkpointPath != NULL)
+    {
+#ifdef _WIN32
+        printf("Checkpoints are not supported on Windows.\n");
+#else
+        checkpointThreads = (CheckpointThread *)calloc((size_t)threadCount, sizeof(CheckpointThread));
+        if (checkpointThreads == NULL)
+        {
+            printf("Out of memory.\n");
+            free(workers);
+            return;
+        }
+        CheckpointHeader header = {CHECKPOINT_MAGIC, 0, runSeed, games, (uint32_t)threadCount, simulationConfigHash(), 0, 0};
+        checkpointHeader = header;
+        if (readSimCheckpoint(workers))
+        {
+            uint64_t done = 0;
+            for (int t = 0; t < threadCount; t++)
+                done += workers[t].stats.games;
+            printf("Resuming from checkpoint %s: %llu of %llu games played.\n", checkpointPath,
+                   (unsigned long long)done, (unsigned long long)games);
+            // Games played after the checkpoint are played again, drop what they left behind
+            if (!truncateMatchStore(checkpointHeader.storeRecords) || !truncateGameLog(checkpointHeader.logBytes))
+                printf("Could not cut the match store or log back to the checkpoint, games after it will appear twice.\n");
+        }
+        else
+        {
+            for (int t = 0; t < threadCount; t++)
+            {
+                checkpointThreads[t].next = workers[t].next;
+                checkpointThreads[t].stats = workers[t].stats;
+            }
+            truncateGameLog(0); // Opened to append in case of a resume, start it afresh
+        }
+        for (int t = 0; t < threadCount; t++)
+            workers[t].checkpointDue = monotonicSeconds() + checkpointSeconds;
+#endif
+    }
+
+    playSimWorkers(workers, threadCount);
+
+    if (checkpointThreads != NULL)
+    {
+        // The finished run stays in the checkpoint, running it again only prints the results
+#ifndef _WIN32
+        if (!writeSimCheckpoint())
+            printf("Could not write checkpoint %s.\n", checkpointPath);
+#endif
+        free(checkpointThreads);
+        checkpointThreads = NULL;
+    }
+
+    initializeSimStats(&total);
+    for (int t = 0; t < threadCount; t++)
+        mergeSimStats(&total, &workers[t].stats);
+
+    printSimStats(&total);
+    free(workers);
+}
+
+// Function to play games with 1 thread and with several, and check the stats
+// come out the same. Returns 0 when they do.
+int selfTestSimulationThreads(uint64_t games, int threadCount, uint64_t runSeed)
+{
+    SimWorker *workers = (SimWorker *)calloc((size_t)threadCount, sizeof(SimWorker));
+    SimStats totals[2];
+    int bot = opponentBot, counts[2] = {1, threadCount};
+
+    if (workers == NULL)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    int placement = botPlacement;
+    opponentBot = BOT_CLASSIC; // The MCTS bot and the placement optimizer think for a set time, so their games are not repeatable
+    botPlacement = PLACEMENT_RANDOM;
+    for (int run = 0; run < 2; run++)
+    {
+        initializeSimWorkers(workers, games, counts[run], runSeed);
+        playSimWorkers(workers, counts[run]);
+        initializeSimStats(&totals[run]);
+        for (int t = 0; t < counts[run]; t++)
+            mergeSimStats(&totals[run], &workers[t].stats);
+    }
+    opponentBot = bot;
+    botPlacement = placement;
+    free(workers);
+
+    int failed = memcmp(&totals[0], &totals[1], sizeof(SimStats)) != 0;
+    printf("%s: %llu simulated games, 1 thread against %d\n", failed ? "FAIL" : "ok", (unsigned long long)games, threadCount);
+    return failed;
+}
+
+// Function to play random legal games and check that undoMove puts back
+// everything applyMove changed. Returns 0 when it does.
+int selfTestApplyUndo(int games, int triesPerTurn, uint64_t runSeed)
+{
+    static PlayerState players[2], saved[2]; // Too large for a worker's stack
+    Move moves[MAX_LEGAL_MOVES];
+    MoveUndo undo;
+    long checked = 0;
+    int failed = 0;
+    WorkerQuiet output = enterWorkerQuiet();
+
+    for (int g = 0; g < games && !failed; g++)
+    {
+        seedGameRand(simulationGameSeed(runSeed, (uint64_t)g));
+        initializePlayer(&players[0], "Bot 1");
+        initializePlayer(&players[1], "Bot 2");
+        autoPlaceShips(players[0].grid, players[0].ships);
+        autoPlaceShips(players[1].grid, players[1].ships);
+
+        for (int turn = 0; !failed; turn++)
+        {
+            PlayerState *self = &players[turn % 2], *opponent = &players[1 - turn % 2];
+            beginTurn(self);
+            int count = generateLegalMoves(self, 1, moves);
+            if (count == 0)
+                break;
+            memcpy(saved, players, sizeof(players));
+            for (int t = 0; t < triesPerTurn && !failed; t++)
+            {
+                Move move = moves[gameRand() % count];
+                applyMove(self, opponent, move, 1, &undo);
+                undoMove(self, opponent, move, &undo);
+                checked++;
+                if (memcmp(saved, players, sizeof(players)) != 0)
                 {
-                    printf("Hit at %c%d!\n", j + 'A', num + 1);
+                    printf("FAIL: undo of move type %d at %d in game %d, turn %d\n", MOVE_TYPE(move), MOVE_TARGET(move), g, turn);
+                    failed = 1;
                 }
             }
-            else
+            applyMove(self, opponent, moves[gameRand() % count], 1, &undo); // Move the game on
+            if (self->sunkTotal == fleet.count)
+                break;
+        }
+    }
+    leaveWorkerQuiet(output);
+    if (!failed)
+        printf("ok: %ld moves applied and undone over %d games\n", checked, games);
+    return failed;
+}
+
+int selfTestLayoutValidation();
+
+// Function to run the self tests, returns the number that failed
+int runSelfTest()
+{
+    int failed = 0;
+
+    failed += selfTestApplyUndo(64, 8, 42);
+    failed += selfTestLayoutValidation();
+    failed += selfTestSimulationThreads(64, 4, 42);
+    printf("%d self test%s failed.\n", failed, failed == 1 ? "" : "s");
+    return failed;
+}
+
+#ifndef _WIN32
+// A file mapped read only and cut into one range of whole lines per thread
+typedef struct
+{
+    const char *data; // NULL for an empty file
+    size_t size;
+    size_t *bounds; // Range t is bounds[t] to bounds[t + 1]
+} LineRanges;
+
+// Function to release what mapLineRanges set up
+void unmapLineRanges(LineRanges *ranges)
+{
+    if (ranges->data != NULL)
+        munmap((void *)ranges->data, ranges->size);
+    free(ranges->bounds);
+    ranges->data = NULL;
+    ranges->bounds = NULL;
+}
+
+// Function to map a file and cut it into count ranges that start at the
+// beginning of a line. kind names the file in messages. Returns 0, with the
+// reason printed, if the file cannot be read.
+int mapLineRanges(const char *path, const char *kind, int count, LineRanges *ranges)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+
+    ranges->data = NULL;
+    ranges->size = 0;
+    ranges->bounds = NULL;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("Could not open %s file %s.\n", kind, path);
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+
+    size_t size = (size_t)info.st_size;
+    if (size > 0)
+    {
+        void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            printf("Could not map %s file %s.\n", kind, path);
+            close(fd);
+            return 0;
+        }
+        ranges->data = (const char *)mapped;
+        ranges->size = size;
+        madvise(mapped, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    ranges->bounds = (size_t *)malloc(((size_t)count + 1) * sizeof(size_t));
+    if (ranges->bounds == NULL)
+    {
+        printf("Out of memory.\n");
+        unmapLineRanges(ranges);
+        return 0;
+    }
+    for (int t = 0; t < count; t++)
+    {
+        size_t start = size / (size_t)count * (size_t)t;
+        if (t > 0 && start > 0)
+        {
+            const char *newline = (const char *)memchr(ranges->data + start - 1, '\n', size - start + 1);
+            start = newline ? (size_t)(newline - ranges->data) + 1 : size;
+        }
+        ranges->bounds[t] = start;
+    }
+    ranges->bounds[count] = size;
+    return 1;
+}
+#endif
+
+// Post-game analysis of NDJSON game logs (--log-format ndjson, --log-level 3
+// or more). The file is memory mapped and cut into one byte range per thread.
+// A game belongs to the thread whose range holds its first record (player 0's
+// name); that thread follows it past the end of its range if it has to, since
+// parallel runs interleave the records of several games. Each thread adds up
+// its own per-player reports, they are merged at the end. The best move at a
+// shot is picked on one set of sampled layouts and scored, like the move the
+// player made, on a second set: the best of noisy estimates would otherwise
+// overstate what was on offer.
+#define ANALYZE_SAMPLES 64                   // Layouts drawn to estimate the hit chances of one shot
+#define ANALYZE_MAX_OVERRUN (64 * 1024 * 1024) // Bytes past its range a thread follows unfinished games
+#define ANALYZE_EVENT_SIZE 24
+#define ANALYZE_SCORE_SEED 0x9E3779B97F4A7C15ULL // Turns a position's hash into the seed of its scoring samples
+
+// Everything one player did over the analysed games
+typedef struct
+{
+    char name[NAME_SIZE]; // Empty while the slot is free
+    uint64_t games, wins;
+    uint64_t shots, hits, repeats; // Single shots, repeats are shots at cells already fired at
+    double expectedHits;           // Sum of the hit chance of each cell fired at
+    double idealHits;              // Sum of the best hit chance available at each shot
+    uint64_t sweeps, smokes;
+    uint64_t weaponUnlocked[NUM_WEAPONS], weaponUsed[NUM_WEAPONS], weaponWasted[NUM_WEAPONS], weaponHits[NUM_WEAPONS];
+    double weaponExpected[NUM_WEAPONS], weaponIdeal[NUM_WEAPONS];
+} PlayerReport;
+
+// Open addressing table of player reports, keyed by name
+typedef struct
+{
+    PlayerReport *slots;
+    int capacity; // Power of two
+    int count;
+} PlayerTable;
+
+// A game being replayed
+typedef struct
+{
+    uint32_t game;
+    char names[2][NAME_SIZE];
+    Observation view[2];            // What each player knew of the other's board
+    int ready[2][NUM_WEAPONS];      // Weapon unlocked and neither used nor expired
+    int inFlight[2];                // Weapon whose cells are being reported, -1 for none
+    int followUp[2];                // The next torpedo is a bot's follow-up, not its unlocked one
+} AnalyzedGame;
+
+typedef struct
+{
+    const char *data;
+    size_t size, start, end;
+    AnalyzedGame *games; // Games this thread owns that have not ended
+    int gameCount, gameCapacity;
+    int *gameSlots; // Open addressing index of games by id: index in games plus one, 0 for a free slot
+    int slotCount;  // Power of two, twice gameCapacity
+    PlayerTable players;
+    uint64_t finished, unfinished;
+    int running; // Set while the range is replayed on a thread of its own
+} AnalyzerWorker;
+
+// Function to find a player's report, adding an empty one for a new name. Returns NULL if memory runs out.
+PlayerReport *findPlayerReport(PlayerTable *table, const char *name)
+{
+    if (table->count * 10 >= table->capacity * 7)
+    {
+        // Grow to twice the size and put every report back
+        PlayerTable grown = {NULL, table->capacity ? table->capacity * 2 : 64, 0};
+        grown.slots = (PlayerReport *)calloc((size_t)grown.capacity, sizeof(PlayerReport));
+        if (grown.slots == NULL)
+            return NULL;
+        for (int i = 0; i < table->capacity; i++)
+        {
+            if (table->slots[i].name[0] != '\0')
+                *findPlayerReport(&grown, table->slots[i].name) = table->slots[i];
+        }
+        free(table->slots);
+        *table = grown;
+    }
+
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (const char *c = name; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    for (int i = (int)(hash & (uint32_t)(table->capacity - 1));; i = (i + 1) & (table->capacity - 1))
+    {
+        PlayerReport *slot = &table->slots[i];
+        if (slot->name[0] == '\0')
+        {
+            strncpy(slot->name, name[0] ? name : "?", NAME_SIZE - 1);
+            table->count++;
+            return slot;
+        }
+        if (strcmp(slot->name, name[0] ? name : "?") == 0)
+            return slot;
+    }
+}
+
+// Function to add one report into another
+void mergePlayerReport(PlayerReport *into, const PlayerReport *from)
+{
+    into->games += from->games;
+    into->wins += from->wins;
+    into->shots += from->shots;
+    into->hits += from->hits;
+    into->repeats += from->repeats;
+    into->expectedHits += from->expectedHits;
+    into->idealHits += from->idealHits;
+    into->sweeps += from->sweeps;
+    into->smokes += from->smokes;
+    for (int w = 0; w < NUM_WEAPONS; w++)
+    {
+        into->weaponUnlocked[w] += from->weaponUnlocked[w];
+        into->weaponUsed[w] += from->weaponUsed[w];
+        into->weaponWasted[w] += from->weaponWasted[w];
+        into->weaponHits[w] += from->weaponHits[w];
+        into->weaponExpected[w] += from->weaponExpected[w];
+        into->weaponIdeal[w] += from->weaponIdeal[w];
+    }
+}
+
+// Function to find "key": in one NDJSON line, returns the start of its value or NULL
+const char *jsonValue(const char *line, const char *end, const char *key)
+{
+    size_t length = strlen(key);
+
+    for (const char *p = line; p + length + 3 <= end; p++)
+    {
+        if (p[0] == '"' && memcmp(p + 1, key, length) == 0 && p[length + 1] == '"' && p[length + 2] == ':')
+            return p + length + 3;
+    }
+    return NULL;
+}
+
+// Function to read a non-negative integer field, returns -1 if it is missing
+long jsonInteger(const char *line, const char *end, const char *key)
+{
+    const char *p = jsonValue(line, end, key);
+    long value = 0;
+
+    if (p == NULL || p >= end || !isdigit((unsigned char)*p))
+        return -1;
+    for (; p < end && isdigit((unsigned char)*p); p++)
+        value = value * 10 + (*p - '0');
+    return value;
+}
+
+// Function to copy a string field into out (escapes decoded, ASCII only), returns 0 if it is missing
+int jsonString(const char *line, const char *end, const char *key, char *out, int size)
+{
+    const char *p = jsonValue(line, end, key);
+    int length = 0;
+
+    if (p == NULL || p >= end || *p != '"')
+        return 0;
+    for (p++; p < end && *p != '"' && length < size - 1; p++)
+    {
+        if (*p == '\\' && p + 1 < end)
+        {
+            p++;
+            if (*p == 'u' && p + 4 < end)
+            {
+                out[length++] = (char)strtol((char[5]){p[1], p[2], p[3], p[4], 0}, NULL, 16);
+                p += 4;
+                continue;
+            }
+            out[length++] = *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+        }
+        else
+            out[length++] = *p;
+    }
+    out[length] = '\0';
+    return 1;
+}
+
+// Function to estimate the chance each cell holds a ship, given what a player
+// knows, from samples layouts that agree with it drawn from seed. Cells already fired at get 0.
+void estimateHitChancesFrom(const Observation *view, int samples, uint64_t seed, double chance[GRID_SIZE * GRID_SIZE])
+{
+    int remaining[MAX_SHIPS], count = 0, order[MAX_SHIPS], placements[MAX_SHIPS];
+    int occupiedCount[GRID_SIZE * GRID_SIZE] = {0};
+    int drawn = 0;
+    BitBoard mustCover = bitboardAndNot(view->hit, view->sunk);
+    BitBoard plain = bitboardOr(view->miss, view->sunk);
+    BitBoard blocked = bitboardOr(plain, bitboardAndNot(view->radarClear, view->hit));
+    BitBoard occupied;
+
+    for (int i = 0; i < fleet.count; i++)
+        if (!(view->sunkShips & (1 << i)))
+            remaining[count++] = i;
+
+    seedGameRand(seed);
+    for (int s = 0; s < samples; s++)
+    {
+        if (!sampleShipLayout(remaining, count, blocked, mustCover, order, placements, &occupied))
+        {
+            // Smoke may have hidden ships from a sweep; without even that, give up
+            if (drawn > 0 || bitboardEqual(blocked, plain))
+                break;
+            blocked = plain;
+            s--;
+            continue;
+        }
+        for (int cell = bitboardPopFirst(&occupied); cell >= 0; cell = bitboardPopFirst(&occupied))
+            occupiedCount[cell]++;
+        drawn++;
+    }
+
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        int known = !observationIsUnknown(view, cell / GRID_SIZE, cell % GRID_SIZE);
+        chance[cell] = known || drawn == 0 ? 0.0 : (double)occupiedCount[cell] / drawn;
+    }
+}
+
+// Function to estimate hit chances from samples seeded by the position, so the same position always gives the same estimate
+void estimateHitChances(const Observation *view, int samples, double chance[GRID_SIZE * GRID_SIZE])
+{
+    estimateHitChancesFrom(view, samples, view->hash, chance);
+}
+
+// Function to sum the hit chances over a 2x2 area, or over a row ('R') or column ('C') when axis is set
+double areaHitChance(const double chance[GRID_SIZE * GRID_SIZE], char axis, int row, int col)
+{
+    double sum = 0.0;
+
+    if (axis != 0)
+    {
+        for (int k = 0; k < GRID_SIZE; k++)
+            sum += axis == 'R' ? chance[CELL_INDEX(row, k)] : chance[CELL_INDEX(k, col)];
+        return sum;
+    }
+    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+            sum += chance[CELL_INDEX(i, j)];
+    return sum;
+}
+
+// Function to find a game id in the worker's index: the slot holding it, or the free slot it would go in
+int findGameSlot(const AnalyzerWorker *worker, uint32_t game)
+{
+    int mask = worker->slotCount - 1;
+
+    for (int i = (int)((game * 2654435761u) & (uint32_t)mask);; i = (i + 1) & mask)
+        if (worker->gameSlots[i] == 0 || worker->games[worker->gameSlots[i] - 1].game == game)
+            return i;
+}
+
+// Function to free a slot of the game index, moving later entries of its probe run back into the gap
+void removeGameSlot(AnalyzerWorker *worker, int slot)
+{
+    int mask = worker->slotCount - 1;
+
+    worker->gameSlots[slot] = 0;
+    for (int i = (slot + 1) & mask; worker->gameSlots[i] != 0; i = (i + 1) & mask)
+    {
+        int home = (int)((worker->games[worker->gameSlots[i] - 1].game * 2654435761u) & (uint32_t)mask);
+        if (((i - home) & mask) >= ((i - slot) & mask)) // Its home is not between the gap and it
+        {
+            worker->gameSlots[slot] = worker->gameSlots[i];
+            worker->gameSlots[i] = 0;
+            slot = i;
+        }
+    }
+}
+
+// Function to end a game this thread owns (it ended or its slot is reused)
+void closeAnalyzedGame(AnalyzerWorker *worker, int index, int winner)
+{
+    AnalyzedGame *game = &worker->games[index];
+
+    if (winner >= 0)
+    {
+        for (int p = 0; p < 2; p++)
+        {
+            PlayerReport *report = findPlayerReport(&worker->players, game->names[p]);
+            if (report != NULL)
+            {
+                report->games++;
+                if (p == winner)
+                    report->wins++;
+            }
+        }
+        worker->finished++;
+    }
+    else
+        worker->unfinished++;
+
+    // The last game fills the gap, its slot in the index follows it
+    removeGameSlot(worker, findGameSlot(worker, game->game));
+    int last = --worker->gameCount;
+    if (index != last)
+    {
+        worker->gameSlots[findGameSlot(worker, worker->games[last].game)] = index + 1;
+        worker->games[index] = worker->games[last];
+    }
+}
+
+// Function to replay one log line. New games are only opened inside this thread's range.
+void analyzeLine(AnalyzerWorker *worker, const char *line, const char *end, int inRange)
+{
+    char event[ANALYZE_EVENT_SIZE];
+    long gameId = jsonInteger(line, end, "game");
+    long player = jsonInteger(line, end, "player");
+    int index;
+
+    if (gameId < 0 || player < 0 || player > 1 || !jsonString(line, end, "event", event, sizeof(event)))
+        return;
+    int slot = worker->slotCount > 0 ? findGameSlot(worker, (uint32_t)gameId) : -1;
+    index = slot >= 0 && worker->gameSlots[slot] != 0 ? worker->gameSlots[slot] - 1 : worker->gameCount;
+
+    int p = (int)player;
+    if (strcmp(event, "player") == 0 && p == 0 && inRange)
+    {
+        // First record of a game
+        if (index < worker->gameCount)
+            closeAnalyzedGame(worker, index, -1);
+        if (worker->gameCount == worker->gameCapacity)
+        {
+            int capacity = worker->gameCapacity ? worker->gameCapacity * 2 : 16;
+            AnalyzedGame *games = (AnalyzedGame *)realloc(worker->games, sizeof(AnalyzedGame) * (size_t)capacity);
+            int *slots = (int *)calloc((size_t)capacity * 2, sizeof(int));
+            if (games == NULL || slots == NULL)
+            {
+                if (games != NULL)
+                    worker->games = games;
+                free(slots);
+                return;
+            }
+            // Index every open game again in the larger table
+            free(worker->gameSlots);
+            worker->games = games;
+            worker->gameCapacity = capacity;
+            worker->gameSlots = slots;
+            worker->slotCount = capacity * 2;
+            for (int i = 0; i < worker->gameCount; i++)
+                worker->gameSlots[findGameSlot(worker, worker->games[i].game)] = i + 1;
+        }
+        index = worker->gameCount++;
+        AnalyzedGame *game = &worker->games[index];
+        memset(game, 0, sizeof(*game));
+        game->game = (uint32_t)gameId;
+        worker->gameSlots[findGameSlot(worker, game->game)] = index + 1;
+        for (int side = 0; side < 2; side++)
+        {
+            initializeObservation(&game->view[side]);
+            game->inFlight[side] = -1;
+        }
+    }
+    if (index == worker->gameCount)
+        return; // Another thread owns this game
+
+    AnalyzedGame *game = &worker->games[index];
+    if (strcmp(event, "player") == 0)
+    {
+        jsonString(line, end, "name", game->names[p], NAME_SIZE);
+        return;
+    }
+
+    Observation *view = &game->view[p];
+    PlayerReport *report = findPlayerReport(&worker->players, game->names[p]);
+    double pick[GRID_SIZE * GRID_SIZE], chance[GRID_SIZE * GRID_SIZE]; // Chances the best move is picked by, and scored by
+    long row = jsonInteger(line, end, "row"), col = jsonInteger(line, end, "col");
+    int onGrid = row >= 0 && row < GRID_SIZE && col >= 0 && col < GRID_SIZE;
+
+    if (report == NULL)
+        return;
+    if (strcmp(event, "turn") == 0)
+    {
+        game->inFlight[p] = -1;
+        game->followUp[p] = 0;
+    }
+    else if (strcmp(event, "fire") == 0 && onGrid)
+    {
+        char result[8];
+        int best = 0;
+
+        jsonString(line, end, "result", result, sizeof(result));
+        estimateHitChances(view, ANALYZE_SAMPLES, pick);
+        estimateHitChancesFrom(view, ANALYZE_SAMPLES, view->hash ^ ANALYZE_SCORE_SEED, chance);
+        for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+            if (pick[cell] > pick[best])
+                best = cell;
+        report->shots++;
+        report->idealHits += chance[best];
+        report->expectedHits += chance[CELL_INDEX(row, col)];
+        if (strcmp(result, "repeat") == 0)
+            report->repeats++;
+        else
+        {
+            report->hits += strcmp(result, "hit") == 0;
+            observeShot(view, (int)row, (int)col, strcmp(result, "hit") == 0);
+        }
+    }
+    else if ((strcmp(event, "artillery") == 0 && onGrid) || strcmp(event, "torpedo") == 0)
+    {
+        int weapon = event[0] == 'a' ? WEAPON_ARTILLERY : WEAPON_TORPEDO;
+        char axis[4] = "";
+        long target = jsonInteger(line, end, "index");
+        double best = -1.0, ideal = 0.0, chosen;
+
+        // A torpedo the player had no torpedo for is the bot's follow-up
+        game->inFlight[p] = -1;
+        if (!game->ready[p][weapon] || (weapon == WEAPON_TORPEDO && game->followUp[p]))
+            return;
+        if (weapon == WEAPON_TORPEDO && (!jsonString(line, end, "axis", axis, sizeof(axis)) || target < 0 || target >= GRID_SIZE))
+            return;
+
+        estimateHitChances(view, ANALYZE_SAMPLES, pick);
+        estimateHitChancesFrom(view, ANALYZE_SAMPLES, view->hash ^ ANALYZE_SCORE_SEED, chance);
+        if (weapon == WEAPON_ARTILLERY)
+        {
+            chosen = areaHitChance(chance, 0, (int)row, (int)col);
+            for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+            {
+                double area = areaHitChance(pick, 0, cell / GRID_SIZE, cell % GRID_SIZE);
+                if (area > best)
+                {
+                    best = area;
+                    ideal = areaHitChance(chance, 0, cell / GRID_SIZE, cell % GRID_SIZE);
+                }
+            }
+        }
+        else
+        {
+            chosen = areaHitChance(chance, axis[0] == 'r' ? 'R' : 'C', (int)target, (int)target);
+            for (int k = 0; k < 2 * GRID_SIZE; k++)
+            {
+                double line = areaHitChance(pick, k < GRID_SIZE ? 'R' : 'C', k % GRID_SIZE, k % GRID_SIZE);
+                if (line > best)
+                {
+                    best = line;
+                    ideal = areaHitChance(chance, k < GRID_SIZE ? 'R' : 'C', k % GRID_SIZE, k % GRID_SIZE);
+                }
+            }
+        }
+        game->ready[p][weapon] = 0;
+        game->inFlight[p] = weapon;
+        report->weaponUsed[weapon]++;
+        report->weaponExpected[weapon] += chosen;
+        report->weaponIdeal[weapon] += ideal;
+    }
+    else if ((strcmp(event, "artillery_cell") == 0 || strcmp(event, "torpedo_cell") == 0) && onGrid)
+    {
+        const char *hit = jsonValue(line, end, "hit");
+        int wasHit = hit != NULL && *hit == 't';
+        if (wasHit && game->inFlight[p] >= 0 && observationIsUnknown(view, (int)row, (int)col))
+            report->weaponHits[game->inFlight[p]]++;
+        observeShot(view, (int)row, (int)col, wasHit);
+    }
+    else if (strcmp(event, "bot_torpedo") == 0)
+        game->followUp[p] = 1;
+    else if (strcmp(event, "radar") == 0 && onGrid)
+    {
+        const char *found = jsonValue(line, end, "found");
+        observeRadar(view, (int)row, (int)col, found != NULL && *found == 't');
+        report->sweeps++;
+    }
+    else if (strcmp(event, "smoke") == 0)
+        report->smokes++;
+    else if (strcmp(event, "sunk") == 0 && onGrid)
+    {
+        char orientation[4] = "";
+        long ship = jsonInteger(line, end, "ship"), size = jsonInteger(line, end, "size");
+        Ship sunk;
+
+        jsonString(line, end, "orientation", orientation, sizeof(orientation));
+        if (ship < 0 || ship >= MAX_SHIPS || size < 1 || size > MAX_SHIP_SIZE)
+            return;
+        sunk.shipSize = (int)size;
+        for (int i = 0; i < size; i++)
+        {
+            sunk.coords[i][0] = (int)row + (orientation[0] == 'V' ? i : 0);
+            sunk.coords[i][1] = (int)col + (orientation[0] == 'V' ? 0 : i);
+            if (sunk.coords[i][0] >= GRID_SIZE || sunk.coords[i][1] >= GRID_SIZE)
+                return;
+        }
+        observeSunk(view, &sunk, (int)ship);
+    }
+    else if (strcmp(event, "unlock") == 0 || strcmp(event, "expire") == 0)
+    {
+        char weaponName[16];
+        jsonString(line, end, "weapon", weaponName, sizeof(weaponName));
+        int weapon = strcmp(weaponName, "artillery") == 0 ? WEAPON_ARTILLERY : WEAPON_TORPEDO;
+        if (event[0] == 'u')
+        {
+            game->ready[p][weapon] = 1;
+            report->weaponUnlocked[weapon]++;
+        }
+        else if (game->ready[p][weapon])
+        {
+            game->ready[p][weapon] = 0;
+            report->weaponWasted[weapon]++;
+        }
+    }
+    else if (strcmp(event, "game_over") == 0)
+    {
+        long winner = jsonInteger(line, end, "winner");
+        closeAnalyzedGame(worker, index, winner == 1 ? 1 : 0);
+    }
+}
+
+// Thread entry point: replays the lines that start in this thread's range,
+// then follows its unfinished games until they end
+void *analyzerWorker(void *arg)
+{
+    AnalyzerWorker *worker = (AnalyzerWorker *)arg;
+    size_t position = worker->start;
+
+    while (position < worker->size)
+    {
+        if (position >= worker->end && (worker->gameCount == 0 || position - worker->end >= ANALYZE_MAX_OVERRUN))
+            break;
+        const char *line = worker->data + position;
+        const char *end = (const char *)memchr(line, '\n', worker->size - position);
+        if (end == NULL)
+            end = worker->data + worker->size;
+        analyzeLine(worker, line, end, position < worker->end);
+        position = (size_t)(end - worker->data) + 1;
+    }
+    while (worker->gameCount > 0)
+        closeAnalyzedGame(worker, worker->gameCount - 1, -1);
+    return NULL;
+}
+
+// Function to compare reports for the table, most shots first
+int comparePlayerReports(const void *a, const void *b)
+{
+    const PlayerReport *x = (const PlayerReport *)a, *y = (const PlayerReport *)b;
+    if (x->shots != y->shots)
+        return x->shots < y->shots ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+// Function to print the accuracy and special weapon tables
+void printAnalysis(PlayerReport *reports, int count, uint64_t finished, uint64_t unfinished)
+{
+    printf("Analysed games: %llu (%llu unfinished)\n\n", (unsigned long long)finished, (unsigned long long)unfinished);
+
+    printf("Shot accuracy by player (chances are estimated from the shooter's view at each shot)\n");
+    printf("%-20s %8s %7s %9s %7s %11s %8s %9s %8s\n",
+           "Player", "Games", "Wins %", "Shots", "Hit %", "Expected %", "Ideal %", "Quality %", "Repeats");
+    for (int i = 0; i < count; i++)
+    {
+        const PlayerReport *r = &reports[i];
+        printf("%-20.20s %8llu %7.2f %9llu %7.2f %11.2f %8.2f %9.2f %8llu\n", r->name,
+               (unsigned long long)r->games, r->games ? 100.0 * (double)r->wins / (double)r->games : 0.0,
+               (unsigned long long)r->shots,
+               r->shots ? 100.0 * (double)r->hits / (double)r->shots : 0.0,
+               r->shots ? 100.0 * r->expectedHits / (double)r->shots : 0.0,
+               r->shots ? 100.0 * r->idealHits / (double)r->shots : 0.0,
+               r->idealHits > 0.0 ? 100.0 * r->expectedHits / r->idealHits : 0.0,
+               (unsigned long long)r->repeats);
+    }
+
+    printf("\nSpecial weapons by player (hits per use: actual, expected from the chosen target, best target)\n");
+    printf("%-20s %-10s %9s %8s %8s %9s %9s %9s %9s\n",
+           "Player", "Weapon", "Unlocked", "Used", "Wasted", "Hits/use", "Expected", "Best", "Quality %");
+    for (int i = 0; i < count; i++)
+    {
+        const PlayerReport *r = &reports[i];
+        for (int w = WEAPON_ARTILLERY; w <= WEAPON_TORPEDO; w++)
+        {
+            uint64_t used = r->weaponUsed[w];
+            printf("%-20.20s %-10s %9llu %8llu %8llu %9.2f %9.2f %9.2f %9.2f\n", r->name, w == WEAPON_ARTILLERY ? "Artillery" : "Torpedo",
+                   (unsigned long long)r->weaponUnlocked[w], (unsigned long long)used, (unsigned long long)r->weaponWasted[w],
+                   used ? (double)r->weaponHits[w] / (double)used : 0.0,
+                   used ? r->weaponExpected[w] / (double)used : 0.0,
+                   used ? r->weaponIdeal[w] / (double)used : 0.0,
+                   r->weaponIdeal[w] > 0.0 ? 100.0 * r->weaponExpected[w] / r->weaponIdeal[w] : 0.0);
+        }
+    }
+    printf("\nRadar sweeps and smoke screens by player\n");
+    printf("%-20s %9s %9s\n", "Player", "Sweeps", "Smoke");
+    for (int i = 0; i < count; i++)
+        printf("%-20.20s %9llu %9llu\n", reports[i].name, (unsigned long long)reports[i].sweeps, (unsigned long long)reports[i].smokes);
+}
+
+// Function to analyse an NDJSON game log with threadCount threads and print per-player reports
+int runAnalysis(const char *path, int threadCount)
+{
+#ifdef _WIN32
+    (void)path;
+    (void)threadCount;
+    printf("Log analysis is not supported on Windows.\n");
+    return 1;
+#else
+    LineRanges ranges;
+
+    if (!mapLineRanges(path, "log", threadCount, &ranges))
+        return 1;
+
+    AnalyzerWorker *workers = (AnalyzerWorker *)calloc((size_t)threadCount, sizeof(AnalyzerWorker));
+    pthread_t *threads = (pthread_t *)calloc((size_t)threadCount, sizeof(pthread_t));
+    if (workers == NULL || threads == NULL)
+    {
+        printf("Out of memory.\n");
+        free(workers);
+        free(threads);
+        unmapLineRanges(&ranges);
+        return 1;
+    }
+
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].data = ranges.data;
+        workers[t].size = ranges.size;
+        workers[t].start = ranges.bounds[t];
+        workers[t].end = ranges.bounds[t + 1];
+    }
+
+    // A range whose thread cannot be started is replayed on this thread instead
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].running = pthread_create(&threads[t], NULL, analyzerWorker, &workers[t]) == 0;
+        if (!workers[t].running)
+            analyzerWorker(&workers[t]);
+    }
+    for (int t = 0; t < threadCount; t++)
+    {
+        if (workers[t].running)
+            pthread_join(threads[t], NULL);
+    }
+
+    PlayerTable merged = {NULL, 0, 0};
+    uint64_t finished = 0, unfinished = 0;
+    for (int t = 0; t < threadCount; t++)
+    {
+        finished += workers[t].finished;
+        unfinished += workers[t].unfinished;
+        for (int i = 0; i < workers[t].players.capacity; i++)
+        {
+            const PlayerReport *from = &workers[t].players.slots[i];
+            PlayerReport *into = from->name[0] ? findPlayerReport(&merged, from->name) : NULL;
+            if (into != NULL)
+                mergePlayerReport(into, from);
+        }
+        free(workers[t].players.slots);
+        free(workers[t].games);
+        free(workers[t].gameSlots);
+    }
+
+    // Pack the reports together for sorting
+    int count = 0;
+    for (int i = 0; i < merged.capacity; i++)
+        if (merged.slots[i].name[0] != '\0')
+            merged.slots[count++] = merged.slots[i];
+    qsort(merged.slots, (size_t)count, sizeof(PlayerReport), comparePlayerReports);
+    printAnalysis(merged.slots, count, finished, unfinished);
+
+    free(merged.slots);
+    free(workers);
+    free(threads);
+    unmapLineRanges(&ranges);
+    return 0;
+#endif
+}
+
+// Opening book builder: plays the classic bot against random fleets for its
+// first OPENING_BOOK_DEPTH shots. Each hunting position it reaches is rated
+// once, from many sampled layouts, and the bot then plays from those ratings,
+// so the book holds the positions a bot using it actually meets. Positions met
+// fewer than OPENING_BOOK_MIN_VISITS times are left out of the file.
+#define OPENING_BOOK_DEPTH 12
+#define OPENING_BOOK_SAMPLES 2048 // Layouts drawn to rate one position
+#define OPENING_BOOK_MIN_VISITS 2
+
+typedef struct
+{
+    uint64_t visits; // 0 while the slot is free
+    OpeningBookEntry entry;
+} BookPosition;
+
+// Open addressing table of rated positions, sized for every position the games could reach
+typedef struct
+{
+    BookPosition *slots;
+    uint64_t capacity; // Power of two
+    uint64_t count;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} BookBuilder;
+
+typedef struct
+{
+    uint64_t firstGame, games, seed;
+    int running; // Set while the games are played on a thread of their own
+} BookWorker;
+
+BookBuilder bookBuilder;
+
+// Function to find a position's slot in the builder's table, a free slot if it is not there
+BookPosition *findBookPosition(uint64_t hash)
+{
+    uint64_t i = (hash * 0x9E3779B97F4A7C15ULL) & (bookBuilder.capacity - 1);
+
+    while (bookBuilder.slots[i].visits > 0 && bookBuilder.slots[i].entry.hash != hash)
+        i = (i + 1) & (bookBuilder.capacity - 1);
+    return &bookBuilder.slots[i];
+}
+
+// Function to copy a position's ratings into rating, rating it for the builder
+// the first time a bot reaches it. Returns 0 once the position is deeper than the book goes.
+int bookBuilderRatings(const Observation *view, uint8_t rating[GRID_SIZE * GRID_SIZE])
+{
+    double chance[GRID_SIZE * GRID_SIZE], best = 0.0;
+    BookPosition *position;
+    uint64_t visits;
+
+    if (bitboardCount(bitboardOr(view->hit, view->miss)) >= OPENING_BOOK_DEPTH)
+        return 0;
+
+    // Copy under the lock: once it is released a free slot may be filled with another position
+#ifndef _WIN32
+    pthread_mutex_lock(&bookBuilder.lock);
+#endif
+    position = findBookPosition(view->hash);
+    visits = position->visits;
+    if (visits > 0)
+    {
+        position->visits++;
+        memcpy(rating, position->entry.rating, GRID_SIZE * GRID_SIZE);
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&bookBuilder.lock);
+#endif
+    if (visits > 0)
+        return 1;
+
+    // Rate it without holding the lock; the sampling reseeds this thread's generator
+    uint64_t rng = rngState;
+    estimateHitChances(view, OPENING_BOOK_SAMPLES, chance);
+    rngState = rng;
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        if (chance[cell] > best)
+            best = chance[cell];
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+        rating[cell] = best > 0.0 ? (uint8_t)(chance[cell] / best * 255.0 + 0.5) : 0;
+
+#ifndef _WIN32
+    pthread_mutex_lock(&bookBuilder.lock);
+#endif
+    position = findBookPosition(view->hash); // Another thread may have rated it meanwhile
+    if (position->visits == 0)
+    {
+        position->entry.hash = view->hash;
+        memcpy(position->entry.rating, rating, GRID_SIZE * GRID_SIZE);
+        bookBuilder.count++;
+    }
+    else
+        memcpy(rating, position->entry.rating, GRID_SIZE * GRID_SIZE);
+    position->visits++;
+#ifndef _WIN32
+    pthread_mutex_unlock(&bookBuilder.lock);
+#endif
+    return 1;
+}
+
+// Thread entry point: play the openings of a range of games
+void *bookWorkerRun(void *arg)
+{
+    BookWorker *worker = (BookWorker *)arg;
+    PlayerState attacker, defender;
+    WorkerQuiet saved = enterWorkerQuiet(); // Put back for the builder's own thread
+
+    for (uint64_t g = 0; g < worker->games; g++)
+    {
+        seedGameRand(simulationGameSeed(worker->seed, worker->firstGame + g));
+        initializePlayer(&attacker, "Bot");
+        initializePlayer(&defender, "Fleet");
+        autoPlaceShips(defender.grid, defender.ships);
+        while (attacker.sunkTotal < fleet.count && bitboardCount(bitboardOr(attacker.view.hit, attacker.view.miss)) < OPENING_BOOK_DEPTH)
+        {
+            beginTurn(&attacker);
+            botTurn(&attacker, &defender, 1, NULL);
+            resolveTurn(&attacker, &defender, NULL);
+        }
+    }
+    leaveWorkerQuiet(saved);
+    return NULL;
+}
+
+// Function to order book entries by hash
+int compareBookEntries(const void *a, const void *b)
+{
+    uint64_t x = ((const OpeningBookEntry *)a)->hash, y = ((const OpeningBookEntry *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+// Function to build an opening book for the current fleet from the openings of games games
+int buildOpeningBook(const char *path, uint64_t games, int threadCount, uint64_t seed)
+{
+    double start = monotonicSeconds();
+    OpeningBookHeader header = {OPENING_BOOK_MAGIC, 0, OPENING_BOOK_DEPTH, (uint8_t)fleet.count, {0}, {0}};
+
+#ifdef _WIN32
+    threadCount = 1; // No worker threads on Windows
+#else
+    pthread_mutex_init(&bookBuilder.lock, NULL);
+#endif
+    bookBuilder.capacity = 1024;
+    while (bookBuilder.capacity < games * OPENING_BOOK_DEPTH * 2)
+        bookBuilder.capacity *= 2;
+    bookBuilder.slots = (BookPosition *)calloc(bookBuilder.capacity, sizeof(BookPosition));
+    BookWorker *workers = (BookWorker *)calloc((size_t)threadCount, sizeof(BookWorker));
+    if (bookBuilder.slots == NULL || workers == NULL)
+    {
+        printf("Out of memory.\n");
+        free(bookBuilder.slots);
+        free(workers);
+        return 1;
+    }
+
+    buildingOpeningBook = 1;
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].firstGame = games * (uint64_t)t / (uint64_t)threadCount;
+        workers[t].games = games * (uint64_t)(t + 1) / (uint64_t)threadCount - workers[t].firstGame;
+        workers[t].seed = seed;
+    }
+#ifndef _WIN32
+    // Games whose thread cannot be started are played on this thread instead
+    pthread_t *threads = (pthread_t *)calloc((size_t)threadCount, sizeof(pthread_t));
+    for (int t = 1; t < threadCount; t++)
+    {
+        workers[t].running = threads != NULL && pthread_create(&threads[t], NULL, bookWorkerRun, &workers[t]) == 0;
+        if (!workers[t].running)
+            bookWorkerRun(&workers[t]);
+    }
+#endif
+    bookWorkerRun(&workers[0]);
+#ifndef _WIN32
+    for (int t = 1; t < threadCount; t++)
+    {
+        if (workers[t].running)
+            pthread_join(threads[t], NULL);
+    }
+    free(threads);
+#endif
+    free(workers);
+    buildingOpeningBook = 0;
+
+    // Keep the positions met often enough, in hash order for binary search
+    OpeningBookEntry *entries = (OpeningBookEntry *)malloc((size_t)(bookBuilder.count + 1) * sizeof(OpeningBookEntry));
+    if (entries == NULL)
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    for (uint64_t i = 0; i < bookBuilder.capacity; i++)
+        if (bookBuilder.slots[i].visits >= OPENING_BOOK_MIN_VISITS)
+            entries[header.entries++] = bookBuilder.slots[i].entry;
+    qsort(entries, header.entries, sizeof(OpeningBookEntry), compareBookEntries);
+    for (int i = 0; i < fleet.count; i++)
+        header.fleetSizes[i] = (uint8_t)fleet.sizes[i];
+
+    FILE *file = fopen(path, "wb");
+    int ok = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(entries, sizeof(OpeningBookEntry), header.entries, file) == header.entries;
+    if (file != NULL && fclose(file) != 0)
+        ok = 0;
+    free(entries);
+    free(bookBuilder.slots);
+    if (!ok)
+    {
+        printf("Could not write opening book %s.\n", path);
+        return 1;
+    }
+
+    printf("Rated %llu positions from %llu games in %.1f s, kept the %u met at least %d times\n", (unsigned long long)bookBuilder.count,
+           (unsigned long long)games, monotonicSeconds() - start, header.entries, OPENING_BOOK_MIN_VISITS);
+    printf("Wrote %s (%llu bytes)\n", path, (unsigned long long)(sizeof(header) + header.entries * sizeof(OpeningBookEntry)));
+    return 0;
+}
+
+// Layout validator: checks files of submitted fleet layouts, one per line, as
+// "Carrier B3 H Battleship D5 V ..." with every ship of the fleet named once.
+// Rules are checked with masks: bounds with placementMask, overlap against the
+// cells taken so far and the no-touch rule against their neighbourhood. The
+// file is memory mapped and cut into one range of whole lines per thread; each
+// thread writes the errors of its own lines, printed in file order at the end.
+#define LAYOUT_SYNTAX 1 // A token is not a coordinate or orientation where one belongs
+#define LAYOUT_UNKNOWN_SHIP 2
+#define LAYOUT_DUPLICATE_SHIP 4
+#define LAYOUT_MISSING_SHIP 8
+#define LAYOUT_OUT_OF_BOUNDS 16
+#define LAYOUT_OVERLAP 32
+#define LAYOUT_TOUCHING 64
+#define LAYOUT_ERROR_KINDS 7
+#define LAYOUT_TOKEN_SIZE 24
+
+const char *layoutErrorNames[LAYOUT_ERROR_KINDS] = {"Syntax", "Unknown ship", "Duplicate ship", "Missing ship", "Out of bounds", "Overlap", "Touching"};
+
+// A submitted layout, by fleet index
+typedef struct
+{
+    int placed; // Bit i is set once ship i has a position
+    int row[MAX_SHIPS], col[MAX_SHIPS];
+    char orientation[MAX_SHIPS];
+} FleetLayout;
+
+typedef struct
+{
+    const char *data;
+    size_t start, end;
+    uint64_t firstLine; // Line number of the first line of the range
+    uint64_t layouts, valid;
+    uint64_t errors[LAYOUT_ERROR_KINDS];
+    char *report; // Error lines of this range
+    size_t reportLength, reportCapacity;
+    int running; // Set while the range is checked on a thread of its own
+} ValidatorWorker;
+
+BitBoard cellNeighbourhood[GRID_SIZE * GRID_SIZE]; // Each cell and the eight around it
+
+// Function to build the neighbourhood masks of every cell
+void buildCellNeighbourhoods()
+{
+    for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+    {
+        memset(&cellNeighbourhood[cell], 0, sizeof(BitBoard));
+        for (int i = cell / GRID_SIZE - 1; i <= cell / GRID_SIZE + 1; i++)
+            for (int j = cell % GRID_SIZE - 1; j <= cell % GRID_SIZE + 1; j++)
+                if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE)
+                    bitboardSet(&cellNeighbourhood[cell], CELL_INDEX(i, j));
+    }
+}
+
+// Function to add "; " and a formatted problem to a layout's description
+void appendLayoutError(char *detail, int size, const char *format, ...)
+{
+    int length = (int)strlen(detail);
+    va_list args;
+
+    if (length > 0 && length + 2 < size)
+    {
+        strcpy(detail + length, "; ");
+        length += 2;
+    }
+    va_start(args, format);
+    vsnprintf(detail + length, (size_t)(size - length), format, args);
+    va_end(args);
+}
+
+// Function to read the next token of a line into token, returns 0 at the end of the line
+int nextLayoutToken(const char **cursor, const char *end, char *token)
+{
+    const char *c = *cursor;
+    int length = 0;
+
+    while (c < end && isTokenSeparator(*c))
+        c++;
+    while (c < end && !isTokenSeparator(*c))
+    {
+        if (length < LAYOUT_TOKEN_SIZE - 1)
+            token[length] = (char)toupper((unsigned char)*c);
+        length++;
+        c++;
+    }
+    token[length < LAYOUT_TOKEN_SIZE ? length : LAYOUT_TOKEN_SIZE - 1] = '\0';
+    *cursor = c;
+    return length > 0;
+}
+
+// Function to read one layout line. Returns the LAYOUT_ bits of the problems found, described in detail.
+int parseFleetLayout(const char *line, const char *end, FleetLayout *layout, char *detail, int size)
+{
+    char name[LAYOUT_TOKEN_SIZE], coordinate[LAYOUT_TOKEN_SIZE], orientation[LAYOUT_TOKEN_SIZE];
+    int errors = 0;
+
+    layout->placed = 0;
+    while (nextLayoutToken(&line, end, name))
+    {
+        int ship = -1, named = 0; // named is one more than the fleet index of the name
+        for (int i = 0; i < fleet.count && ship < 0; i++)
+        {
+            int n = 0;
+            while (fleet.names[i][n] && toupper((unsigned char)fleet.names[i][n]) == name[n])
+                n++;
+            if (fleet.names[i][n] == '\0' && name[n] == '\0')
             {
-                if (trackingDifficulty == 1) // Only print and mark miss in easy mode
-                {
-                    printf("Miss at %c%d.\n", j + 'A', num + 1);
-                    grid[num][j] = 'o'; // Mark miss
-                }
+                named = i + 1;
+                if (!(layout->placed & (1 << i)))
+                    ship = i; // Fleets may repeat a name, take the first copy not placed yet
             }
         }
+
+        int row, col;
+        char axis;
+        if (!nextLayoutToken(&line, end, coordinate) || !nextLayoutToken(&line, end, orientation) ||
+            !parseCoordinate(coordinate, &row, &col) || !parseOrientation(orientation, &axis))
+        {
+            errors |= LAYOUT_SYNTAX;
+            appendLayoutError(detail, size, "expected a coordinate and H or V after %s", name);
+            return errors; // The rest of the line cannot be lined up with ships
+        }
+        if (ship >= 0)
+        {
+            layout->placed |= 1 << ship;
+            layout->row[ship] = row;
+            layout->col[ship] = col;
+            layout->orientation[ship] = axis;
+        }
+        else if (named)
+        {
+            errors |= LAYOUT_DUPLICATE_SHIP;
+            appendLayoutError(detail, size, "%s placed twice", fleet.names[named - 1]);
+        }
+        else
+        {
+            errors |= LAYOUT_UNKNOWN_SHIP;
+            appendLayoutError(detail, size, "no ship named %s in the fleet", name);
+        }
     }
-    else if (choice == 'C')
-    { // Column attack
-        printf("Firing torpedo at column %c\n", num + 'A');
-        for (int i = 0; i < GRID_SIZE; i++)
+    return errors;
+}
+
+// Function to check a layout against the fleet and the placement rules.
+// Returns the LAYOUT_ bits of the problems found, described in detail.
+int checkFleetLayout(const FleetLayout *layout, char *detail, int size)
+{
+    BitBoard neighbourhood = {{0, 0}}, masks[MAX_SHIPS]; // Cells next to or on the ships checked so far
+    int errors = 0;
+
+    for (int i = 0; i < fleet.count; i++)
+    {
+        if (!(layout->placed & (1 << i)))
         {
-            if (grid[i][num] == 'S')
+            errors |= LAYOUT_MISSING_SHIP;
+            appendLayoutError(detail, size, "%s missing", fleet.names[i]);
+            continue;
+        }
+        if (!placementMask(fleet.sizes[i], layout->row[i], layout->col[i], layout->orientation[i], &masks[i]))
+        {
+            errors |= LAYOUT_OUT_OF_BOUNDS;
+            appendLayoutError(detail, size, "%s leaves the board", fleet.names[i]);
+            continue;
+        }
+
+        // Name the ship it collides with only when there is a collision
+        if (!bitboardIsEmpty(bitboardAnd(masks[i], neighbourhood)))
+        {
+            for (int j = 0; j < i; j++)
             {
-                grid[i][num] = '*'; // Mark hit
-                hit = 1;
-                if (trackingDifficulty == 1) // Only print in easy mode
+                if (!(layout->placed & (1 << j)) || bitboardIsEmpty(masks[j]))
+                    continue;
+                if (!bitboardIsEmpty(bitboardAnd(masks[i], masks[j])))
                 {
-                    printf("Hit at %c%d!\n", num + 'A', i + 1);
+                    errors |= LAYOUT_OVERLAP;
+                    appendLayoutError(detail, size, "%s overlaps %s", fleet.names[i], fleet.names[j]);
                 }
-            }
-            else
-            {
-                if (trackingDifficulty == 1) // Only print and mark miss in easy mode
+                else
                 {
-                    printf("Miss at %c%d.\n", num + 'A', i + 1);
-                    grid[i][num] = 'o'; // Mark miss
+                    BitBoard around = {{0, 0}}, cells = masks[j];
+                    for (int cell = bitboardPopFirst(&cells); cell >= 0; cell = bitboardPopFirst(&cells))
+                        around = bitboardOr(around, cellNeighbourhood[cell]);
+                    if (!bitboardIsEmpty(bitboardAnd(masks[i], around)))
+                    {
+                        errors |= LAYOUT_TOUCHING;
+                        appendLayoutError(detail, size, "%s touches %s", fleet.names[i], fleet.names[j]);
+                    }
                 }
             }
         }
+
+        BitBoard cells = masks[i];
+        for (int cell = bitboardPopFirst(&cells); cell >= 0; cell = bitboardPopFirst(&cells))
+            neighbourhood = bitboardOr(neighbourhood, cellNeighbourhood[cell]);
+    }
+    return errors;
+}
+
+// Function to check fixed layouts of the standard fleet against the problems
+// they were written to have. Returns 0 when every one is found.
+int selfTestLayoutValidation()
+{
+    struct
+    {
+        const char *line;
+        int errors;
+    } cases[] = {
+        {"Carrier A1 H Battleship A3 H Destroyer A5 H Submarine A7 H", 0},
+        {"carrier a1 h battleship a3 h destroyer a5 h submarine j9 v", 0},
+        {"Carrier A1 H Battleship A2 H Destroyer A5 H Submarine A7 H", LAYOUT_TOUCHING},
+        {"Carrier A1 H Battleship C1 H Destroyer A5 H Submarine A7 H", LAYOUT_OVERLAP},
+        {"Carrier H1 H Battleship A3 H Destroyer A5 H Submarine A7 H", LAYOUT_OUT_OF_BOUNDS},
+        {"Carrier A1 H Battleship A3 H Destroyer A5 H Submarine A10 V", LAYOUT_OUT_OF_BOUNDS},
+        {"Carrier A1 H Carrier A3 H Battleship A5 H Destroyer A7 H Submarine A9 H", LAYOUT_DUPLICATE_SHIP},
+        {"Carrier A1 H Battleship A3 H Destroyer A5 H", LAYOUT_MISSING_SHIP},
+        {"Carrier A1 H Battleship A3 H Destroyer A5 H Submarine A7 H Zork C9 H", LAYOUT_UNKNOWN_SHIP},
+        {"Carrier A1 X Battleship A3 H Destroyer A5 H Submarine A7 H", LAYOUT_SYNTAX},
+    };
+    int count = (int)(sizeof(cases) / sizeof(cases[0])), failed = 0;
+    Fleet played = fleet;
+
+    fleet = fleetPresets[0].fleet; // The cases are written for the standard fleet
+    buildFleetKernels();
+    buildCellNeighbourhoods();
+    for (int i = 0; i < count; i++)
+    {
+        FleetLayout layout;
+        char detail[512] = "";
+        const char *end = cases[i].line + strlen(cases[i].line);
+        int errors = parseFleetLayout(cases[i].line, end, &layout, detail, sizeof(detail));
+        if (!(errors & LAYOUT_SYNTAX))
+            errors |= checkFleetLayout(&layout, detail, sizeof(detail));
+        if (errors != cases[i].errors)
+        {
+            printf("FAIL: layout \"%s\" gave errors %d, expected %d (%s)\n", cases[i].line, errors, cases[i].errors, detail);
+            failed = 1;
+        }
+    }
+    fleet = played;
+    buildFleetKernels();
+    if (!failed)
+        printf("ok: %d fixed layouts validated\n", count);
+    return failed;
+}
+
+// Thread entry point: check the layouts of this thread's range
+void *validatorWorker(void *arg)
+{
+    ValidatorWorker *worker = (ValidatorWorker *)arg;
+    const char *line = worker->data + worker->start, *rangeEnd = worker->data + worker->end;
+    uint64_t number = worker->firstLine;
+    FleetLayout layout;
+    char detail[512];
+
+    for (; line < rangeEnd; number++)
+    {
+        const char *end = (const char *)memchr(line, '\n', (size_t)(rangeEnd - line));
+        const char *next = end ? end + 1 : rangeEnd;
+        if (end == NULL)
+            end = rangeEnd;
+        const char *comment = (const char *)memchr(line, '#', (size_t)(end - line));
+        if (comment != NULL)
+            end = comment;
+
+        const char *c = line;
+        while (c < end && isTokenSeparator(*c))
+            c++;
+        if (c == end) // Blank or comment line
+        {
+            line = next;
+            continue;
+        }
+
+        detail[0] = '\0';
+        int errors = parseFleetLayout(line, end, &layout, detail, sizeof(detail));
+        if (!(errors & LAYOUT_SYNTAX))
+            errors |= checkFleetLayout(&layout, detail, sizeof(detail));
+        worker->layouts++;
+        if (errors == 0)
+            worker->valid++;
+        for (int kind = 0; kind < LAYOUT_ERROR_KINDS; kind++)
+            worker->errors[kind] += (errors >> kind) & 1;
+
+        if (errors != 0)
+        {
+            // Room for the line number, the detail and a newline
+            size_t needed = worker->reportLength + strlen(detail) + 32;
+            if (needed > worker->reportCapacity)
+            {
+                size_t capacity = worker->reportCapacity ? worker->reportCapacity : 4096;
+                while (capacity < needed)
+                    capacity *= 2;
+                char *grown = (char *)realloc(worker->report, capacity);
+                if (grown == NULL)
+                    return NULL; // The layouts counted so far are still reported
+                worker->report = grown;
+                worker->reportCapacity = capacity;
+            }
+            worker->reportLength += (size_t)sprintf(worker->report + worker->reportLength, "line %llu: %s\n", (unsigned long long)number, detail);
+        }
+        line = next;
+    }
+    return NULL;
+}
+
+// Function to check a file of fleet layouts with threadCount threads, print
+// each invalid layout's problems and a summary. Returns 1 if any layout is invalid.
+int runLayoutValidation(const char *path, int threadCount)
+{
+#ifdef _WIN32
+    (void)path;
+    (void)threadCount;
+    printf("Layout validation is not supported on Windows.\n");
+    return 1;
+#else
+    LineRanges ranges;
+
+    if (!mapLineRanges(path, "layout", threadCount, &ranges))
+        return 1;
+
+    ValidatorWorker *workers = (ValidatorWorker *)calloc((size_t)threadCount, sizeof(ValidatorWorker));
+    pthread_t *threads = (pthread_t *)calloc((size_t)threadCount, sizeof(pthread_t));
+    if (workers == NULL || threads == NULL)
+    {
+        printf("Out of memory.\n");
+        free(workers);
+        free(threads);
+        unmapLineRanges(&ranges);
+        return 1;
+    }
+    buildCellNeighbourhoods();
+    double start = monotonicSeconds();
+
+    // Count the lines before each range for the report
+    uint64_t lines = 1;
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].data = ranges.data;
+        workers[t].start = ranges.bounds[t];
+        workers[t].end = ranges.bounds[t + 1];
+        if (t > 0)
+        {
+            const char *c = ranges.data + ranges.bounds[t - 1], *stop = ranges.data + ranges.bounds[t];
+            for (; (c = (const char *)memchr(c, '\n', (size_t)(stop - c))) != NULL; c++)
+                lines++;
+        }
+        workers[t].firstLine = lines;
+    }
+
+    // A range whose thread cannot be started is checked on this thread instead
+    for (int t = 0; t < threadCount; t++)
+    {
+        workers[t].running = pthread_create(&threads[t], NULL, validatorWorker, &workers[t]) == 0;
+        if (!workers[t].running)
+            validatorWorker(&workers[t]);
+    }
+    for (int t = 0; t < threadCount; t++)
+    {
+        if (workers[t].running)
+            pthread_join(threads[t], NULL);
+    }
+    double elapsed = monotonicSeconds() - start;
+
+    uint64_t layouts = 0, valid = 0, errors[LAYOUT_ERROR_KINDS] = {0};
+    for (int t = 0; t < threadCount; t++)
+    {
+        if (workers[t].reportLength > 0)
+            fwrite(workers[t].report, 1, workers[t].reportLength, stdout);
+        layouts += workers[t].layouts;
+        valid += workers[t].valid;
+        for (int kind = 0; kind < LAYOUT_ERROR_KINDS; kind++)
+            errors[kind] += workers[t].errors[kind];
+        free(workers[t].report);
+    }
+
+    printf("Checked %llu layouts in %.3f s (%.0f per second): %llu valid, %llu invalid\n", (unsigned long long)layouts, elapsed,
+           elapsed > 0.0 ? (double)layouts / elapsed : 0.0, (unsigned long long)valid, (unsigned long long)(layouts - valid));
+    for (int kind = 0; kind < LAYOUT_ERROR_KINDS; kind++)
+        if (errors[kind] > 0)
+            printf("  %-15s %10llu layouts\n", layoutErrorNames[kind], (unsigned long long)errors[kind]);
+
+    free(workers);
+    free(threads);
+    unmapLineRanges(&ranges);
+    return layouts > valid;
+#endif
+}
+
+// Free-for-all: any number of players, each on its own board, and every turn
+// fires at one surviving opponent of the player's choice. A player keeps one
+// observation and one bot targeting state per opponent and they are swapped
+// into its PlayerState for the turn, so the moves and bots of the two player
+// game work unchanged and the special weapons keep their rules per player.
+// Turns go round a ring of the surviving players; an eliminated player is
+// unlinked in O(1) and never visited again. The bots of a round play at the
+// same time, each on copies of its own state and its target's board as they
+// stood when the round began, and their shots land on the real boards in turn
+// order, where sinks and eliminations are decided.
+#define MAX_FFA_PLAYERS 64
+
+int ffaThreads = 1; // Threads the bots of a round play on
+
+// What one player knows about and plans against one opponent
+typedef struct
+{
+    Observation view;
+    BotState bot;
+} FfaRivalry;
+
+typedef struct
+{
+    int count;
+    int trackingDifficulty;
+    uint64_t seed;
+    int round;
+    PlayerState players[MAX_FFA_PLAYERS];
+    int isBot[MAX_FFA_PLAYERS];
+    FfaRivalry *rivalries; // [attacker * count + defender]
+    int next[MAX_FFA_PLAYERS], previous[MAX_FFA_PLAYERS]; // Ring of the surviving players in turn order
+    int first;                                             // Player who opens each round
+    int alive;
+    int eliminatedBy[MAX_FFA_PLAYERS]; // -1 while the player is in the game
+    int place[MAX_FFA_PLAYERS];        // Finishing place, 1 for the winner
+} FfaGame;
+
+// A bot's turn of the current round, played on copies
+typedef struct
+{
+    int player;
+    int target;
+    PlayerState self;   // The bot, with its view of the target swapped in
+    PlayerState board;  // The target, with its view of the bot swapped in
+    ShotReport report;
+} FfaBotTurn;
+
+// Round of bot turns shared by the threads that play them
+typedef struct
+{
+    const FfaGame *game;
+    FfaBotTurn *turns;
+    int count;
+    int nextTurn; // Next turn to hand out, taken atomically
+} FfaRound;
+
+// Threads that stay up for a whole game and play the bot turns of each round
+// with the game's own thread. A round is handed out by bumping generation.
+typedef struct
+{
+    FfaRound round;
+    int threadCount; // Threads playing rounds, the game's own included
+#ifndef _WIN32
+    int generation; // Round the pool threads were last woken for
+    int finished;   // Pool threads done with the current round
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t roundReady, roundDone;
+    pthread_t threads[MAX_FFA_PLAYERS];
+#endif
+} FfaPool;
+
+// Function to find what attacker knows about and plans against defender
+FfaRivalry *ffaRivalry(const FfaGame *game, int attacker, int defender)
+{
+    return &game->rivalries[attacker * game->count + defender];
+}
+
+// Function to set up a game of count players, all still to place their fleets.
+// Returns 0 if memory runs out.
+int initializeFfaGame(FfaGame *game, int count, int trackingDifficulty, uint64_t seed)
+{
+    game->count = count;
+    game->trackingDifficulty = trackingDifficulty;
+    game->seed = seed;
+    game->round = 0;
+    game->alive = count;
+    game->rivalries = (FfaRivalry *)malloc(sizeof(FfaRivalry) * (size_t)count * (size_t)count);
+    if (game->rivalries == NULL)
+        return 0;
+
+    for (int p = 0; p < count; p++)
+    {
+        game->next[p] = (p + 1) % count;
+        game->previous[p] = (p + count - 1) % count;
+        game->eliminatedBy[p] = -1;
+        game->place[p] = 0;
+        for (int q = 0; q < count; q++)
+        {
+            initializeObservation(&ffaRivalry(game, p, q)->view);
+            initializeBotState(&ffaRivalry(game, p, q)->bot);
+        }
+    }
+    game->first = 0;
+    return 1;
+}
+
+// Function to teach a view every sinking announced on the defender's board
+void ffaLearnSinkings(Observation *view, const PlayerState *defender)
+{
+    for (int i = 0; i < fleet.count; i++)
+        if (defender->ships[i].sunk == 0) // resolveTurn clears the flag once it announces the sinking
+            observeSunk(view, &defender->ships[i], i);
+}
+
+// Function to take an eliminated player out of the turn ring
+void ffaEliminate(FfaGame *game, int player, int by)
+{
+    game->eliminatedBy[player] = by;
+    game->place[player] = game->alive--;
+    game->next[game->previous[player]] = game->next[player];
+    game->previous[game->next[player]] = game->previous[player];
+    if (game->first == player)
+        game->first = game->next[player];
+    if (game->alive == 1)
+        game->place[game->next[player]] = 1;
+}
+
+// Function to choose the opponent a bot attacks: the one it is finishing off
+// a ship of, else the one with the most sunk or damaged ships
+int ffaChooseTarget(const FfaGame *game, int player)
+{
+    int best = -1, bestScore = -1;
+
+    for (int q = game->next[player]; q != player; q = game->next[q])
+    {
+        const FfaRivalry *rivalry = ffaRivalry(game, player, q);
+        if (rivalry->bot.lastHitRow != -1 || rivalry->bot.torpedoTurns > 0)
+            return q;
+
+        int score = __builtin_popcount((unsigned)rivalry->view.sunkShips) * GRID_SIZE * GRID_SIZE +
+                    bitboardCount(bitboardAndNot(rivalry->view.hit, rivalry->view.sunk));
+        if (score > bestScore)
+        {
+            bestScore = score;
+            best = q;
+        }
+    }
+    return best;
+}
+
+// Function to load the states a turn of player against target works on
+void ffaLoadTurn(const FfaGame *game, int player, int target, PlayerState *self, PlayerState *board)
+{
+    self->view = ffaRivalry(game, player, target)->view;
+    self->bot = ffaRivalry(game, player, target)->bot;
+    board->view = ffaRivalry(game, target, player)->view; // The smoke planner reads what the target knows
+}
+
+// Function to play a bot's turn of the round on copies of the boards. Each
+// turn has its own random stream, so results do not depend on the threads.
+void ffaPlayBotTurn(const FfaGame *game, FfaBotTurn *turn)
+{
+    seedGameRand(simulationGameSeed(game->seed, (uint64_t)game->round * MAX_FFA_PLAYERS + (uint64_t)turn->player));
+    turn->target = ffaChooseTarget(game, turn->player);
+    turn->self = game->players[turn->player];
+    turn->board = game->players[turn->target];
+    ffaLoadTurn(game, turn->player, turn->target, &turn->self, &turn->board);
+    beginTurn(&turn->self);
+    playBotTurn(opponentBot, &turn->self, &turn->board, game->trackingDifficulty, &turn->report);
+}
+
+// Function to play bot turns of the round until none are left to claim
+void ffaPlayRound(FfaRound *round)
+{
+    for (int t; (t = __atomic_fetch_add(&round->nextTurn, 1, __ATOMIC_RELAXED)) < round->count;)
+        ffaPlayBotTurn(round->game, &round->turns[t]);
+}
+
+#ifndef _WIN32
+// Thread entry point: plays its share of every round until the pool stops
+void *ffaPoolWorker(void *arg)
+{
+    FfaPool *pool = (FfaPool *)arg;
+    WorkerQuiet saved = enterWorkerQuiet();
+    int seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        while (pool->generation == seen && !pool->stopping)
+            pthread_cond_wait(&pool->roundReady, &pool->lock);
+        if (pool->stopping)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        ffaPlayRound(&pool->round);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->threadCount - 1)
+            pthread_cond_signal(&pool->roundDone);
     }
+    pthread_mutex_unlock(&pool->lock);
+    flushDecisionCounters();
+    leaveWorkerQuiet(saved);
+    return NULL;
+}
+#endif
+
+// Function to start the pool threads for a game of count players, as many as
+// ffaThreads asks for, a round can use and there are processors to run them.
+// A bot turn takes microseconds, so a thread beyond the processors only adds
+// handovers. Threads that cannot be started are done without; the others play their share.
+void startFfaPool(FfaPool *pool, int count)
+{
+    int wanted = ffaThreads < count ? ffaThreads : count;
+
+    pool->threadCount = 1;
+#ifndef _WIN32
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if (processors > 0 && wanted > processors)
+        wanted = (int)processors;
+    pool->generation = 0;
+    pool->finished = 0;
+    pool->stopping = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->roundReady, NULL);
+    pthread_cond_init(&pool->roundDone, NULL);
+    while (pool->threadCount < wanted && pthread_create(&pool->threads[pool->threadCount], NULL, ffaPoolWorker, pool) == 0)
+        pool->threadCount++;
+#else
+    (void)wanted;
+#endif
+}
 
-    return hit;
+// Function to stop and join the pool threads
+void stopFfaPool(FfaPool *pool)
+{
+#ifndef _WIN32
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->roundReady);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 1; t < pool->threadCount; t++)
+        pthread_join(pool->threads[t], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->roundReady);
+    pthread_cond_destroy(&pool->roundDone);
+#else
+    (void)pool;
+#endif
 }
-void radarSweep(char grid[GRID_SIZE][GRID_SIZE], int smokeGrid[GRID_SIZE][GRID_SIZE], int row, int col)
+
+// Function to settle a turn of player against target on the real boards:
+// report sinkings, announce them to every player and remove a sunk fleet
+void ffaResolveTurn(FfaGame *game, int player, int target)
 {
-    printf("Performing radar sweep on area %c%d to %c%d\n", col + 'A', row + 1, col + 'A' + 1, row + 2);
-    int foundShip = 0;
+    PlayerState *self = &game->players[player];
+    PlayerState *defender = &game->players[target];
+    FfaRivalry *rivalry = ffaRivalry(game, player, target);
 
-    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
+    // resolveTurn's own message speaks to the attacker alone, name both sides instead
+    int sunkShips[MAX_SHIPS], quiet = quietOutput;
+    quietOutput = 1;
+    int sunk = resolveTurn(self, defender, sunkShips);
+    quietOutput = quiet;
+    for (int i = 0; i < sunk && !quietOutput; i++)
+        printf("%s sunk %s's %s!\n", self->name, defender->name, fleet.names[sunkShips[i]]);
+    if (sunk > 0)
+        for (int q = game->next[target]; q != target; q = game->next[q])
+            ffaLearnSinkings(&ffaRivalry(game, q, target)->view, defender);
+    rivalry->view = self->view;
+    rivalry->bot = self->bot;
+
+    if (game->eliminatedBy[target] < 0 && allShipsSunk(defender->grid))
     {
-        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
-        {
-            if (smokeGrid[i][j] == 0 && grid[i][j] == 'S') // Skip cells that are under smoke
-            {
-                foundShip = 1;
-            }
-        }
+        if (!quietOutput)
+            printf("%s has been eliminated by %s!\n", defender->name, self->name);
+        ffaEliminate(game, target, player);
     }
+}
 
-    if (foundShip)
+// Function to land a bot's turn played on copies. Its own state comes back
+// whole but for its fleet, which other players may have hit since; shots
+// become marks on the target's real board.
+void ffaApplyBotTurn(FfaGame *game, FfaBotTurn *turn)
+{
+    const char *weaponNames[NUM_WEAPONS] = {"Fire", "Artillery", "Torpedo"};
+    PlayerState *self = &game->players[turn->player];
+    PlayerState *defender = &game->players[turn->target];
+    int radarUsed = turn->self.radarUses < self->radarUses;
+    int smokeUsed = turn->self.smokeScreenUses < self->smokeScreenUses;
+
+    memcpy(turn->self.grid, self->grid, sizeof(self->grid));
+    memcpy(turn->self.ships, self->ships, sizeof(self->ships));
+    *self = turn->self;
+    ffaLearnSinkings(&self->view, defender); // Sinkings announced since the round began
+
+    for (int i = 0; i < GRID_SIZE; i++)
+        for (int j = 0; j < GRID_SIZE; j++)
+            if (turn->board.grid[i][j] == '*' || turn->board.grid[i][j] == 'o')
+                defender->grid[i][j] = turn->board.grid[i][j];
+
+    if (!quietOutput)
     {
-        printf("Enemy ships found in the area.\n");
+        if (radarUsed)
+            printf("%s sweeps %s's waters with radar.\n", self->name, defender->name);
+        else if (smokeUsed)
+            printf("%s lays a smoke screen.\n", self->name);
+        else
+            printf("%s attacks %s with %s: %d hit%s.\n", self->name, defender->name, weaponNames[turn->report.weapon],
+                   turn->report.hits, turn->report.hits == 1 ? "" : "s");
     }
-    else
+    ffaResolveTurn(game, turn->player, turn->target);
+}
+
+// Function to play the bot turns of a round at once, on the pool's threads and this one
+void ffaPlayBotTurns(FfaPool *pool, FfaGame *game, FfaBotTurn *turns, int count)
+{
+    WorkerQuiet saved;
+
+    pool->round = (FfaRound){game, turns, count, 0};
+#ifndef _WIN32
+    if (pool->threadCount > 1)
     {
-        printf("No enemy ships found in the area.\n");
+        pthread_mutex_lock(&pool->lock);
+        pool->finished = 0;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->roundReady);
+        pthread_mutex_unlock(&pool->lock);
     }
+#endif
+    saved = enterWorkerQuiet();
+    ffaPlayRound(&pool->round);
+    leaveWorkerQuiet(saved);
+#ifndef _WIN32
+    // The round is reused for the next one, so every pool thread must be done with it
+    if (pool->threadCount > 1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->finished < pool->threadCount - 1)
+            pthread_cond_wait(&pool->roundDone, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+#endif
 }
 
-void smokeScreen(int smokeDurationGrid[GRID_SIZE][GRID_SIZE], int row, int col)
+// Function to ask a human which surviving opponent to attack
+int ffaAskForTarget(const FfaGame *game, int player, InputReader *input)
 {
-    printf("Deploying smoke screen on area %c%d to %c%d\n", col + 'A', row + 1, col + 'A' + 1, row + 2);
-    for (int i = row; i < row + 2 && i < GRID_SIZE; i++)
- {
-        for (int j = col; j < col + 2 && j < GRID_SIZE; j++)
+    Command command;
+
+    if (game->alive == 2)
+        return game->next[player];
+    while (1)
+    {
+        if (!inputPending(input))
         {
-            smokeDurationGrid[i][j] = 1; // Set smoke duration for 1 round
+            printf("Choose your target:");
+            for (int q = game->next[player]; q != player; q = game->next[q])
+                printf(" %d for %s%s", q + 1, game->players[q].name, game->next[q] == player ? ": " : ",");
         }
+
+        int status = readCommand(input, &command);
+        if (status == 0)
+            inputClosed();
+
+        int target = command.number - 1;
+        if (status > 0 && command.type == CMD_NUMBER && target >= 0 && target < game->count && target != player &&
+            game->eliminatedBy[target] < 0)
+            return target;
+        else if (status > 0)
+            printf("Invalid input. Please enter the number of a player still in the game.\n");
     }
 }
 
-void reduceSmokeDuration(int smokeDurationGrid[GRID_SIZE][GRID_SIZE])
+// Function to play a human's turn against the opponent they choose
+void ffaPlayHumanTurn(FfaGame *game, int player, InputReader *input)
 {
-    for (int i = 0; i < GRID_SIZE; i++)
-    {
-        for (int j = 0; j < GRID_SIZE; j++)
-        {
-            if (smokeDurationGrid[i][j] > 0) // If smoke is active
-            {
-                smokeDurationGrid[i][j]--; // Decrease duration
-            }
-        }
-    }
+    PlayerState *self = &game->players[player];
+
+    printf("%s's turn!\n", self->name);
+    beginTurn(self);
+    int target = ffaAskForTarget(game, player, input);
+    ffaLoadTurn(game, player, target, self, &game->players[target]);
+    displayGrid(&self->view, game->trackingDifficulty);
+    performMove(self, &game->players[target], game->trackingDifficulty, input);
+    ffaResolveTurn(game, player, target);
 }
-// Move handler
-void performMove(
-    char grid[GRID_SIZE][GRID_SIZE],
-    Ship ships[NUM_SHIPS],
-    int *radarUses,
-    int *smokeScreenUses,
-    int mySmokeDurationGrid[GRID_SIZE][GRID_SIZE],
-    int opponentSmokeDurationGrid[GRID_SIZE][GRID_SIZE],
-    int trackingDifficulty,
-    int *sunkTotal,
-    int *artilleryLifetime,
-    int *torpedoLifetime)
-{
-    char move[INPUT_SIZE];
-    int row, col;
-    int validMove = 0; // Flag to check if a valid move was chosen
 
-    while (!validMove) // Loop until a valid move is chosen
+// Function to play rounds until one fleet is left, returns the winner.
+// input is only read when some players are human.
+int playFfaGame(FfaGame *game, InputReader *input)
+{
+    FfaBotTurn *turns = (FfaBotTurn *)malloc(sizeof(FfaBotTurn) * (size_t)game->count);
+    int order[MAX_FFA_PLAYERS], slot[MAX_FFA_PLAYERS];
+    FfaPool pool;
+
+    if (turns == NULL)
     {
-        printf("Choose your move (Fire, Radar, Smoke, Artillery, Torpedo): ");
-        fgets(move, sizeof(move), stdin);
-        move[strcspn(move, "\n")] = '\0';
+        printf("Out of memory.\n");
+        return -1;
+    }
+    startFfaPool(&pool, game->count);
 
-        // Convert move to uppercase for case insensitivity
-        for (int i = 0; move[i]; i++)
-        {
-            move[i] = toupper(move[i]);
-        }
+    while (game->alive > 1)
+    {
+        int players = 0, bots = 0, p = game->first;
+        TRACE_SCOPE(TRACE_TURN);
 
-        if (strncmp(move, "FIRE", 4) == 0)
-        {
-            getFiringCoordinates(&row, &col);
-            fireAtCoordinate(grid, row, col, ships, trackingDifficulty);
-            validMove = 1; // Mark the move as valid
-        }
-        else if (strncmp(move, "RADAR", 5) == 0)
+        game->round++;
+        do
         {
-            if (*radarUses > 0)
+            order[players++] = p;
+            if (game->isBot[p])
             {
-                // Get the coordinates and perform the radar sweep
-                getFiringCoordinates(&row, &col);
-                radarSweep(grid, opponentSmokeDurationGrid, row, col); // Perform radar sweep
-                (*radarUses)--;                                        // Decrease the available radar uses for the current player
-                validMove = 1;                                         // Mark the move as valid
+                turns[bots].player = p;
+                slot[p] = bots++;
             }
-            else
-            {
-                printf("No radar sweeps left!\n");
-            }
-        }
-        else if (strncmp(move, "SMOKE", 5) == 0)
+            p = game->next[p];
+        } while (p != game->first);
+        ffaPlayBotTurns(&pool, game, turns, bots);
+
+        for (int k = 0; k < players && game->alive > 1; k++)
         {
-            if (*smokeScreenUses > 0)
+            p = order[k];
+            if (game->eliminatedBy[p] >= 0)
+                continue;
+            logTurn(p);
+            if (!game->isBot[p])
             {
-                // Get the coordinates and deploy the smoke screen
-                getFiringCoordinates(&row, &col);
-                smokeScreen(mySmokeDurationGrid, row, col); // Set the smoke duration
-                (*smokeScreenUses)--;                       // Decrease the available smoke screen uses for the current player
-                validMove = 1;                              // Mark the move as valid
+                ffaPlayHumanTurn(game, p, input);
+                printf("Switching turns...\n");
+                pauseBetweenTurns();
+                clearScreen();
+                continue;
             }
-            else
+
+            // Play again on the boards as they are now if the target went down earlier this round
+            FfaBotTurn *turn = &turns[slot[p]];
+            if (game->eliminatedBy[turn->target] >= 0)
             {
-                printf("No smoke screens left!\n");
+                int quiet = quietOutput;
+                quietOutput = 1;
+                ffaPlayBotTurn(game, turn);
+                quietOutput = quiet;
             }
+            ffaApplyBotTurn(game, turn);
         }
-        else if (strncmp(move, "ARTILLERY", 9) == 0 && *artilleryLifetime > 0)
+    }
+
+    stopFfaPool(&pool);
+    free(turns);
+    return game->first;
+}
+
+// Function to set up and play a free-for-all at the terminal
+void runFfaGame(InputReader *input)
+{
+    FfaGame *game = (FfaGame *)malloc(sizeof(FfaGame));
+    Command command;
+    int count = 0;
+
+    while (count == 0)
+    {
+        if (!inputPending(input))
+            printf("How many players (2 to %d)? ", MAX_FFA_PLAYERS);
+        int status = readCommand(input, &command);
+        if (status == 0)
+            inputClosed();
+        if (status > 0 && command.type == CMD_NUMBER && command.number >= 2 && command.number <= MAX_FFA_PLAYERS)
+            count = command.number;
+        else if (status > 0)
+            printf("Invalid input. Please enter a number from 2 to %d.\n", MAX_FFA_PLAYERS);
+    }
+    if (game == NULL || !initializeFfaGame(game, count, 1, ((uint64_t)gameRand() << 32) | gameRand()))
+    {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+
+    for (int p = 0; p < count; p++)
+    {
+        char name[NAME_SIZE];
+
+        if (!inputPending(input))
+            printf("Enter Player %d's name, or BOT for a bot: ", p + 1);
+        if (!readInputLine(input, name, sizeof(name)))
+            inputClosed();
+        game->isBot[p] = strcmp(name, "BOT") == 0;
+        if (game->isBot[p])
+            snprintf(name, sizeof(name), "Bot %d", p + 1);
+        initializePlayer(&game->players[p], name);
+    }
+    game->trackingDifficulty = askForTrackingDifficulty(input);
+
+    for (int p = 0; p < count; p++)
+    {
+        PlayerState *player = &game->players[p];
+        if (game->isBot[p])
         {
-            getFiringCoordinates(&row, &col);
-            artilleryStrike(grid, row, col, trackingDifficulty);
-            printf("Artillery used successfully!\n");
-            *artilleryLifetime = 0; // Deactivate after use
-            validMove = 1;          // Mark the move as valid
+            printf("%s is placing ships...\n", player->name);
+            logPlayer = p;
+            placeBotFleet(player->grid, player->ships);
+            continue;
         }
-        else if (strncmp(move, "TORPEDO", 7) == 0 && *torpedoLifetime > 0 && *sunkTotal >= 3)
-        {
-            char choice;
-            int isValidInput = 0; // Flag to check if input is valid
+        printf("%s, place your ships.\n", player->name);
+        for (int i = 0; i < fleet.count; i++)
+            placeShip(player->grid, player->ships, i, input);
+        clearScreen(); // Hide the fleet from the next player
+    }
 
-            // Loop until valid input for row (R) or column (C)
-            while (!isValidInput)
-            {
-                printf("Choose row (R) or column (C): ");
-                scanf(" %c", &choice);
-                choice = toupper(choice); // Make case insensitive
+    game->first = gameRand() % count;
+    printf("%s goes first!\n", game->players[game->first].name);
 
-                if (choice == 'R' || choice == 'C') // Check if input is 'R' or 'C'
-                {
-                    isValidInput = 1; // Valid input
-                }
-                else
-                {
-                    printf("Invalid choice. Please enter 'R' for row or 'C' for column.\n");
-                }
-            }
+    int winner = playFfaGame(game, input);
+    if (winner >= 0)
+        printf("%s wins! Every other fleet has been sunk!\n", game->players[winner].name);
+    free(game->rivalries);
+    free(game);
+}
 
-            if (choice == 'R')
-            {
-                isValidInput = 0; // Reset flag for row validation
-                while (!isValidInput)
-                {
-                    printf("Enter row number (1-10): ");
-                    if (scanf("%d", &row) == 1 && row >= 1 && row <= 10) // Check if input is a valid number
-                    {
-                        isValidInput = 1; // Valid input
-                    }
-                    else
-                    {
-                        printf("Invalid row. Please enter a number between 1 and 10.\n");
-                        clearInputBuffer(); // Clear invalid input
-                    }
-                }
-                torpedoAttack(grid, 'R', row - 1, trackingDifficulty); // Perform row attack
-                printf("Torpedo used successfully on row %d!\n", row);
-                *torpedoLifetime = 0; // Deactivate after use
-                validMove = 1;        // Mark the move as valid
-            }
-            else if (choice == 'C')
-            {
-                isValidInput = 0; // Reset flag for column validation
-                char colChar;
-                while (!isValidInput)
-                {
-                    printf("Enter column letter (A-J): ");
-                    scanf(" %c", &colChar);
-                    colChar = toupper(colChar); // Convert to uppercase
+// Function to play a silent free-for-all of bots and print how it went
+int runFfaSimulation(int count, uint64_t seed)
+{
+    FfaGame *game = (FfaGame *)malloc(sizeof(FfaGame));
 
-                    if (colChar >= 'A' && colChar <= 'J') // Check if input is a valid column letter
-                    {
-                        isValidInput = 1;                                            // Valid input
-                        torpedoAttack(grid, 'C', colChar - 'A', trackingDifficulty); // Perform column attack
-                        printf("Torpedo used successfully on column %c!\n", colChar);
-                        *torpedoLifetime = 0; // Deactivate after use
-                        validMove = 1;        // Mark the move as valid
-                    }
-                    else
-                    {
-                        printf("Invalid column. Please enter a letter between A and J.\n");
-                    }
-                }
-            }
-            clearInputBuffer(); // Clear the input buffer after scanf
-        }
-        else
+    if (game == NULL || !initializeFfaGame(game, count, 2, seed))
+    {
+        printf("Out of memory.\n");
+        return 1;
+    }
+
+    quietOutput = 1;
+    seedGameRand(seed);
+    for (int p = 0; p < count; p++)
+    {
+        char name[NAME_SIZE];
+        snprintf(name, sizeof(name), "Bot %d", p + 1);
+        initializePlayer(&game->players[p], name);
+        game->isBot[p] = 1;
+        logPlayer = p;
+        placeBotFleet(game->players[p].grid, game->players[p].ships);
+    }
+    game->first = gameRand() % count;
+
+    double start = monotonicSeconds();
+    int winner = playFfaGame(game, NULL);
+    double seconds = monotonicSeconds() - start;
+    quietOutput = 0;
+
+    printf("Free-for-all of %d bots: %s wins after %d rounds (%.1f ms, %.1f us per round).\n\n", count,
+           game->players[winner].name, game->round, seconds * 1000.0, seconds * 1e6 / game->round);
+    printf("Place  Player      Ships sunk  Eliminated by\n");
+    for (int place = 1; place <= count; place++)
+    {
+        for (int p = 0; p < count; p++)
         {
-            printf("Invalid move! Please enter a valid move.\n");
+            if (game->place[p] != place)
+                continue;
+            printf("%5d  %-10s  %10d  %s\n", place, game->players[p].name, game->players[p].sunkTotal,
+                   game->eliminatedBy[p] >= 0 ? game->players[game->eliminatedBy[p]].name : "-");
         }
     }
+    free(game->rivalries);
+    free(game);
+    return 0;
 }
-int isAdjacent(char grid[GRID_SIZE][GRID_SIZE], int row, int col, int shipSize, char orientation)
+
+// Load generator: runs many interactive games at once, each in its own
+// process on pipes, answers their prompts as a Player vs Bot human would and
+// measures how long the game takes to come back with the next prompt.
+#define LOAD_OUTPUT_SIZE 65536
+
+#define LOAD_PROMPT_START 0 // From spawning the game to its first prompt
+#define LOAD_PROMPT_SETUP 1 // Game mode, name, difficulty and placement prompts
+#define LOAD_PROMPT_MOVE 2  // Move prompts, the wait includes the bot's turn
+#define LOAD_PROMPT_KINDS 3
+
+typedef struct
 {
-    int directions[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+#ifndef _WIN32
+    pid_t pid;
+#endif
+    int toGame, fromGame;  // Pipe ends, -1 once closed
+    char output[LOAD_OUTPUT_SIZE]; // Output since the last answer
+    int length;
+    int promptKind;        // Kind of prompt being waited for
+    double askedAt;        // When the last answer was written
+    double startedAt;
+    int shipsPlaced;
+    Ship layout[MAX_SHIPS];
+    unsigned char targets[GRID_SIZE * GRID_SIZE]; // Shuffled cells still to fire at
+    int targetCount;
+    int turnSwitches;      // "Switching turns..." lines seen
+} LoadSession;
 
-    if (orientation == 'H')
+typedef struct
+{
+    QuantileSketch latency[LOAD_PROMPT_KINDS]; // Microseconds
+    QuantileSketch wallPerGame;                // Milliseconds
+    QuantileSketch cpuPerGame;                 // Milliseconds, game process and its children
+    uint64_t games, failed;
+    uint64_t turnSwitches;
+    double userSeconds, systemSeconds;
+} LoadStats;
+
+// Function to count the lines of output that mark a pause between turns
+int countTurnSwitches(const char *text, int length)
+{
+    const char *marker = "Switching turns...";
+    int markerLength = (int)strlen(marker), count = 0;
+
+    for (int i = 0; i + markerLength <= length; i++)
     {
-        for (int i = 0; i < shipSize; i++)
+        if (text[i] == 'S' && memcmp(text + i, marker, (size_t)markerLength) == 0)
+            count++;
+    }
+    return count;
+}
+
+// Function to find the answer to the prompt at the end of a session's output, returns 0 if it is not a known prompt
+int answerPrompt(LoadSession *session, int sessionIndex, char *answer, int size)
+{
+    session->output[session->length] = '\0';
+    char *prompt = strrchr(session->output, '\n');
+    prompt = prompt ? prompt + 1 : session->output;
+
+    if (strstr(prompt, "game mode"))
+    {
+        session->promptKind = LOAD_PROMPT_SETUP;
+        return snprintf(answer, size, "2\n");
+    }
+    if (strstr(prompt, "name"))
+    {
+        session->promptKind = LOAD_PROMPT_SETUP;
+        return snprintf(answer, size, "Load %d\n", sessionIndex);
+    }
+    if (strstr(prompt, "difficulty"))
+    {
+        session->promptKind = LOAD_PROMPT_SETUP;
+        return snprintf(answer, size, "%d\n", gameRand() % 2 + 1);
+    }
+    if (strstr(prompt, "orientation") && session->shipsPlaced < fleet.count)
+    {
+        const Ship *ship = &session->layout[session->shipsPlaced++];
+        char orientation = ship->coords[1][0] == ship->coords[0][0] ? 'H' : 'V';
+        session->promptKind = LOAD_PROMPT_SETUP;
+        return snprintf(answer, size, "%c%d %c\n", ship->coords[0][1] + 'A', ship->coords[0][0] + 1, orientation);
+    }
+    if (strstr(prompt, "Choose your move") && session->targetCount > 0)
+    {
+        int cell = session->targets[--session->targetCount];
+        session->promptKind = LOAD_PROMPT_MOVE;
+        return snprintf(answer, size, "FIRE %c%d\n", cell % GRID_SIZE + 'A', cell / GRID_SIZE + 1);
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+// Function to start one game process with the given arguments, returns 0 on failure
+int startLoadSession(LoadSession *session, char *const gameArgs[])
+{
+    int input[2], output[2];
+    char grid[GRID_SIZE][GRID_SIZE];
+
+    if (pipe(input) != 0)
+        return 0;
+    if (pipe(output) != 0)
+    {
+        close(input[0]);
+        close(input[1]);
+        return 0;
+    }
+
+    session->pid = fork();
+    if (session->pid == 0)
+    {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(input[0], 0);
+        dup2(output[1], 1);
+        if (devNull >= 0)
+            dup2(devNull, 2); // clear complains on stderr without a terminal
+        close(input[0]);
+        close(input[1]);
+        close(output[0]);
+        close(output[1]);
+        execv("/proc/self/exe", gameArgs);
+        execvp(gameArgs[0], gameArgs);
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+    if (session->pid < 0)
+    {
+        close(input[1]);
+        close(output[0]);
+        return 0;
+    }
+
+    session->toGame = input[1];
+    session->fromGame = output[0];
+    fcntl(session->fromGame, F_SETFL, fcntl(session->fromGame, F_GETFL) | O_NONBLOCK);
+    session->length = 0;
+    session->promptKind = LOAD_PROMPT_START;
+    session->startedAt = session->askedAt = monotonicSeconds();
+    session->shipsPlaced = 0;
+    session->turnSwitches = 0;
+
+    // A random legal fleet and a random firing order
+    initializeGrid(grid);
+    for (int i = 0; i < fleet.count; i++)
+        autoPlaceSingleShip(grid, &session->layout[i], fleet.sizes[i], fleet.names[i]);
+    session->targetCount = GRID_SIZE * GRID_SIZE;
+    for (int i = 0; i < session->targetCount; i++)
+        session->targets[i] = (unsigned char)i;
+    for (int i = session->targetCount - 1; i > 0; i--)
+    {
+        int j = gameRand() % (i + 1);
+        unsigned char swap = session->targets[i];
+        session->targets[i] = session->targets[j];
+        session->targets[j] = swap;
+    }
+    return 1;
+}
+
+// Function to reap a finished game and add its costs to the stats
+void finishLoadSession(LoadSession *session, int failed, LoadStats *stats)
+{
+    struct rusage usage;
+    int status = 0;
+
+    if (session->toGame >= 0)
+        close(session->toGame);
+    close(session->fromGame);
+    session->toGame = session->fromGame = -1;
+    if (failed)
+        kill(session->pid, SIGKILL);
+    if (wait4(session->pid, &status, 0, &usage) < 0)
+        memset(&usage, 0, sizeof(usage));
+
+    session->turnSwitches += countTurnSwitches(session->output, session->length);
+    if (failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        stats->failed++;
+        return;
+    }
+
+    double user = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6;
+    double system = (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+    stats->games++;
+    stats->turnSwitches += (uint64_t)session->turnSwitches;
+    stats->userSeconds += user;
+    stats->systemSeconds += system;
+    sketchAdd(&stats->cpuPerGame, (uint64_t)((user + system) * 1000.0));
+    sketchAdd(&stats->wallPerGame, (uint64_t)((monotonicSeconds() - session->startedAt) * 1000.0));
+}
+
+// Function to read what a game printed and answer it if it is waiting at a prompt, returns 0 once the session is over
+int serviceLoadSession(LoadSession *session, int sessionIndex, LoadStats *stats)
+{
+    while (1)
+    {
+        if (session->length >= LOAD_OUTPUT_SIZE - 1)
         {
-            int r = row;
-            int c = col + i;
-            for (int d = 0; d < 8; d++)
-            {
-                int adjR = r + directions[d][0];
-                int adjC = c + directions[d][1];
-                if (adjR >= 0 && adjR < GRID_SIZE && adjC >= 0 && adjC < GRID_SIZE && grid[adjR][adjC] == 'S')
-                {
-                    return 1; // Adjacent to another ship
-                }
-            }
+            // Keep the newest half, prompts are always at the end
+            int keep = LOAD_OUTPUT_SIZE / 2;
+            session->turnSwitches += countTurnSwitches(session->output, session->length - keep);
+            memmove(session->output, session->output + session->length - keep, (size_t)keep);
+            session->length = keep;
         }
+
+        ssize_t count = read(session->fromGame, session->output + session->length, (size_t)(LOAD_OUTPUT_SIZE - 1 - session->length));
+        if (count == 0)
+        {
+            finishLoadSession(session, 0, stats);
+            return 0;
+        }
+        if (count < 0)
+            break; // Nothing more for now
+        session->length += (int)count;
     }
-    else if (orientation == 'V')
+
+    // A prompt is a line waiting without its newline
+    if (session->length < 2 || memcmp(session->output + session->length - 2, ": ", 2) != 0)
+        return 1;
+
+    char answer[64];
+    double now = monotonicSeconds();
+    sketchAdd(&stats->latency[session->promptKind], (uint64_t)((now - session->askedAt) * 1e6));
+
+    int length = answerPrompt(session, sessionIndex, answer, sizeof(answer));
+    session->turnSwitches += countTurnSwitches(session->output, session->length);
+    session->length = 0;
+    if (length <= 0 || write(session->toGame, answer, (size_t)length) != length)
     {
-        for (int i = 0; i < shipSize; i++)
-        {
-            int r = row + i;
-            int c = col;
-            for (int d = 0; d < 8; d++)
-            {
-                int adjR = r + directions[d][0];
-                int adjC = c + directions[d][1];
-                if (adjR >= 0 && adjR < GRID_SIZE && adjC >= 0 && adjC < GRID_SIZE && grid[adjR][adjC] == 'S')
-                {
-                    return 1; // Adjacent to another ship
-                }
+        finishLoadSession(session, 1, stats);
+        return 0;
+    }
+    session->askedAt = monotonicSeconds();
+    return 1;
+}
+
+// Function to time the shell command the game uses to clear the screen
+double measureClearSeconds()
+{
+    double start = monotonicSeconds();
+    for (int i = 0; i < 5; i++)
+    {
+        if (system("clear >/dev/null 2>&1") == -1)
+            return 0.0;
+    }
+    return (monotonicSeconds() - start) / 5.0;
+}
+#endif
+
+// Function to print the latency and cost tables of a load run
+void printLoadStats(const LoadStats *stats, double elapsed, double clearSeconds)
+{
+    const char *kindNames[LOAD_PROMPT_KINDS] = {"Start", "Setup", "Move"};
+
+    printf("Games completed: %llu, failed: %llu, %.1f games per minute\n\n",
+           (unsigned long long)stats->games, (unsigned long long)stats->failed,
+           elapsed > 0 ? (double)stats->games * 60.0 / elapsed : 0.0);
+
+    printf("Prompt to next prompt latency (ms)\n");
+    printf("%-6s %10s %10s %10s %10s %10s %10s\n", "Prompt", "Count", "Mean", "p50", "p90", "p99", "Max");
+    for (int k = 0; k < LOAD_PROMPT_KINDS; k++)
+    {
+        const QuantileSketch *sketch = &stats->latency[k];
+        if (sketch->count == 0)
+            continue;
+        printf("%-6s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f\n", kindNames[k],
+               (unsigned long long)sketch->count,
+               (double)sketch->sum / (double)sketch->count / 1000.0,
+               (double)sketchQuantile(sketch, 0.50) / 1000.0,
+               (double)sketchQuantile(sketch, 0.90) / 1000.0,
+               (double)sketchQuantile(sketch, 0.99) / 1000.0,
+               (double)sketch->max / 1000.0);
+    }
+
+    if (stats->games == 0)
+        return;
+
+    double games = (double)stats->games;
+    double wall = (double)stats->wallPerGame.sum / games / 1000.0;
+    double pauses = ((double)stats->turnSwitches / games + 1.0) * turnPauseSeconds; // One more after bot placement
+    double clears = clearScreens ? ((double)stats->turnSwitches / games + 2.0) * clearSeconds : 0.0;
+    double cpu = (stats->userSeconds + stats->systemSeconds) / games;
+
+    printf("\nWhere a game's time goes (mean seconds per game)\n");
+    printf("%-28s %10.1f\n", "Turns", (double)stats->turnSwitches / games + 1.0);
+    printf("%-28s %10.3f\n", "Wall time", wall);
+    printf("%-28s %10.3f\n", "  Pauses between turns", pauses);
+    printf("%-28s %10.3f\n", "  Clearing the screen (est.)", clears);
+    printf("%-28s %10.3f\n", "  Everything else", wall - pauses - clears);
+    printf("%-28s %10.3f (user %.3f, system %.3f)\n", "CPU time", cpu, stats->userSeconds / games, stats->systemSeconds / games);
+    printf("%-28s %10.2f %10.2f %10.2f\n", "CPU ms per game p50/p90/max",
+           (double)sketchQuantile(&stats->cpuPerGame, 0.50),
+           (double)sketchQuantile(&stats->cpuPerGame, 0.90),
+           (double)stats->cpuPerGame.max);
+}
+
+// Function to play games against this binary with up to concurrency sessions at a time.
+// gameArgs are the options every game is started with.
+void runLoadTest(int games, int concurrency, uint64_t seed, char *const gameArgs[])
+{
+#ifdef _WIN32
+    (void)games;
+    (void)concurrency;
+    (void)seed;
+    (void)gameArgs;
+    printf("The load generator is not supported on Windows.\n");
+#else
+    LoadSession *sessions = (LoadSession *)calloc((size_t)concurrency, sizeof(LoadSession));
+    struct pollfd *waits = (struct pollfd *)calloc((size_t)concurrency, sizeof(struct pollfd));
+    int *slotOf = (int *)calloc((size_t)concurrency, sizeof(int));
+    LoadStats stats;
+    int started = 0, running = 0;
+
+    if (sessions == NULL || waits == NULL || slotOf == NULL)
+    {
+        printf("Out of memory.\n");
+        free(sessions);
+        free(waits);
+        free(slotOf);
+        return;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    for (int k = 0; k < LOAD_PROMPT_KINDS; k++)
+        sketchInitialize(&stats.latency[k]);
+    sketchInitialize(&stats.wallPerGame);
+    sketchInitialize(&stats.cpuPerGame);
+
+    configureLogThread(0);
+    seedGameRand(seed);
+    signal(SIGPIPE, SIG_IGN); // A game that dies shows up as a failed write
+    double clearSeconds = clearScreens ? measureClearSeconds() : 0.0;
+    for (int i = 0; i < concurrency; i++)
+        sessions[i].fromGame = sessions[i].toGame = -1;
+
+    double start = monotonicSeconds();
+    while (started < games || running > 0)
+    {
+        // Top up to the concurrency limit
+        for (int i = 0; i < concurrency && started < games; i++)
+        {
+            if (sessions[i].fromGame >= 0)
+                continue;
+            if (!startLoadSession(&sessions[i], gameArgs))
+            {
+                printf("Could not start a game process.\n");
+                games = started;
+                break;
             }
+            started++;
+            running++;
+        }
+
+        int count = 0;
+        for (int i = 0; i < concurrency; i++)
+        {
+            if (sessions[i].fromGame < 0)
+                continue;
+            waits[count].fd = sessions[i].fromGame;
+            waits[count].events = POLLIN;
+            slotOf[count++] = i;
+        }
+        if (count == 0)
+            break;
+        if (poll(waits, (nfds_t)count, 1000) <= 0)
+            continue;
+
+        for (int w = 0; w < count; w++)
+        {
+            if (waits[w].revents == 0)
+                continue;
+            int i = slotOf[w];
+            if (!serviceLoadSession(&sessions[i], i, &stats))
+                running--;
         }
     }
 
-    return 0; // No adjacent ships
+    printLoadStats(&stats, monotonicSeconds() - start, clearSeconds);
+    free(sessions);
+    free(waits);
+    free(slotOf);
+#endif
 }
 
-// Helper function to place a single ship automatically
-void autoPlaceSingleShip(char grid[GRID_SIZE][GRID_SIZE], Ship *ship, int shipSize, const char *shipName)
+// Function to show a player their own fleet: ships, hits taken, misses and smoke
+void displayFleet(char grid[GRID_SIZE][GRID_SIZE], int smokeGrid[GRID_SIZE][GRID_SIZE])
 {
-    int valid = 0, attempts = 0;
-    while (!valid)
+    printf("  A B C D E F G H I J\n"); // Column headers
+    for (int i = 0; i < GRID_SIZE; i++)
     {
-        if (attempts > 100)
-        { // Safeguard: if too many attempts, reset grid
-            printf("Too many attempts to place ships. Restarting bot placement...\n");
-            initializeGrid(grid); // Reset grid
-            attempts = 0;         // Reset attempts
+        printf("%d ", i + 1); // Row numbers
+        for (int j = 0; j < GRID_SIZE; j++)
+        {
+            if (grid[i][j] == '~' && smokeGrid[i][j] > 0)
+                printf("# "); // Smoke over open water
+            else
+                printf("%c ", grid[i][j]);
         }
+        printf("\n");
+    }
+}
 
-        int row = rand() % GRID_SIZE;
-        int col = rand() % GRID_SIZE;
-        char orientation = (rand() % 2 == 0) ? 'H' : 'V'; // Randomize orientation
-
-        if (isValidPlacement(grid, row, col, shipSize, orientation) &&
-            !isAdjacent(grid, row, col, shipSize, orientation))
+// Function to tell a player where the opponent's last move landed on their fleet
+void reportIncomingShots(char before[GRID_SIZE][GRID_SIZE], char after[GRID_SIZE][GRID_SIZE])
+{
+    for (int i = 0; i < GRID_SIZE; i++)
+    {
+        for (int j = 0; j < GRID_SIZE; j++)
         {
-            // Place the ship on the grid
-            if (orientation == 'H')
-            {
-                for (int i = 0; i < shipSize; i++)
-                {
-                    grid[row][col + i] = 'S';     // Mark ship on grid horizontally
-                    ship->coords[i][0] = row;     // Store row coordinate
-                    ship->coords[i][1] = col + i; // Store column coordinate
-                }
-            }
-            else // 'V'
-            {
-                for (int i = 0; i < shipSize; i++)
-                {
-                    grid[row + i][col] = 'S';     // Mark ship on grid vertically
-                    ship->coords[i][0] = row + i; // Store row coordinate
-                    ship->coords[i][1] = col;     // Store column coordinate
-                }
-            }
+            if (before[i][j] != '*' && after[i][j] == '*')
+                printf("Your ship was hit at %c%d!\n", j + 'A', i + 1);
+            else if (before[i][j] == '~' && after[i][j] == 'o')
+                printf("The opponent missed at %c%d.\n", j + 'A', i + 1);
+        }
+    }
+}
 
-            // Initialize ship properties
-            ship->shipSize = shipSize;
-            strcpy(ship->name, shipName);
-            ship->sunk = 1; // Initialize the sunk flag to 1 (not sunk)
+// Two-terminal play: each player runs their own process, and the game lives in
+// a shared-memory segment. Turns are handed over by bumping a sequence number
+// and waking the other process (a futex on Linux), so there is no sleeping.
+// A process that exits early ends the game on its way out. One that dies
+// without exiting is noticed by the other, which checks every second while it
+// waits that the process is still running.
+#define SHARED_WAITING 0 // Host is waiting for the second player
+#define SHARED_PLAYING 1
+#define SHARED_OVER 2
 
-            valid = 1; // Ship placed successfully
+typedef struct
+{
+    uint32_t sequence; // Bumped on every change the other process must see
+    uint32_t phase;
+    uint32_t placed; // Bit i set once player i has placed their fleet
+    uint32_t fleetReady; // Set once the host has published the fleet
+    int32_t pid[2];      // Process of each player, 0 until it joins
+    int winner;          // -1 when a player left before the end
+    Fleet fleet; // The host's fleet, both players use it
+    GameState game;
+} SharedGame;
+
+#ifndef _WIN32
+SharedGame *sharedSession = NULL; // The game this process is playing, until it ends
+
+// Function to publish a change to the shared game and wake the other process
+void sharedGameNotify(SharedGame *shared)
+{
+    __atomic_add_fetch(&shared->sequence, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    syscall(SYS_futex, &shared->sequence, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+}
+
+// Function to end a game no one won, unless it is over already
+void abandonSharedGame(SharedGame *shared)
+{
+    uint32_t phase = __atomic_load_n(&shared->phase, __ATOMIC_ACQUIRE);
+
+    while (phase != SHARED_OVER)
+    {
+        shared->winner = -1;
+        if (__atomic_compare_exchange_n(&shared->phase, &phase, SHARED_OVER, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            sharedGameNotify(shared);
+            break;
         }
-        attempts++;
     }
 }
-// Refactored autoPlaceShips function
-void autoPlaceShips(char grid[GRID_SIZE][GRID_SIZE], Ship ships[NUM_SHIPS])
+
+// Function to end the shared game when this process exits before it is over (registered with atexit)
+void leaveSharedGame()
 {
-    int shipSizes[NUM_SHIPS] = {5, 4, 3, 2}; // Sizes of Carrier, Battleship, Destroyer, Submarine
-    const char *shipNames[NUM_SHIPS] = {"Carrier", "Battleship", "Destroyer", "Submarine"};
+    if (sharedSession != NULL)
+        abandonSharedGame(sharedSession);
+}
 
-    for (int i = 0; i < NUM_SHIPS; i++)
+// Function to wait until the shared sequence moves past a seen value. Every
+// second it checks the other player's process is still running, and ends the
+// game if it is not.
+void sharedGameWait(SharedGame *shared, uint32_t seen, int me)
+{
+    while (__atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE) == seen)
     {
-        autoPlaceSingleShip(grid, &ships[i], shipSizes[i], shipNames[i]);
+#ifdef __linux__
+        struct timespec timeout = {1, 0};
+        syscall(SYS_futex, &shared->sequence, FUTEX_WAIT, seen, &timeout, NULL, 0);
+#else
+        struct timespec pause = {0, 100000}; // No futex here, poll every 100 microseconds
+        for (int i = 0; i < 10000 && __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE) == seen; i++)
+            nanosleep(&pause, NULL);
+#endif
+        pid_t peer = (pid_t)__atomic_load_n(&shared->pid[1 - me], __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE) == seen && peer > 0 && kill(peer, 0) != 0 && errno == ESRCH)
+            abandonSharedGame(shared);
     }
+}
 
-    printf("Bot has successfully placed all ships.\n");
+// Function to block until it is this player's turn, returns 0 once the game is over
+int sharedGameAwaitTurn(SharedGame *shared, int me)
+{
+    while (1)
+    {
+        uint32_t seen = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        uint32_t phase = __atomic_load_n(&shared->phase, __ATOMIC_ACQUIRE);
+        if (phase == SHARED_OVER)
+            return 0;
+        if (phase == SHARED_PLAYING && shared->game.currentPlayer == me)
+            return 1;
+        sharedGameWait(shared, seen, me);
+    }
 }
+#endif
 
-void botTurn(
-    char grid[GRID_SIZE][GRID_SIZE],
-    Ship ships[NUM_SHIPS],
-    int trackingDifficulty,
-    int *artilleryLifetime,
-    int *torpedoLifetime)
+// Function to play one side of a two-terminal game. The host creates the
+// session and chooses the difficulty; the other player joins it by name.
+int playSharedGame(const char *session, int host)
 {
-    // Static variables to track bot's state
-    static int lastHitRow = -1, lastHitCol = -1; // Track last hit for adjacent targeting
-    static int torpedoRow = -1, torpedoCol = -1; // Row and Column to perform torpedo attacks
-    static int torpedoState = 0;                 // 0 = no torpedo, 1 = column torpedo, 2 = row torpedo
-    static int torpedoTurns = 0;                 // Number of remaining torpedo turns
+#ifdef _WIN32
+    (void)session;
+    (void)host;
+    printf("Two-terminal play is not supported on Windows.\n");
+    return 1;
+#else
+    char path[NAME_SIZE + 16];
+    char name[NAME_SIZE];
+    InputReader input;
+    int me = host ? 0 : 1;
 
-    int row, col;
-    int hitFlag = 0;
+    snprintf(path, sizeof(path), "/battleship-%s", session);
+    if (host)
+        shm_unlink(path); // Drop a segment left behind by an earlier crashed game
 
-    // Check if Artillery is available
-    if (*artilleryLifetime == 1)
+    int fd = shm_open(path, host ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+    if (fd < 0)
     {
-        // Bot decides to use Artillery
-        printf("Bot is using Artillery!\n");
-        // Random coordinates for artillery (ensure they are within bounds)
-        row = rand() % (GRID_SIZE - 1);
-        col = rand() % (GRID_SIZE - 1);
-        artilleryStrike(grid, row, col, trackingDifficulty);
-        *artilleryLifetime = 0; // Deactivate after use
-        return;                 // Artillery used, end turn
+        printf(host ? "Could not create session %s.\n" : "No game is hosted as %s.\n", session);
+        return 1;
+    }
+    if (host && ftruncate(fd, sizeof(SharedGame)) != 0)
+    {
+        printf("Could not size session %s.\n", session);
+        close(fd);
+        shm_unlink(path);
+        return 1;
     }
 
-    // Check if Torpedo is available
-    if (*torpedoLifetime == 1)
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SharedGame))
     {
-        // Bot decides to use Torpedo
-        printf("Bot is using Torpedo!\n");
-        // Randomly choose between row or column
-        if (rand() % 2 == 0)
+        printf("Session %s is not ready yet, try again.\n", session);
+        close(fd);
+        return 1;
+    }
+
+    SharedGame *shared = (SharedGame *)mmap(NULL, sizeof(SharedGame), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED)
+    {
+        printf("Could not map session %s.\n", session);
+        return 1;
+    }
+
+    initializeInputReader(&input, 0); // Standard input
+    seedGameRand((uint64_t)time(NULL) ^ (uint64_t)getpid());
+    __atomic_store_n(&shared->pid[me], (int32_t)getpid(), __ATOMIC_RELEASE);
+    sharedSession = shared;
+    atexit(leaveSharedGame);
+
+    if (host)
+    {
+        shared->fleet = fleet;
+        __atomic_store_n(&shared->fleetReady, 1, __ATOMIC_RELEASE);
+        sharedGameNotify(shared);
+    }
+
+    if (!inputPending(&input))
+        printf("Enter your name: ");
+    if (!readInputLine(&input, name, sizeof(name)))
+        inputClosed();
+
+    PlayerState *self = &shared->game.players[me];
+    PlayerState *opponent = &shared->game.players[1 - me];
+
+    if (host)
+    {
+        // The segment starts zeroed, in SHARED_WAITING; the host fills in the game settings
+        shared->game.trackingDifficulty = askForTrackingDifficulty(&input);
+    }
+    else
+    {
+        // Play with the host's fleet
+        while (1)
         {
-            row = rand() % GRID_SIZE;
-            torpedoAttack(grid, 'R', row, trackingDifficulty);
+            uint32_t seen = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&shared->fleetReady, __ATOMIC_ACQUIRE) || __atomic_load_n(&shared->phase, __ATOMIC_ACQUIRE) == SHARED_OVER)
+                break;
+            sharedGameWait(shared, seen, me);
         }
-        else
+        if (!__atomic_load_n(&shared->fleetReady, __ATOMIC_ACQUIRE))
         {
-            col = rand() % GRID_SIZE;
-            torpedoAttack(grid, 'C', col, trackingDifficulty);
+            sharedSession = NULL;
+            printf("The other player left the game.\n");
+            munmap(shared, sizeof(SharedGame));
+            return 1;
         }
-        *torpedoLifetime = 0; // Deactivate after use
-        return;               // Torpedo used, end turn
+        fleet = shared->fleet;
+        buildFleetKernels();
     }
+    initializePlayer(self, name);
 
-    // Existing bot logic...
+    printf("%s, place your ships.\n", self->name);
+    for (int i = 0; i < fleet.count; i++)
+        placeShip(self->grid, self->ships, i, &input);
+    __atomic_or_fetch(&shared->placed, 1u << me, __ATOMIC_ACQ_REL);
+    sharedGameNotify(shared);
+
+    // The host starts the game once both fleets are placed
+    printf("Waiting for the other player...\n");
+    fflush(stdout);
+    while (1)
+    {
+        uint32_t seen = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        uint32_t phase = __atomic_load_n(&shared->phase, __ATOMIC_ACQUIRE);
+        if (phase == SHARED_OVER || (__atomic_load_n(&shared->placed, __ATOMIC_ACQUIRE) == 3 && (host || phase != SHARED_WAITING)))
+            break;
+        sharedGameWait(shared, seen, me);
+    }
+    if (host)
+    {
+        // Start unless the other player has left meanwhile
+        uint32_t waiting = SHARED_WAITING;
+        shared->game.currentPlayer = chooseFirstPlayer();
+        if (__atomic_compare_exchange_n(&shared->phase, &waiting, SHARED_PLAYING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            sharedGameNotify(shared);
+    }
+    if (__atomic_load_n(&shared->phase, __ATOMIC_ACQUIRE) != SHARED_OVER)
+    {
+        printf("%s goes first!\n", shared->game.players[shared->game.currentPlayer].name);
+        const char *names[2] = {shared->game.players[0].name, shared->game.players[1].name};
+        logGameStart(0, names, shared->game.trackingDifficulty, shared->game.currentPlayer);
+    }
+
+    char before[GRID_SIZE][GRID_SIZE];
+    memcpy(before, self->grid, sizeof(before));
 
-    if (torpedoTurns > 0)
+    while (1)
     {
-        if (torpedoState == 0)
+        if (shared->game.currentPlayer != me)
         {
-            // Perform torpedo on column
-            printf("Bot is performing a torpedo attack on column %c.\n", torpedoCol + 'A');
-            hitFlag = torpedoAttack(grid, 'C', torpedoCol, trackingDifficulty);
+            printf("Waiting for %s...\n", opponent->name);
+            fflush(stdout);
+        }
+        if (!sharedGameAwaitTurn(shared, me))
+            break;
 
-            if (hitFlag)
-            {
-                printf("Bot's torpedo column attack hit!\n");
-                // Reset torpedo state
-                torpedoState = 0;
-                torpedoTurns = 0;
-                torpedoRow = -1;
-                torpedoCol = -1;
-            }
-            else
-            {
-                // Proceed to next torpedo attack
-                torpedoState = 1;
-                torpedoTurns--;
-            }
+        reportIncomingShots(before, self->grid);
+
+        TRACE_SCOPE(TRACE_TURN);
+        logTurn(me);
+        beginTurn(self);
+        printf("%s's turn!\nYour fleet:\n", self->name);
+        displayFleet(self->grid, self->smokeDurationGrid);
+        printf("Your view of %s:\n", opponent->name);
+        displayGrid(&self->view, shared->game.trackingDifficulty);
+        performMove(self, opponent, shared->game.trackingDifficulty, &input);
+
+        // Report sunk ships and unlock special moves
+        resolveTurn(self, opponent, NULL);
+        memcpy(before, self->grid, sizeof(before));
+
+        if (allShipsSunk(opponent->grid))
+        {
+            shared->winner = me;
+            __atomic_store_n(&shared->phase, SHARED_OVER, __ATOMIC_RELEASE);
+            LOG_EVENT(LOG_LEVEL_GAMES, LOG_GAME_OVER, LOG_FLAG_PRIVATE, me);
         }
-        else if (torpedoState == 1)
+        else
         {
-            // Perform torpedo on row
-            printf("Bot is performing a torpedo attack on row %d.\n", torpedoRow + 1);
-            hitFlag = torpedoAttack(grid, 'R', torpedoRow, trackingDifficulty);
+            shared->game.currentPlayer = 1 - me;
+        }
+        sharedGameNotify(shared);
+    }
 
-            if (hitFlag)
-            {
-                printf("Bot's torpedo row attack hit!\n");
-                // Reset torpedo state
-                torpedoState = 0;
-                torpedoTurns = 0;
-                torpedoRow = -1;
-                torpedoCol = -1;
-            }
-            else
+    sharedSession = NULL;
+    if (shared->winner < 0)
+    {
+        printf("The other player left the game.\n");
+        munmap(shared, sizeof(SharedGame));
+        if (host)
+            shm_unlink(path);
+        return 1;
+    }
+    reportIncomingShots(before, self->grid);
+    printf("%s wins! All enemy ships have been sunk!\n", shared->game.players[shared->winner].name);
+    if (host)
+        recordMatch(&shared->game, shared->winner); // One record per game, not one per terminal
+
+    munmap(shared, sizeof(SharedGame));
+    if (host)
+        shm_unlink(path);
+    return 0;
+#endif
+}
+
+// Function to print the command line options
+void printUsage(const char *program)
+{
+    printf("Usage: %s [OPTIONS]                                 Play interactively\n", program);
+    printf("       %s [OPTIONS] --simulate GAMES [THREADS] [SEED]  Run silent bot games and print statistics\n", program);
+    printf("       %s [OPTIONS] --ffa PLAYERS [THREADS] [SEED]   Play a silent free-for-all of bots and print the standings\n", program);
+    printf("       %s [OPTIONS] --build-book FILE [GAMES] [THREADS] [SEED]  Rate the bot's opening positions for the fleet\n", program);
+    printf("       %s [OPTIONS] --validate FILE [THREADS]       Check a file of fleet layouts, one \"Carrier B3 H ...\" per line\n", program);
+    printf("       %s [OPTIONS] --analyze LOG [THREADS]         Report move quality per player from an NDJSON log\n", program);
+    printf("       %s [OPTIONS] --leaderboard [N]               Print the N best rated players of the match store (default 10)\n", program);
+    printf("       %s [OPTIONS] --history NAME [N]              Print a player's N newest matches from the match store (default 10)\n", program);
+    printf("       %s [OPTIONS] --load GAMES [CONCURRENCY] [SEED]  Play interactive games in parallel processes and time them\n", program);
+    printf("       %s [OPTIONS] --selftest                      Run the self tests\n", program);
+    printf("       %s [OPTIONS] --host SESSION                  Host a game for a second terminal\n", program);
+    printf("       %s [OPTIONS] --join SESSION                  Join a game hosted in another terminal\n", program);
+    printf("Options:\n");
+    printf("  --endgame-layouts N  Solve endgames exactly once at most N ship layouts remain (default %d)\n", endgameLayoutThreshold);
+    printf("  --decision-cache MB  Memory for the bots' shared cache of endgame decisions, 0 for none (default %d)\n", decisionCacheMegabytes);
+    printf("  --endgame-nodes N    Positions the endgame solver may expand per move (default %ld)\n", endgameNodeBudget);
+    printf("  --bot NAME           Bot to play against, and Bot 2 of simulations: classic or mcts (default %s)\n", botNames[opponentBot]);
+    printf("  --mcts-ms MS         Time the MCTS bot thinks per move (default %d)\n", mctsBudgetMs);
+    printf("  --mcts-threads N     Threads the MCTS bot searches with (default %d)\n", mctsThreads);
+    printf("  --bot-placement MODE How the bot places its fleet: random or optimized (default random)\n");
+    printf("  --heatmap LOG        Optimize placements against where the games of an NDJSON log shot first\n");
+    printf("  --place-ms MS        Time the placement optimizer may spend (default %d)\n", placementBudgetMs);
+    printf("  --place-threads N    Threads the placement optimizer anneals with (default %d)\n", placementThreads);
+    printf("  --ffa-threads N      Threads the bots of a free-for-all round play on, one per processor at most (default %d)\n", ffaThreads);
+    printf("  --fleet NAME|FILE    Fleet to play with: standard, classic, or a file of \"Name Size\" lines\n");
+    printf("  --book FILE          Let the classic bot open from an opening book built with --build-book\n");
+    printf("  --store FILE         Record finished games and player ratings in the match store FILE\n");
+    printf("  --checkpoint FILE    Save the progress of --simulate to FILE and resume from it when run again\n");
+    printf("  --checkpoint-every SECONDS  Time between checkpoints of each simulation thread (default %g)\n", checkpointSeconds);
+    printf("  --trace FILE         Time rule functions and turns, write Chrome trace JSON to FILE\n");
+    printf("  --pause SECONDS      Pause between turns (default %d)\n", turnPauseSeconds);
+    printf("  --clear 0|1          Clear the screen between turns (default %d)\n", clearScreens);
+    printf("  --log FILE           Write a game log to FILE\n");
+    printf("  --log-format FORMAT  text or ndjson (default text)\n");
+    printf("  --log-level N        0 off, 1 games, 2 events, 3 shots, 4 everything (default %d)\n", logLevel);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg = 1;
+    const char *logPath = NULL;
+    const char *storePath = NULL;
+    const char *bookPath = NULL;
+    int ffaThreadsGiven = 0;
+
+    // Tuning options come before the mode
+    while (arg + 1 < argc)
+    {
+        if (strcmp(argv[arg], "--endgame-layouts") == 0)
+            endgameLayoutThreshold = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--endgame-nodes") == 0)
+            endgameNodeBudget = atol(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--decision-cache") == 0)
+            decisionCacheMegabytes = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--log") == 0)
+            logPath = argv[arg + 1];
+        else if (strcmp(argv[arg], "--log-format") == 0)
+            logFormat = strcmp(argv[arg + 1], "ndjson") == 0 ? LOG_FORMAT_NDJSON : LOG_FORMAT_TEXT;
+        else if (strcmp(argv[arg], "--log-level") == 0)
+            logLevel = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--bot") == 0)
+            opponentBot = strcmp(argv[arg + 1], "mcts") == 0 ? BOT_MCTS : BOT_CLASSIC;
+        else if (strcmp(argv[arg], "--mcts-ms") == 0)
+            mctsBudgetMs = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--mcts-threads") == 0)
+            mctsThreads = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--bot-placement") == 0)
+            botPlacement = strcmp(argv[arg + 1], "optimized") == 0 ? PLACEMENT_OPTIMIZED : PLACEMENT_RANDOM;
+        else if (strcmp(argv[arg], "--heatmap") == 0)
+        {
+            if (!loadHeatMap(argv[arg + 1]))
             {
-                // Torpedo attacks completed
-                torpedoState = 0;
-                torpedoTurns--;
+                printf("Could not read fire events from %s\n", argv[arg + 1]);
+                return 1;
             }
         }
+        else if (strcmp(argv[arg], "--place-ms") == 0)
+            placementBudgetMs = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--place-threads") == 0)
+            placementThreads = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--ffa-threads") == 0)
+        {
+            ffaThreads = atoi(argv[arg + 1]);
+            ffaThreadsGiven = 1;
+        }
+        else if (strcmp(argv[arg], "--fleet") == 0)
+        {
+            if (!selectFleet(argv[arg + 1]))
+                return 1;
+        }
+        else if (strcmp(argv[arg], "--trace") == 0)
+            tracePath = argv[arg + 1];
+        else if (strcmp(argv[arg], "--store") == 0)
+            storePath = argv[arg + 1];
+        else if (strcmp(argv[arg], "--checkpoint") == 0)
+            checkpointPath = argv[arg + 1];
+        else if (strcmp(argv[arg], "--checkpoint-every") == 0)
+            checkpointSeconds = atof(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--book") == 0)
+            bookPath = argv[arg + 1];
+        else if (strcmp(argv[arg], "--pause") == 0)
+            turnPauseSeconds = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--clear") == 0)
+            clearScreens = atoi(argv[arg + 1]);
+        else
+            break;
+        arg += 2;
     }
-    else
+
+    if (logPath != NULL && logLevel > LOG_LEVEL_OFF)
     {
-        if (lastHitRow != -1 && lastHitCol != -1)
+        if (!openGameLog(logPath, checkpointPath != NULL))
         {
-            // After a hit, target adjacent cells
-            int directions[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}}; // Up, Down, Left, Right
-            int foundTarget = 0;
+            printf("Could not open log file %s.\n", logPath);
+            return 1;
+        }
+        atexit(closeGameLog);
+    }
+    if (tracePath != NULL)
+    {
+        traceEnabled = 1;
+        atexit(writeTrace);
+    }
+    if (storePath != NULL)
+    {
+        if (!openMatchStore(storePath))
+            return 1;
+        atexit(closeMatchStore);
+    }
+    buildFleetKernels();
+    initializeDecisionCache(decisionCacheMegabytes);
+    if (bookPath != NULL && !loadOpeningBook(bookPath))
+        return 1;
 
-            for (int i = 0; i < 4; i++)
-            {
-                int newRow = lastHitRow + directions[i][0];
-                int newCol = lastHitCol + directions[i][1];
-                if (newRow >= 0 && newRow < GRID_SIZE && newCol >= 0 && newCol < GRID_SIZE && grid[newRow][newCol] == 'S')
-                {
-                    row = newRow;
-                    col = newCol;
-                    foundTarget = 1;
-                    break;
-                }
-            }
+    if (arg < argc)
+    {
+        if (strcmp(argv[arg], "--simulate") == 0 && argc >= arg + 2)
+        {
+            uint64_t games = strtoull(argv[arg + 1], NULL, 10);
+            int threadCount = argc >= arg + 3 ? atoi(argv[arg + 2]) : 1;
+            uint64_t runSeed = argc >= arg + 4 ? strtoull(argv[arg + 3], NULL, 10) : (uint64_t)time(NULL);
 
-            if (foundTarget)
-            {
-                printf("Bot fires at %c%d\n", col + 'A', row + 1);
-                hitFlag = fireAtCoordinate(grid, row, col, ships, trackingDifficulty);
+            if (threadCount < 1)
+                threadCount = 1;
+            runSimulation(games, threadCount, runSeed);
+            return 0;
+        }
+        if (strcmp(argv[arg], "--selftest") == 0)
+            return runSelfTest() > 0;
+        if (strcmp(argv[arg], "--ffa") == 0 && argc >= arg + 2)
+        {
+            int players = atoi(argv[arg + 1]);
+            uint64_t seed = argc >= arg + 4 ? strtoull(argv[arg + 3], NULL, 10) : (uint64_t)time(NULL);
 
-                if (hitFlag)
-                {
-                    // Hit, set up torpedo attacks for next two turns
-                    torpedoRow = row;
-                    torpedoCol = col;
-                    torpedoState = 0; // Start with column torpedo
-                    torpedoTurns = 2;
-                    lastHitRow = row;
-                    lastHitCol = col;
-                }
-                else
+            if (argc >= arg + 3)
+            {
+                if (ffaThreadsGiven && atoi(argv[arg + 2]) != ffaThreads)
                 {
-                    // Miss, do not change torpedo state
-                    lastHitRow = -1;
-                    lastHitCol = -1;
+                    printf("--ffa-threads %d and --ffa %s %s disagree, give the thread count once.\n", ffaThreads, argv[arg + 1], argv[arg + 2]);
+                    return 1;
                 }
+                ffaThreads = atoi(argv[arg + 2]);
             }
-            else
+            if (ffaThreads < 1)
+                ffaThreads = 1;
+            if (players < 2 || players > MAX_FFA_PLAYERS)
             {
-                // No adjacent targets found, fire randomly
-                do
-                {
-                    row = rand() % GRID_SIZE;
-                    col = rand() % GRID_SIZE;
-                } while (grid[row][col] == '*' || grid[row][col] == 'o'); // Avoid repeated shots
-
-                printf("Bot fires at %c%d\n", col + 'A', row + 1);
-                hitFlag = fireAtCoordinate(grid, row, col, ships, trackingDifficulty);
-
-                if (hitFlag)
-                {
-                    // Hit, set up torpedo attacks for next two turns
-                    torpedoRow = row;
-                    torpedoCol = col;
-                    torpedoState = 0; // Start with column torpedo
-                    torpedoTurns = 2;
-                    lastHitRow = row;
-                    lastHitCol = col;
-                }
+                printf("A free-for-all needs 2 to %d players.\n", MAX_FFA_PLAYERS);
+                return 1;
             }
+            return runFfaSimulation(players, seed);
         }
-        else
+        if (strcmp(argv[arg], "--build-book") == 0 && argc >= arg + 2)
         {
-            // Random targeting for the first hit
-            do
-            {
-                row = rand() % GRID_SIZE;
-                col = rand() % GRID_SIZE;
-            } while (grid[row][col] == '*' || grid[row][col] == 'o'); // Avoid repeated shots
-
-            printf("Bot fires at %c%d\n", col + 'A', row + 1);
-            hitFlag = fireAtCoordinate(grid, row, col, ships, trackingDifficulty);
-
-            if (hitFlag)
+            uint64_t games = argc >= arg + 3 ? strtoull(argv[arg + 2], NULL, 10) : 10000;
+            int threadCount = argc >= arg + 4 ? atoi(argv[arg + 3]) : 1;
+            uint64_t seed = argc >= arg + 5 ? strtoull(argv[arg + 4], NULL, 10) : (uint64_t)time(NULL);
+            return buildOpeningBook(argv[arg + 1], games, threadCount < 1 ? 1 : threadCount, seed);
+        }
+        if (strcmp(argv[arg], "--validate") == 0 && argc >= arg + 2)
+        {
+            int threadCount = argc >= arg + 3 ? atoi(argv[arg + 2]) : 1;
+            return runLayoutValidation(argv[arg + 1], threadCount < 1 ? 1 : threadCount);
+        }
+        if (strcmp(argv[arg], "--analyze") == 0 && argc >= arg + 2)
+        {
+            int threadCount = argc >= arg + 3 ? atoi(argv[arg + 2]) : 1;
+            return runAnalysis(argv[arg + 1], threadCount < 1 ? 1 : threadCount);
+        }
+        if (strcmp(argv[arg], "--leaderboard") == 0 || (strcmp(argv[arg], "--history") == 0 && argc >= arg + 2))
+        {
+            if (matchStore.fd < 0)
             {
-                // Hit, set up torpedo attacks for next two turns
-                torpedoRow = row;
-                torpedoCol = col;
-                torpedoState = 0; // Start with column torpedo
-                torpedoTurns = 2;
-                lastHitRow = row;
-                lastHitCol = col;
+                printf("%s needs a match store, give one with --store FILE.\n", argv[arg]);
+                return 1;
             }
-        }
-    }
-}
-nt main()
-{
-    srand(time(NULL)); // Seed the random number generator once at the start
+            if (strcmp(argv[arg], "--leaderboard") == 0)
+                return printLeaderboard(argc >= arg + 2 ? atoi(argv[arg + 1]) : 10);
+            return printMatchHistory(argv[arg + 1], argc >= arg + 3 ? atoi(argv[arg + 2]) : 10);
+        }
+        if (strcmp(argv[arg], "--load") == 0 && argc >= arg + 2)
+        {
+            int games = atoi(argv[arg + 1]);
+            int concurrency = argc >= arg + 3 ? atoi(argv[arg + 2]) : 1;
+            uint64_t seed = argc >= arg + 4 ? strtoull(argv[arg + 3], NULL, 10) : (uint64_t)time(NULL);
+
+            // Games get the same options this run was given, minus the mode
+            argv[arg] = NULL;
+            runLoadTest(games, concurrency < 1 ? 1 : concurrency, seed, argv);
+            return 0;
+        }
+        if ((strcmp(argv[arg], "--host") == 0 || strcmp(argv[arg], "--join") == 0) && argc >= arg + 2)
+        {
+            return playSharedGame(argv[arg + 1], strcmp(argv[arg], "--host") == 0);
+        }
 
-    int smokeScreenUsesP1 = 0, smokeScreenUsesP2 = 0;
-    int radarUsesP1 = 3, radarUsesP2 = 3;
-    int sunkTotalP1 = 0, sunkTotalP2 = 0;
-    int artilleryLifetimeP1 = 0, artilleryLifetimeP2 = 0;
-    int torpedoLifetimeP1 = 0, torpedoLifetimeP2 = 0;
-    int filledArtilleryP1_FLAG = 0, filledArtilleryP2_FLAG = 0;
-    int filledTorpedoP1_FLAG = 0, filledTorpedoP2_FLAG = 0;
+        printUsage(argv[0]);
+        return 1;
+    }
 
-    // Create two grids for the two players
-    char player1Grid[GRID_SIZE][GRID_SIZE];
-    char player2Grid[GRID_SIZE][GRID_SIZE];
+    seedGameRand((uint64_t)time(NULL)); // Seed the random number generator once at the start
 
-    // Separate smoke grids for each player
-    int smokeDurationGridP1[GRID_SIZE][GRID_SIZE] = {0}; // Smoke duration grid for Player 1
-    int smokeDurationGridP2[GRID_SIZE][GRID_SIZE] = {0}; // Smoke duration grid for Player 2
+    GameState game;
+    char name[NAME_SIZE];
+    InputReader input;
 
-    // Initialize both grids with water
-    initializeGrid(player1Grid);
-    initializeGrid(player2Grid);
+    initializeInputReader(&input, 0); // Standard input
 
     // Ask for game mode
-    int gameMode;
-    printf("Choose game mode: 1 for Player vs. Player, 2 for Player vs. Bot: ");
-    scanf("%d", &gameMode);
-    clearInputBuffer(); // Clear input buffer
+    int gameMode = askForGameMode(&input);
+    if (gameMode == 3)
+    {
+        runFfaGame(&input);
+        return 0;
+    }
 
     // Ask for player name(s)
-    char player1Name[NAME_SIZE], player2Name[NAME_SIZE];
-    printf("Enter Player 1's name: ");
-    fgets(player1Name, sizeof(player1Name), stdin);
-    player1Name[strcspn(player1Name, "\n")] = '\0'; // Remove newline character
+    if (!inputPending(&input))
+        printf("Enter Player 1's name: ");
+    if (!readInputLine(&input, name, sizeof(name)))
+        inputClosed();
+    initializePlayer(&game.players[0], name);
 
     if (gameMode == 1)
     {
         // For PvP, ask for Player 2's name
-        printf("Enter Player 2's name: ");
-        fgets(player2Name, sizeof(player2Name), stdin);
-        player2Name[strcspn(player2Name, "\n")] = '\0'; // Remove newline character
+        if (!inputPending(&input))
+            printf("Enter Player 2's name: ");
+        if (!readInputLine(&input, name, sizeof(name)))
+            inputClosed();
+        initializePlayer(&game.players[1], name);
     }
     else
     {
         // For PvB, set the bot's name
-        strcpy(player2Name, "Bot");
+        initializePlayer(&game.players[1], "Bot");
     }
 
     // Ask for tracking difficulty
-    int trackingDifficulty = askForTrackingDifficulty();
+    game.trackingDifficulty = askForTrackingDifficulty(&input);
 
     // Player 1 places ships
-    printf("%s, place your ships.\n", player1Name);
-    placeShip(player1Grid, &player1Ships[0], 5, "Carrier");
-    placeShip(player1Grid, &player1Ships[1], 4, "Battleship");
-    placeShip(player1Grid, &player1Ships[2], 3, "Destroyer");
-    placeShip(player1Grid, &player1Ships[3], 2, "Submarine");
+    PlayerState *player1 = &game.players[0];
+    PlayerState *player2 = &game.players[1];
+    printf("%s, place your ships.\n", player1->name);
+    for (int i = 0; i < fleet.count; i++)
+        placeShip(player1->grid, player1->ships, i, &input);
     clearScreen(); // Clear the screen after Player 1 finishes placing ships
 
     if (gameMode == 1)
     {
         // Player 2 places ships in PvP mode
-        printf("%s, place your ships.\n", player2Name);
-        placeShip(player2Grid, &player2Ships[0], 5, "Carrier");
-        placeShip(player2Grid, &player2Ships[1], 4, "Battleship");
-        placeShip(player2Grid, &player2Ships[2], 3, "Destroyer");
-        placeShip(player2Grid, &player2Ships[3], 2, "Submarine");
+        printf("%s, place your ships.\n", player2->name);
+        for (int i = 0; i < fleet.count; i++)
+            placeShip(player2->grid, player2->ships, i, &input);
     }
     else
     {
         // Bot places ships in PvB mode
         printf("Bot is placing ships...\n");
-        autoPlaceShips(player2Grid, player2Ships); // Correctly use autoPlaceShips
-#ifdef _WIN32
-        Sleep(3000); // Wait for 3 seconds (Windows)
-#else
-        sleep(3); // Wait for 3 seconds (Unix/Linux/macOS)
-#endif
+        logPlayer = 1;
+        placeBotFleet(player2->grid, player2->ships);
+        pauseBetweenTurns();
     }
     clearScreen(); // Clear the screen after Player 2 (or Bot) finishes placing ships
 
     // Randomly select the first player
-    int currentPlayer = chooseFirstPlayer();
-    printf("%s goes first!\n", currentPlayer == 0 ? player1Name : player2Name);
+    game.currentPlayer = chooseFirstPlayer();
+    printf("%s goes first!\n", game.players[game.currentPlayer].name);
+    const char *names[2] = {player1->name, player2->name};
+    logGameStart(0, names, game.trackingDifficulty, game.currentPlayer);
 
     while (1)
     {
         // Determine current and opponent player details
-        char *currentPlayerName = currentPlayer == 0 ? player1Name : player2Name;
-        char *opponentPlayerName = currentPlayer == 0 ? player2Name : player1Name;
-        char(*opponentGrid)[GRID_SIZE] = currentPlayer == 0 ? player2Grid : player1Grid;
-        Ship *opponentShips = currentPlayer == 0 ? player2Ships : player1Ships;
-
-        // Use the correct smokeScreenUses and radarUses for the current player
-        int *smokeScreenUses = currentPlayer == 0 ? &smokeScreenUsesP1 : &smokeScreenUsesP2;
-        int *radarUses = currentPlayer == 0 ? &radarUsesP1 : &radarUsesP2;
-        int *sunkTotal = currentPlayer == 0 ? &sunkTotalP1 : &sunkTotalP2;
-        int *artilleryLifetime = currentPlayer == 0 ? &artilleryLifetimeP1 : &artilleryLifetimeP2;
-        int *torpedoLifetime = currentPlayer == 0 ? &torpedoLifetimeP1 : &torpedoLifetimeP2;
-
-        // Decrement lifetime variables at the start of the turn
-        if (currentPlayer == 0)
-        {
-            if (*artilleryLifetime > 0)
-                (*artilleryLifetime)--;
-            if (*torpedoLifetime > 0)
-                (*torpedoLifetime)--;
-        }
-        else
-        {
-            if (*artilleryLifetime > 0)
-                (*artilleryLifetime)--;
-            if (*torpedoLifetime > 0)
-                (*torpedoLifetime)--;
-        }
+        PlayerState *current = &game.players[game.currentPlayer];
+        PlayerState *opponent = &game.players[switchPlayer(game.currentPlayer)];
+        TRACE_SCOPE(TRACE_TURN);
 
-        // Reduce smoke duration at the start of the player's turn
-        reduceSmokeDuration(currentPlayer == 0 ? smokeDurationGridP1 : smokeDurationGridP2);
+        logTurn(game.currentPlayer);
+        beginTurn(current);
 
         // Player or bot's turn
-        if (gameMode == 2 && currentPlayer == 1)
+        if (gameMode == 2 && game.currentPlayer == 1)
         {
             // Bot's turn
             printf("Bot's turn!\n");
-            botTurn(player1Grid, player1Ships, trackingDifficulty, artilleryLifetime, torpedoLifetime);
+            playBotTurn(opponentBot, current, opponent, game.trackingDifficulty, NULL);
         }
         else
         {
             // Player's turn
-            printf("%s's turn!\n", currentPlayerName);
-            displayGrid(opponentGrid, trackingDifficulty);
-            performMove(
-                opponentGrid,
-                opponentShips,
-                radarUses,
-                smokeScreenUses,
-                currentPlayer == 0 ? smokeDurationGridP1 : smokeDurationGridP2,
-                currentPlayer == 0 ? smokeDurationGridP2 : smokeDurationGridP1,
-                trackingDifficulty,
-                sunkTotal,
-                artilleryLifetime,
-                torpedoLifetime);
-        }
-
-        // Check if any ships have been sunk
-        for (int i = 0; i < NUM_SHIPS; i++)
-        {
-            if (opponentShips[i].sunk == 1 && isShipSunk(opponentGrid, opponentShips[i]))
-            {
-                printf("You sunk the %s!\n", opponentShips[i].name);
-                opponentShips[i].sunk = 0; // Mark the ship as sunk to prevent repeated messages
-                (*smokeScreenUses)++;      // Award extra smoke use
-                (*sunkTotal)++;
-            }
+            printf("%s's turn!\n", current->name);
+            displayGrid(&current->view, game.trackingDifficulty);
+            performMove(current, opponent, game.trackingDifficulty, &input);
         }
 
-        // Unlock special moves based on sunkTotal
-        if (currentPlayer == 0)
-        {
-            if (*sunkTotal == 1 && artilleryLifetimeP1 == 0 && !filledArtilleryP1_FLAG)
-            {
-                artilleryLifetimeP1 = 2;
-                filledArtilleryP1_FLAG = 1;
-                printf("%s has unlocked Artillery! You have one turn to use it.\n", currentPlayerName);
-            }
-            if (*sunkTotal == 3 && torpedoLifetimeP1 == 0)
-            {
-                torpedoLifetimeP1 = 2;
-                filledTorpedoP1_FLAG = 1;
-
-                printf("%s has unlocked Torpedo! You have one turn to use it.\n", currentPlayerName);
-            }
-        }
-        else
-        {
-            if (*sunkTotal == 1 && artilleryLifetimeP2 == 0)
-            {
-                artilleryLifetimeP2 = 2;
-                filledArtilleryP2_FLAG = 1;
-                printf("%s has unlocked Artillery! You have one turn to use it.\n", currentPlayerName);
-            }
-            if (*sunkTotal == 3 && torpedoLifetimeP2 == 0)
-            {
-                torpedoLifetimeP2 = 2;
-                filledTorpedoP2_FLAG = 1;
-                printf("%s has unlocked Torpedo! You have one turn to use it.\n", currentPlayerName);
-            }
-        }
+        // Report sunk ships and unlock special moves
+        resolveTurn(current, opponent, NULL);
 
         // Check if all of the opponent's ships have been sunk
-        if (allShipsSunk(opponentGrid))
+        if (allShipsSunk(opponent->grid))
         {
-            printf("%s wins! All enemy ships have been sunk!\n", currentPlayerName);
+            printf("%s wins! All enemy ships have been sunk!\n", current->name);
+            LOG_EVENT(LOG_LEVEL_GAMES, LOG_GAME_OVER, LOG_FLAG_PRIVATE, game.currentPlayer);
+            recordMatch(&game, game.currentPlayer);
             break;
         }
 
         // Switch players and pause before the next turn
         printf("Switching turns...\n");
-#ifdef _WIN32
-        Sleep(3000); // Wait for 3 seconds (Windows)
-#else
-        sleep(3); // Wait for 3 seconds (Unix/Linux/macOS)
-#endif
+        pauseBetweenTurns();
 
-        currentPlayer = switchPlayer(currentPlayer);
+        game.currentPlayer = switchPlayer(game.currentPlayer);
         clearScreen(); // Clear the screen between player turns
     }
 